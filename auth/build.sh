@@ -1,7 +1,9 @@
 #!/bin/bash
 set -e
 
-gcc src/main/main.c src/header/socket.c src/header/sslsocket.c -o build/auth -O2 -lssl -lcrypto -lsqlite3
+../common/build.sh
+gcc src/main/main.c src/header/userstore.c src/header/hex.c src/header/token.c src/header/sha256mb.c src/header/changelog.c src/header/replica.c ../common/build/libnoble.a -o build/auth -O2 -lssl -lcrypto -lsqlite3 -lpthread
+gcc src/tools/reshard.c src/header/userstore.c src/header/hex.c src/header/sha256mb.c -o build/reshard -O2 -lssl -lcrypto -lsqlite3 -lpthread
 
 if [[ $1 == "run" ]]; then
   cd build
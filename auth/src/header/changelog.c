@@ -0,0 +1,170 @@
+// changelog.c - Implementation of the user change log
+//
+// The log is a text file only ever appended to. The offset of every change is
+// kept in memory, so a replica asking for the changes after any point is served
+// with one pread, however far behind it is.
+#define _GNU_SOURCE
+#include "changelog.h"
+
+#include <stdio.h>          // For printf, fprintf, perror, snprintf, sscanf
+#include <stdlib.h>         // For realloc, free, strtoull, strtol
+#include <string.h>         // For strlen, strcpy, strtok_r
+#include <fcntl.h>          // For open
+#include <unistd.h>         // For pread, write, ftruncate, close
+
+#include <openssl/rand.h>   // For RAND_bytes
+
+#include "hex.h"            // For hexEncode, hexDecode
+
+static int logFD = -1;            // Only used from the event loop thread
+static uint64_t *offsets;         // offsets[n] is where change n + 1 starts; offsets[lastSeq] is the end
+static size_t offsetsCapacity;
+static uint64_t lastSeq;
+static char logId[CHANGE_LOG_ID_LENGTH + 1];
+
+// Record where change seq + 1 starts. Returns 0, or -1 when out of memory.
+static int setOffset(uint64_t seq, uint64_t offset) {
+  if (seq >= offsetsCapacity) {
+    size_t capacity = offsetsCapacity ? offsetsCapacity * 2 : 1024;
+    uint64_t *grown = realloc(offsets, capacity * sizeof(uint64_t));
+    if (!grown) return -1;
+    offsets = grown;
+    offsetsCapacity = capacity;
+  }
+  offsets[seq] = offset;
+  return 0;
+}
+
+int changeLogOpen(const char *path) {
+  logFD = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+  if (logFD < 0) {
+    perror("Error opening change log");
+    return -1;
+  }
+
+  // A new log gets a fresh id first
+  char header[4 + CHANGE_LOG_ID_LENGTH + 2];   // "LOG <id>\n"
+  ssize_t headerLength = pread(logFD, header, sizeof(header) - 1, 0);
+  if (headerLength == 0) {
+    unsigned char random[CHANGE_LOG_ID_LENGTH / 2];
+    if (RAND_bytes(random, sizeof(random)) != 1) return -1;
+    hexEncode(random, sizeof(random), logId);
+    headerLength = snprintf(header, sizeof(header), "LOG %s\n", logId);
+    if (write(logFD, header, (size_t)headerLength) != headerLength) {
+      perror("Error creating change log");
+      return -1;
+    }
+  }
+  header[headerLength < 0 ? 0 : headerLength] = '\0';
+  if (headerLength != (ssize_t)sizeof(header) - 1 || header[headerLength - 1] != '\n' ||
+      sscanf(header, "LOG %16[0-9a-f]", logId) != 1) {
+    fprintf(stderr, "[!] %s is not a change log\n", path);
+    return -1;
+  }
+
+  lastSeq = 0;
+  if (setOffset(0, (uint64_t)headerLength) != 0) return -1;
+
+  // Index every complete line after the header
+  char buffer[65536];
+  uint64_t position = (uint64_t)headerLength;
+  uint64_t lineStart = position;
+  ssize_t bytesRead;
+  while ((bytesRead = pread(logFD, buffer, sizeof(buffer), (off_t)position)) > 0) {
+    for (ssize_t i = 0; i < bytesRead; i++) {
+      if (buffer[i] != '\n') continue;
+      lineStart = position + (uint64_t)i + 1;
+      if (setOffset(lastSeq + 1, lineStart) != 0) {
+        fprintf(stderr, "[!] Out of memory indexing the change log\n");
+        return -1;
+      }
+      lastSeq++;
+    }
+    position += (uint64_t)bytesRead;
+  }
+
+  if (lineStart < position) {
+    fprintf(stderr, "[!] Dropping a partial change at the end of %s\n", path);
+    if (ftruncate(logFD, (off_t)lineStart) < 0) perror("Error truncating change log");
+  }
+
+  printf("[*] Change log %s (id %s): %llu changes\n", path, logId, (unsigned long long)lastSeq);
+  return 0;
+}
+
+const char *changeLogId(void) {
+  return logId;
+}
+
+void changeLogClose(void) {
+  if (logFD >= 0) close(logFD);
+  logFD = -1;
+}
+
+uint64_t changeLogLastSeq(void) {
+  return lastSeq;
+}
+
+int changeLogAppend(const char *username, const UserRecord *record) {
+  if (logFD < 0) return -1;
+
+  char salt[2 * USER_SALT_LENGTH + 1] = "-";
+  if (record->iterations > 0) hexEncode(record->salt, USER_SALT_LENGTH, salt);
+
+  char line[CHANGE_LINE_MAX];
+  int length = snprintf(line, sizeof(line), "%llu %s %s %s %d\n", (unsigned long long)(lastSeq + 1),
+                        username, record->passwordHash, salt, record->iterations);
+  if (length < 0 || (size_t)length >= sizeof(line)) return -1;
+
+  // One write per line with O_APPEND, so a crash leaves at most one partial line
+  if (setOffset(lastSeq + 1, offsets[lastSeq] + (uint64_t)length) != 0 ||
+      write(logFD, line, (size_t)length) != length) {
+    perror("Error appending to change log");
+    return -1;
+  }
+  lastSeq++;
+  return 0;
+}
+
+size_t changeLogRead(uint64_t after, char *buffer, size_t size, uint64_t *through) {
+  if (logFD < 0 || after >= lastSeq) return 0;
+
+  // Take whole lines up to the buffer size
+  uint64_t last = after;
+  while (last < lastSeq && offsets[last + 1] - offsets[after] <= size) last++;
+  if (last == after) return 0;
+
+  size_t length = (size_t)(offsets[last] - offsets[after]);
+  ssize_t bytesRead = pread(logFD, buffer, length, (off_t)offsets[after]);
+  if (bytesRead != (ssize_t)length) return 0;
+
+  *through = last;
+  return length;
+}
+
+int changeLogParse(char *line, uint64_t *seq, char **username, UserRecord *record) {
+  char *state;
+  char *seqText = strtok_r(line, " ", &state);
+  char *name = strtok_r(NULL, " ", &state);
+  char *hash = strtok_r(NULL, " ", &state);
+  char *salt = strtok_r(NULL, " ", &state);
+  char *iterations = strtok_r(NULL, " \r", &state);
+  if (!iterations || strlen(name) >= USER_NAME_MAX || strlen(hash) >= USER_HASH_MAX) return -1;
+
+  char *end;
+  *seq = strtoull(seqText, &end, 10);
+  if (*end != '\0' || *seq == 0) return -1;
+
+  *username = name;
+  strcpy(record->passwordHash, hash);
+  record->iterations = (int)strtol(iterations, &end, 10);
+  if (*end != '\0' || record->iterations < 0) return -1;
+
+  if (record->iterations > 0) {
+    if (hexDecode(salt, record->salt, USER_SALT_LENGTH) != 0) return -1;
+    record->keyValid = hexDecode(record->passwordHash, record->key, USER_KEY_LENGTH) == 0;
+  } else {
+    record->keyValid = 0;
+  }
+  return 0;
+}
@@ -0,0 +1,40 @@
+// changelog.h - Append-only log of user changes, streamed to replicas
+#ifndef CHANGELOG_H
+#define CHANGELOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "userstore.h"
+
+// The log starts with "LOG <id>", a random id telling a recreated log apart from the old
+// one. Then one line per change, numbered from 1: "<seq> <username> <password_hash>
+// <salt hex or -> <iterations>". Each line holds the user's whole row, so applying a
+// change twice is harmless.
+#define CHANGE_LINE_MAX (24 + USER_NAME_MAX + USER_HASH_MAX + 2 * USER_SALT_LENGTH + 16)
+#define CHANGE_LOG_ID_LENGTH 16   // Hex digits in a log id
+
+// Open (or create) the log and index its changes. A partial last line left by a
+// crash is cut off. Returns 0 on success.
+int changeLogOpen(const char *path);
+
+// The open log's id
+const char *changeLogId(void);
+
+// Stop appending; later appends fail. Used once another process owns the log.
+void changeLogClose(void);
+
+// Number of the last change, or 0 for an empty log
+uint64_t changeLogLastSeq(void);
+
+// Append a user's current row as the next change. Returns 0 on success.
+int changeLogAppend(const char *username, const UserRecord *record);
+
+// Copy whole changes after seq after into buffer, as many as fit in size. Sets
+// *through to the last change copied. Returns the bytes copied (0 if none are newer).
+size_t changeLogRead(uint64_t after, char *buffer, size_t size, uint64_t *through);
+
+// Split one change line (without its newline) in place. Returns 0 if it is well formed.
+int changeLogParse(char *line, uint64_t *seq, char **username, UserRecord *record);
+
+#endif // CHANGELOG_H
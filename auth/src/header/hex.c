@@ -0,0 +1,31 @@
+// hex.c - Implementation of hex encoding
+#include "hex.h"
+
+#include <string.h>         // For strlen
+
+void hexEncode(const unsigned char *bytes, size_t length, char *out) {
+  static const char digits[] = "0123456789abcdef";
+  for (size_t i = 0; i < length; i++) {
+    out[2 * i] = digits[bytes[i] >> 4];
+    out[2 * i + 1] = digits[bytes[i] & 0xf];
+  }
+  out[2 * length] = '\0';
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+int hexDecode(const char *hex, unsigned char *out, size_t length) {
+  if (strlen(hex) != 2 * length) return -1;
+  for (size_t i = 0; i < length; i++) {
+    int high = hexValue(hex[2 * i]);
+    int low = hexValue(hex[2 * i + 1]);
+    if (high < 0 || low < 0) return -1;
+    out[i] = (unsigned char)(high << 4 | low);
+  }
+  return 0;
+}
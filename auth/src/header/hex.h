@@ -0,0 +1,13 @@
+// hex.h - Lowercase hex encoding of binary keys, hashes and names
+#ifndef HEX_H
+#define HEX_H
+
+#include <stddef.h>
+
+// Write 2 * length hex digits and a terminating NUL to out
+void hexEncode(const unsigned char *bytes, size_t length, char *out);
+
+// Decode exactly length bytes from a string of 2 * length hex digits. Returns 0 on success.
+int hexDecode(const char *hex, unsigned char *out, size_t length);
+
+#endif // HEX_H
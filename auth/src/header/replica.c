@@ -0,0 +1,315 @@
+// replica.c - Implementation of the replication client
+//
+// The replica sends "REPLICATE <log id> <last change applied>". The primary answers
+// with "LOG <id>" and "HEAD <last change>", then streams every later change, one
+// line each, with another HEAD whenever it has been quiet for a heartbeat. A log
+// id other than ours means the primary's log was recreated, so the stream starts
+// again at its first change. Changes carry whole rows, so replaying one is
+// harmless and the position only needs to be saved after each batch.
+#define _GNU_SOURCE
+#include "replica.h"
+
+#include <stdio.h>         // For printf, fprintf, perror, snprintf, sscanf
+#include <stdlib.h>        // For strtoull
+#include <string.h>        // For memcpy, memchr, memmove, strncmp, strrchr, strerror
+#include <errno.h>         // For errno, EINPROGRESS, EAGAIN
+#include <fcntl.h>         // For open
+#include <unistd.h>        // For close, pread, pwrite, ftruncate
+#include <netdb.h>         // For getaddrinfo
+#include <sys/socket.h>    // For socket, connect, send, recv
+#include <sys/un.h>        // For sockaddr_un
+
+#include "userstore.h"     // For userStoreSet, userStoreTransaction
+#include "changelog.h"     // For changeLogParse, CHANGE_LOG_ID_LENGTH
+#include "../../../common/src/header/pool.h"     // For bufferAcquire
+#include "../../../common/src/header/metrics.h"  // For metricsRegister
+
+// Only used from the event loop thread
+static EventLoop *replicaLoop;
+static struct sockaddr_storage primaryAddress;
+static socklen_t primaryAddressLength;
+static const char *primaryName;
+static int primaryFD = -1;
+static int connecting;           // Non-blocking connect still in progress
+static EventHandler primaryHandler;
+static Timer primaryTimer;       // Silence deadline while connected, retry delay otherwise
+static char *input;              // Pooled buffer holding a partial line, or NULL
+static size_t inputLength;
+static int stateFD = -1;
+
+static char logId[CHANGE_LOG_ID_LENGTH + 1];   // Primary's log being followed, or "" before the first
+static uint64_t applied;         // Last change applied to the local store
+static uint64_t primarySeq;      // Last change the primary is known to have
+static uint64_t caughtUpMs;      // When applied last reached primarySeq
+static int connected;            // Streaming from the primary
+
+static double readConnected(const void *data) {
+  (void)data;
+  return connected;
+}
+
+static double readCounter(const void *data) {
+  return (double)*(const uint64_t *)data;
+}
+
+static double readLagChanges(const void *data) {
+  (void)data;
+  return primarySeq > applied ? (double)(primarySeq - applied) : 0;
+}
+
+static double readLagSeconds(const void *data) {
+  (void)data;
+  uint64_t now = monotonicMs();
+  return applied >= primarySeq && connected ? 0 : (double)(now - caughtUpMs) / 1000.0;
+}
+
+// Parse "unix:/path" or "host:port" into primaryAddress
+static int resolveAddress(const char *address) {
+  if (strncmp(address, "unix:", 5) == 0) {
+    struct sockaddr_un *unixAddress = (struct sockaddr_un *)&primaryAddress;
+    const char *path = address + 5;
+    if (strlen(path) >= sizeof(unixAddress->sun_path)) {
+      fprintf(stderr, "[!] Primary socket path too long: %s\n", path);
+      return -1;
+    }
+    unixAddress->sun_family = AF_UNIX;
+    strcpy(unixAddress->sun_path, path);
+    primaryAddressLength = sizeof(struct sockaddr_un);
+    return 0;
+  }
+
+  char host[256];
+  const char *colon = strrchr(address, ':');
+  if (!colon || (size_t)(colon - address) >= sizeof(host)) {
+    fprintf(stderr, "[!] Primary address must be host:port or unix:/path, got %s\n", address);
+    return -1;
+  }
+  memcpy(host, address, (size_t)(colon - address));
+  host[colon - address] = '\0';
+
+  struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+  struct addrinfo *result;
+  int status = getaddrinfo(host, colon + 1, &hints, &result);
+  if (status != 0) {
+    fprintf(stderr, "[!] Cannot resolve primary %s: %s\n", address, gai_strerror(status));
+    return -1;
+  }
+  memcpy(&primaryAddress, result->ai_addr, result->ai_addrlen);
+  primaryAddressLength = result->ai_addrlen;
+  freeaddrinfo(result);
+  return 0;
+}
+
+// Remember the log and the last change applied, for the next start
+static void saveState(void) {
+  char text[64];
+  int length = snprintf(text, sizeof(text), "%s %llu\n", logId[0] ? logId : "-", (unsigned long long)applied);
+  if (pwrite(stateFD, text, (size_t)length, 0) != length || ftruncate(stateFD, length) < 0) {
+    perror("Error saving replication position");
+  }
+}
+
+// Close the connection and try again after a pause
+static void disconnect(void) {
+  if (primaryFD >= 0) {
+    eventLoopRemove(replicaLoop, &primaryHandler);
+    close(primaryFD);
+    primaryFD = -1;
+  }
+  if (input) bufferRelease(input);
+  input = NULL;
+  inputLength = 0;
+  if (connected) fprintf(stderr, "[!] Lost the primary at change %llu\n", (unsigned long long)applied);
+  connected = 0;
+
+  timerCancel(eventLoopTimers(replicaLoop), &primaryTimer);
+  timerArm(eventLoopTimers(replicaLoop), &primaryTimer, REPLICA_RETRY_MS);
+}
+
+// Apply one line from the primary. Returns -1 if the stream makes no sense.
+static int applyLine(char *line) {
+  if (strncmp(line, "HEAD ", 5) == 0) {
+    primarySeq = strtoull(line + 5, NULL, 10);
+    return 0;
+  }
+  if (strncmp(line, "LOG ", 4) == 0) {
+    if (strcmp(line + 4, logId) == 0) return 0;
+    if (logId[0]) fprintf(stderr, "[!] Primary's change log was recreated; replaying it from the start\n");
+    snprintf(logId, sizeof(logId), "%s", line + 4);
+    applied = 0;
+    primarySeq = 0;
+    return 0;
+  }
+  if (strcmp(line, "false") == 0) {
+    fprintf(stderr, "[!] %s refused to stream changes (not a primary?)\n", primaryName);
+    return -1;
+  }
+
+  uint64_t seq;
+  char *username;
+  UserRecord record;
+  if (changeLogParse(line, &seq, &username, &record) != 0 || seq != applied + 1) {
+    fprintf(stderr, "[!] Unexpected change from the primary after %llu\n", (unsigned long long)applied);
+    return -1;
+  }
+  if (userStoreSet(username, &record) != 0) return -1;
+
+  applied = seq;
+  if (seq > primarySeq) primarySeq = seq;
+  return 0;
+}
+
+// Apply every complete line received, in one transaction
+static int applyInput(void) {
+  char *start = input;
+  char *end = input + inputLength;
+  char *newline;
+  int status = 0;
+
+  userStoreTransaction(1);
+  while (status == 0 && (newline = memchr(start, '\n', (size_t)(end - start)))) {
+    *newline = '\0';
+    status = applyLine(start);
+    start = newline + 1;
+  }
+  userStoreTransaction(0);
+  saveState();
+
+  if (applied >= primarySeq) caughtUpMs = eventLoopNow(replicaLoop);
+
+  // Keep a partial line for the next read
+  inputLength = (size_t)(end - start);
+  memmove(input, start, inputLength);
+  return status;
+}
+
+static void onPrimaryReady(EventLoop *loop, EventHandler *handler, uint32_t events) {
+  (void)loop;
+  (void)handler;
+
+  if (connecting) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    getsockopt(primaryFD, SOL_SOCKET, SO_ERROR, &error, &length);
+    if (error != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+      fprintf(stderr, "[!] Cannot connect to primary %s: %s\n", primaryName, strerror(error ? error : ECONNREFUSED));
+      disconnect();
+      return;
+    }
+    connecting = 0;
+
+    // The request is tiny, so a fresh socket takes it whole
+    char request[64];
+    int requestLength = snprintf(request, sizeof(request), "REPLICATE %s %llu\n",
+                                 logId[0] ? logId : "-", (unsigned long long)applied);
+    if (send(primaryFD, request, (size_t)requestLength, MSG_NOSIGNAL) != requestLength) {
+      disconnect();
+      return;
+    }
+    connected = 1;
+    printf("[+] Replicating from %s after change %llu\n", primaryName, (unsigned long long)applied);
+    eventLoopModify(replicaLoop, &primaryHandler, EPOLLIN);
+  }
+
+  while (1) {
+    if (!input && !(input = bufferAcquire())) {
+      disconnect();
+      return;
+    }
+    if (inputLength == POOL_BUFFER_SIZE) {
+      disconnect();  // A line longer than any change
+      return;
+    }
+
+    ssize_t bytesRead = recv(primaryFD, input + inputLength, POOL_BUFFER_SIZE - inputLength, 0);
+    if (bytesRead < 0 && (errno == EAGAIN || errno == EINTR)) break;
+    if (bytesRead <= 0) {
+      disconnect();
+      return;
+    }
+
+    inputLength += (size_t)bytesRead;
+    if (applyInput() != 0) {
+      disconnect();
+      return;
+    }
+  }
+  if (inputLength == 0) {
+    bufferRelease(input);
+    input = NULL;
+  }
+
+  // The primary sends a heartbeat at least this often
+  timerCancel(eventLoopTimers(replicaLoop), &primaryTimer);
+  timerArm(eventLoopTimers(replicaLoop), &primaryTimer, REPLICA_SILENCE_MS);
+}
+
+// Start connecting to the primary
+static void openPrimary(void) {
+  int fd = socket(primaryAddress.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("Error creating primary socket");
+    timerArm(eventLoopTimers(replicaLoop), &primaryTimer, REPLICA_RETRY_MS);
+    return;
+  }
+
+  int status = connect(fd, (struct sockaddr *)&primaryAddress, primaryAddressLength);
+  if ((status != 0 && errno != EINPROGRESS) ||
+      eventLoopAdd(replicaLoop, &primaryHandler, fd, EPOLLOUT, onPrimaryReady, NULL) != 0) {
+    close(fd);
+    timerArm(eventLoopTimers(replicaLoop), &primaryTimer, REPLICA_RETRY_MS);
+    return;
+  }
+
+  primaryFD = fd;
+  connecting = 1;
+  timerArm(eventLoopTimers(replicaLoop), &primaryTimer, REPLICA_SILENCE_MS);
+}
+
+// Silence from the primary, or time to retry after a failure
+static void onPrimaryTimer(Timer *timer) {
+  (void)timer;
+  if (primaryFD >= 0) {
+    fprintf(stderr, "[!] Primary %s went quiet\n", primaryName);
+    disconnect();
+    return;
+  }
+  openPrimary();
+}
+
+int replicaStart(EventLoop *loop, const char *address, const char *statePath) {
+  replicaLoop = loop;
+  primaryName = address;
+  if (resolveAddress(address) != 0) return -1;
+
+  stateFD = open(statePath, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (stateFD < 0) {
+    perror("Error opening replication state");
+    return -1;
+  }
+  char text[64] = { 0 };
+  unsigned long long savedApplied;
+  if (pread(stateFD, text, sizeof(text) - 1, 0) > 0 &&
+      sscanf(text, "%16s %llu", logId, &savedApplied) == 2) {
+    applied = savedApplied;
+    if (strcmp(logId, "-") == 0) logId[0] = '\0';
+  }
+  primarySeq = applied;
+  caughtUpMs = eventLoopNow(loop);
+
+  metricsRegister("auth_replica_connected", "Whether the replica is streaming from its primary",
+                  METRIC_GAUGE, readConnected, NULL);
+  metricsRegister("auth_replica_applied_change", "Last change from the primary applied locally",
+                  METRIC_GAUGE, readCounter, &applied);
+  metricsRegister("auth_replica_primary_change", "Last change the primary is known to have",
+                  METRIC_GAUGE, readCounter, &primarySeq);
+  metricsRegister("auth_replica_lag_changes", "Changes the primary has that are not applied yet",
+                  METRIC_GAUGE, readLagChanges, NULL);
+  metricsRegister("auth_replica_lag_seconds", "Time since the replica was last caught up with its primary",
+                  METRIC_GAUGE, readLagSeconds, NULL);
+
+  printf("[*] Read-only replica of %s\n", address);
+  timerInit(&primaryTimer, onPrimaryTimer, NULL);
+  openPrimary();
+  return 0;
+}
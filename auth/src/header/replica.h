@@ -0,0 +1,17 @@
+// replica.h - Follow a primary auth server's change log into the local user store
+#ifndef REPLICA_H
+#define REPLICA_H
+
+#include "../../../common/src/header/eventloop.h"
+
+#define REPLICA_HEARTBEAT_MS 1000    // Primary says where its log ends after this long without changes
+#define REPLICA_SILENCE_MS 5000      // Reconnect after hearing nothing from the primary for this long
+#define REPLICA_RETRY_MS 1000        // Wait before reconnecting after a failure
+
+// Connect to the primary at address ("host:port" or "unix:/path") and apply its
+// changes as they arrive, reconnecting whenever the connection is lost. The last
+// change applied is kept in statePath, so a restart resumes where it stopped.
+// Returns 0 on success.
+int replicaStart(EventLoop *loop, const char *address, const char *statePath);
+
+#endif // REPLICA_H
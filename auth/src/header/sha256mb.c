@@ -0,0 +1,261 @@
+// sha256mb.c - Multi-buffer PBKDF2-HMAC-SHA256 with runtime instruction set selection
+#include "sha256mb.h"
+
+#include <string.h>         // For memcpy, memset, strcmp
+#include <openssl/crypto.h> // For OPENSSL_cleanse
+#include <openssl/evp.h>    // For EVP_sha256
+#include <openssl/hmac.h>   // For HMAC
+#include <openssl/sha.h>    // For SHA256
+
+static const uint32_t sha256RoundConstants[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256InitialState[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// Written so they work on plain words and on vectors of words alike
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z) (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define BIG_SIGMA0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define BIG_SIGMA1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SIGMA0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SIGMA1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+// One lane: the portable fallback
+#define LANES 1
+#define LANE_FUNCTION iterateScalar
+#define LANE_TARGET
+#include "sha256mb_lanes.h"
+#undef LANES
+#undef LANE_FUNCTION
+#undef LANE_TARGET
+
+#ifdef __x86_64__
+#define LANES 4
+#define LANE_FUNCTION iterateSSE2
+#define LANE_TARGET __attribute__((target("sse2")))
+#include "sha256mb_lanes.h"
+#undef LANES
+#undef LANE_FUNCTION
+#undef LANE_TARGET
+
+#define LANES 8
+#define LANE_FUNCTION iterateAVX2
+#define LANE_TARGET __attribute__((target("avx2")))
+#include "sha256mb_lanes.h"
+#undef LANES
+#undef LANE_FUNCTION
+#undef LANE_TARGET
+
+#define LANES 16
+#define LANE_FUNCTION iterateAVX512
+#define LANE_TARGET __attribute__((target("avx512f")))
+#include "sha256mb_lanes.h"
+#undef LANES
+#undef LANE_FUNCTION
+#undef LANE_TARGET
+#endif
+
+typedef void (*IterateFunction)(const uint32_t inner[8][SHA256MB_MAX_LANES],
+                                const uint32_t outer[8][SHA256MB_MAX_LANES],
+                                uint32_t result[8][SHA256MB_MAX_LANES],
+                                const uint32_t iterations[SHA256MB_MAX_LANES]);
+
+typedef struct {
+  const char *name;
+  int lanes;
+  IterateFunction iterate;
+  const char *feature;      // CPU feature it needs, or NULL
+} Implementation;
+
+// Widest first
+static const Implementation implementations[] = {
+#ifdef __x86_64__
+  { "avx512", 16, iterateAVX512, "avx512f" },
+  { "avx2", 8, iterateAVX2, "avx2" },
+  { "sse2", 4, iterateSSE2, "sse2" },
+#endif
+  { "scalar", 1, iterateScalar, NULL },
+};
+
+static Implementation implementation;
+
+static int cpuSupports(const Implementation *candidate) {
+  if (!candidate->feature) return 1;
+#ifdef __x86_64__
+  __builtin_cpu_init();
+  if (strcmp(candidate->feature, "avx512f") == 0) return __builtin_cpu_supports("avx512f");
+  if (strcmp(candidate->feature, "avx2") == 0) return __builtin_cpu_supports("avx2");
+  if (strcmp(candidate->feature, "sse2") == 0) return __builtin_cpu_supports("sse2");
+#endif
+  return 0;
+}
+
+// Racing threads all compute the same answer; publish the function last
+static void publish(const Implementation *chosen) {
+  implementation.name = chosen->name;
+  implementation.lanes = chosen->lanes;
+  __atomic_store_n(&implementation.iterate, chosen->iterate, __ATOMIC_RELEASE);
+}
+
+// Pick the widest implementation the CPU supports, once
+static const Implementation *selectImplementation(void) {
+  if (implementation.iterate) return &implementation;
+
+  size_t count = sizeof(implementations) / sizeof(implementations[0]);
+  for (size_t i = 0; i < count; i++) {
+    if (cpuSupports(&implementations[i])) {
+      publish(&implementations[i]);
+      break;
+    }
+  }
+  return &implementation;
+}
+
+int sha256mbUse(const char *name) {
+  size_t count = sizeof(implementations) / sizeof(implementations[0]);
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(implementations[i].name, name) == 0 && cpuSupports(&implementations[i])) {
+      publish(&implementations[i]);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+int sha256mbLanes(void) {
+  return selectImplementation()->lanes;
+}
+
+const char *sha256mbName(void) {
+  return selectImplementation()->name;
+}
+
+// Plain single-block SHA-256 compression, used to absorb the HMAC key pads
+static void compressBlock(uint32_t state[8], const unsigned char block[64]) {
+  uint32_t w[64];
+  for (int i = 0; i < 16; i++) {
+    w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 |
+           (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+  }
+  for (int i = 16; i < 64; i++) {
+    w[i] = SIGMA1(w[i - 2]) + w[i - 7] + SIGMA0(w[i - 15]) + w[i - 16];
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+  for (int r = 0; r < 64; r++) {
+    uint32_t t1 = h + BIG_SIGMA1(e) + CH(e, f, g) + sha256RoundConstants[r] + w[r];
+    uint32_t t2 = BIG_SIGMA0(a) + MAJ(a, b, c);
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+// HMAC state after absorbing (key XOR pad)
+static void padState(const unsigned char key[64], unsigned char pad, uint32_t state[8]) {
+  unsigned char block[64];
+  for (int i = 0; i < 64; i++) block[i] = key[i] ^ pad;
+  memcpy(state, sha256InitialState, sizeof(sha256InitialState));
+  compressBlock(state, block);
+  OPENSSL_cleanse(block, sizeof(block));
+}
+
+// Set up one lane: HMAC key states and U1 = HMAC(password, salt || INT(1))
+static void loadLane(const PBKDF2Job *job, int lane, uint32_t inner[8][SHA256MB_MAX_LANES],
+                     uint32_t outer[8][SHA256MB_MAX_LANES], uint32_t result[8][SHA256MB_MAX_LANES],
+                     uint32_t iterations[SHA256MB_MAX_LANES]) {
+  unsigned char key[64] = {0};
+  if (job->passwordLength > sizeof(key)) {
+    SHA256((const unsigned char *)job->password, job->passwordLength, key);
+  } else {
+    memcpy(key, job->password, job->passwordLength);
+  }
+
+  uint32_t innerState[8], outerState[8];
+  padState(key, 0x36, innerState);
+  padState(key, 0x5c, outerState);
+
+  unsigned char message[256 + 4];
+  unsigned char first[SHA256MB_KEY_LENGTH];
+  size_t saltLength = job->saltLength < 256 ? job->saltLength : 256;
+  memcpy(message, job->salt, saltLength);
+  message[saltLength] = 0;
+  message[saltLength + 1] = 0;
+  message[saltLength + 2] = 0;
+  message[saltLength + 3] = 1;
+  HMAC(EVP_sha256(), key, sizeof(key), message, saltLength + 4, first, NULL);
+
+  for (int i = 0; i < 8; i++) {
+    inner[i][lane] = innerState[i];
+    outer[i][lane] = outerState[i];
+    result[i][lane] = (uint32_t)first[4 * i] << 24 | (uint32_t)first[4 * i + 1] << 16 |
+                      (uint32_t)first[4 * i + 2] << 8 | first[4 * i + 3];
+  }
+  iterations[lane] = job->iterations;
+
+  OPENSSL_cleanse(key, sizeof(key));
+  OPENSSL_cleanse(innerState, sizeof(innerState));
+  OPENSSL_cleanse(outerState, sizeof(outerState));
+  OPENSSL_cleanse(first, sizeof(first));
+}
+
+void pbkdf2Sha256Batch(PBKDF2Job *jobs, size_t count) {
+  const Implementation *impl = selectImplementation();
+  uint32_t inner[8][SHA256MB_MAX_LANES], outer[8][SHA256MB_MAX_LANES];
+  uint32_t result[8][SHA256MB_MAX_LANES], iterations[SHA256MB_MAX_LANES];
+
+  for (size_t start = 0; start < count; start += impl->lanes) {
+    size_t group = count - start < (size_t)impl->lanes ? count - start : (size_t)impl->lanes;
+
+    // Unused lanes run with one iteration and are never read back
+    memset(inner, 0, sizeof(inner));
+    memset(outer, 0, sizeof(outer));
+    memset(result, 0, sizeof(result));
+    memset(iterations, 0, sizeof(iterations));
+    for (size_t lane = 0; lane < group; lane++) {
+      loadLane(&jobs[start + lane], (int)lane, inner, outer, result, iterations);
+    }
+
+    impl->iterate(inner, outer, result, iterations);
+
+    for (size_t lane = 0; lane < group; lane++) {
+      unsigned char *key = jobs[start + lane].key;
+      for (int i = 0; i < 8; i++) {
+        key[4 * i] = (unsigned char)(result[i][lane] >> 24);
+        key[4 * i + 1] = (unsigned char)(result[i][lane] >> 16);
+        key[4 * i + 2] = (unsigned char)(result[i][lane] >> 8);
+        key[4 * i + 3] = (unsigned char)result[i][lane];
+      }
+    }
+  }
+
+  OPENSSL_cleanse(inner, sizeof(inner));
+  OPENSSL_cleanse(outer, sizeof(outer));
+  OPENSSL_cleanse(result, sizeof(result));
+}
@@ -0,0 +1,35 @@
+// sha256mb.h - Multi-buffer SHA-256: PBKDF2 for several passwords at once in SIMD lanes
+#ifndef SHA256MB_H
+#define SHA256MB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256MB_MAX_LANES 16   // Widest implementation (AVX-512: 16 x 32-bit lanes)
+#define SHA256MB_KEY_LENGTH 32  // Output of one PBKDF2-HMAC-SHA256 block
+
+// One PBKDF2-HMAC-SHA256 derivation with a single-block (32-byte) output
+typedef struct {
+  const char *password;
+  size_t passwordLength;
+  const unsigned char *salt;
+  size_t saltLength;
+  uint32_t iterations;
+  unsigned char key[SHA256MB_KEY_LENGTH];   // Result
+} PBKDF2Job;
+
+// Number of derivations the selected implementation runs side by side (1, 4, 8 or 16)
+int sha256mbLanes(void);
+
+// Name of the selected implementation, for logging
+const char *sha256mbName(void);
+
+// Use the named implementation ("scalar", "sse2", "avx2" or "avx512") instead of the
+// widest one, for benchmarks and checks. Returns -1 if the CPU doesn't support it.
+int sha256mbUse(const char *name);
+
+// Derive keys for all jobs. Jobs are run in groups of sha256mbLanes(), each
+// group iterating in lockstep, so a batch costs about as much as its longest job.
+void pbkdf2Sha256Batch(PBKDF2Job *jobs, size_t count);
+
+#endif // SHA256MB_H
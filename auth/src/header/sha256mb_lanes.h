@@ -0,0 +1,98 @@
+// sha256mb_lanes.h - PBKDF2 iteration loop over LANES parallel SHA-256 states
+//
+// Included by sha256mb.c once per instruction set, with these defined:
+//   LANES          number of 32-bit lanes in a vector
+//   LANE_FUNCTION  name of the generated function
+//   LANE_TARGET    function attribute selecting the instruction set (may be empty)
+//
+// All state is kept as words, one vector per word with one password per lane,
+// so no byte swapping or transposing happens inside the iteration loop.
+
+#define LANE_COMPRESS LANE_CONCAT(LANE_FUNCTION, Compress)
+#define LANE_VECTOR LANE_CONCAT(LANE_FUNCTION, Vector)
+#define LANE_CONCAT(a, b) LANE_CONCAT2(a, b)
+#define LANE_CONCAT2(a, b) a##b
+
+typedef uint32_t LANE_VECTOR __attribute__((vector_size(LANES * 4)));
+
+// Compress one block made of eight message words plus the fixed padding of a
+// 32-byte message that follows a 64-byte key block (as in every HMAC step)
+LANE_TARGET __attribute__((always_inline))
+static inline void LANE_COMPRESS(LANE_VECTOR out[8], const LANE_VECTOR init[8], const LANE_VECTOR message[8]) {
+  const LANE_VECTOR zero = {0};
+  LANE_VECTOR w[16];
+  for (int i = 0; i < 8; i++) w[i] = message[i];
+  w[8] = zero + 0x80000000u;
+  for (int i = 9; i < 15; i++) w[i] = zero;
+  w[15] = zero + (64 + 32) * 8;
+
+  LANE_VECTOR a = init[0], b = init[1], c = init[2], d = init[3];
+  LANE_VECTOR e = init[4], f = init[5], g = init[6], h = init[7];
+
+  #pragma GCC unroll 64
+  for (int r = 0; r < 64; r++) {
+    if (r >= 16) {
+      LANE_VECTOR w15 = w[(r - 15) & 15];
+      LANE_VECTOR w2 = w[(r - 2) & 15];
+      w[r & 15] += SIGMA0(w15) + w[(r - 7) & 15] + SIGMA1(w2);
+    }
+
+    LANE_VECTOR t1 = h + BIG_SIGMA1(e) + CH(e, f, g) + sha256RoundConstants[r] + w[r & 15];
+    LANE_VECTOR t2 = BIG_SIGMA0(a) + MAJ(a, b, c);
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+
+  out[0] = init[0] + a;
+  out[1] = init[1] + b;
+  out[2] = init[2] + c;
+  out[3] = init[3] + d;
+  out[4] = init[4] + e;
+  out[5] = init[5] + f;
+  out[6] = init[6] + g;
+  out[7] = init[7] + h;
+}
+
+// Run PBKDF2 iterations 2..n. result holds U1 on entry and T on return;
+// inner/outer are the HMAC key states. Lanes stop accumulating at their own count.
+LANE_TARGET
+static void LANE_FUNCTION(const uint32_t inner[8][SHA256MB_MAX_LANES],
+                          const uint32_t outer[8][SHA256MB_MAX_LANES],
+                          uint32_t result[8][SHA256MB_MAX_LANES],
+                          const uint32_t iterations[SHA256MB_MAX_LANES]) {
+  LANE_VECTOR innerState[8], outerState[8], u[8], t[8], digest[8], remaining;
+  uint32_t rounds = 0;
+
+  for (int i = 0; i < 8; i++) {
+    memcpy(&innerState[i], inner[i], sizeof(LANE_VECTOR));
+    memcpy(&outerState[i], outer[i], sizeof(LANE_VECTOR));
+    memcpy(&u[i], result[i], sizeof(LANE_VECTOR));
+    t[i] = u[i];
+  }
+  memcpy(&remaining, iterations, sizeof(LANE_VECTOR));
+  for (int lane = 0; lane < LANES; lane++) {
+    if (iterations[lane] > rounds) rounds = iterations[lane];
+  }
+
+  for (uint32_t n = 1; n < rounds; n++) {
+    // U(n+1) = HMAC(U(n)) = H(outer || H(inner || U(n)))
+    LANE_COMPRESS(digest, innerState, u);
+    LANE_COMPRESS(u, outerState, digest);
+
+    LANE_VECTOR active = (LANE_VECTOR)(remaining > n);
+    for (int i = 0; i < 8; i++) t[i] ^= u[i] & active;
+  }
+
+  for (int i = 0; i < 8; i++) memcpy(result[i], &t[i], sizeof(LANE_VECTOR));
+}
+
+#undef LANE_COMPRESS
+#undef LANE_CONCAT
+#undef LANE_CONCAT2
+#undef LANE_VECTOR
@@ -0,0 +1,160 @@
+// token.c - Implementation of HMAC session tokens
+//
+// A token is "expires.hex(username).hex(mac)", where mac is HMAC-SHA256 over
+// "expires.hex(username)" keyed by the key of the epoch the token was issued in.
+// Epoch keys are HMAC(master key, epoch number), so a leaked epoch key only
+// forges tokens for that epoch, and no state is shared between checks.
+#include "token.h"
+
+#include <stdio.h>          // For fprintf, snprintf, perror
+#include <stdint.h>         // For int64_t, uint64_t
+#include <errno.h>          // For errno, EEXIST
+#include <string.h>         // For strlen, strchr, memcpy
+#include <time.h>           // For time
+#include <fcntl.h>          // For open
+#include <unistd.h>         // For read, write, close
+#include <openssl/crypto.h> // For CRYPTO_memcmp, OPENSSL_cleanse
+#include <openssl/evp.h>    // For EVP_sha256
+#include <openssl/hmac.h>   // For HMAC
+#include <openssl/rand.h>   // For RAND_bytes
+
+#include "hex.h"            // For hexEncode, hexDecode
+
+#define TOKEN_MAC_LENGTH 32
+
+// Derived key for one epoch; the current and previous epochs are kept
+typedef struct {
+  int64_t epoch;
+  int valid;
+  unsigned char key[TOKEN_MAC_LENGTH];
+} EpochKey;
+
+// Only used from the event loop thread
+static unsigned char masterKey[TOKEN_MASTER_KEY_LENGTH];
+static EpochKey epochKeys[2];
+
+// Read the key file, or create it with a fresh random key. Returns 0 on success.
+static int loadMasterKey(const char *keyPath, unsigned char key[TOKEN_MASTER_KEY_LENGTH]) {
+  int fd = open(keyPath, O_RDONLY | O_CLOEXEC);
+  if (fd >= 0) {
+    ssize_t bytesRead = read(fd, key, TOKEN_MASTER_KEY_LENGTH);
+    close(fd);
+    if (bytesRead != TOKEN_MASTER_KEY_LENGTH) {
+      fprintf(stderr, "[!] %s must hold at least %d bytes\n", keyPath, TOKEN_MASTER_KEY_LENGTH);
+      return 1;
+    }
+    return 0;
+  }
+
+  if (RAND_bytes(key, TOKEN_MASTER_KEY_LENGTH) != 1) return 1;
+
+  // Only the owner may read the key; if another process wins the race, use its key
+  fd = open(keyPath, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    if (errno == EEXIST) return loadMasterKey(keyPath, key);
+    perror("Error creating token key");
+    fprintf(stderr, "[!] Tokens will not survive a restart\n");
+    return 0;
+  }
+  if (write(fd, key, TOKEN_MASTER_KEY_LENGTH) != TOKEN_MASTER_KEY_LENGTH) {
+    perror("Error writing token key");
+  }
+  close(fd);
+  printf("[+] Created token key %s\n", keyPath);
+  return 0;
+}
+
+static void forgetEpochKeys(void) {
+  OPENSSL_cleanse(epochKeys, sizeof(epochKeys));
+}
+
+int tokenInit(const char *keyPath) {
+  forgetEpochKeys();
+  return loadMasterKey(keyPath, masterKey);
+}
+
+void tokenReload(const char *keyPath) {
+  unsigned char fresh[TOKEN_MASTER_KEY_LENGTH];
+  if (loadMasterKey(keyPath, fresh) != 0) {
+    fprintf(stderr, "[!] Token key reload failed, keeping current key\n");
+    return;
+  }
+
+  memcpy(masterKey, fresh, sizeof(masterKey));
+  OPENSSL_cleanse(fresh, sizeof(fresh));
+  forgetEpochKeys();
+}
+
+// Signing key for an epoch, derived on first use
+static const unsigned char *epochKey(int64_t epoch) {
+  EpochKey *slot = &epochKeys[epoch & 1];
+  if (!slot->valid || slot->epoch != epoch) {
+    unsigned char label[8];
+    for (int i = 0; i < 8; i++) label[i] = (unsigned char)((uint64_t)epoch >> (56 - 8 * i));
+    HMAC(EVP_sha256(), masterKey, sizeof(masterKey), label, sizeof(label), slot->key, NULL);
+    slot->epoch = epoch;
+    slot->valid = 1;
+  }
+  return slot->key;
+}
+
+// Hex MAC of the signed part of a token
+static void sign(int64_t expires, const char *body, size_t length, char mac[2 * TOKEN_MAC_LENGTH + 1]) {
+  unsigned char digest[TOKEN_MAC_LENGTH];
+  int64_t epoch = (expires - TOKEN_LIFETIME_SECONDS) / TOKEN_EPOCH_SECONDS;
+  HMAC(EVP_sha256(), epochKey(epoch), TOKEN_MAC_LENGTH, (const unsigned char *)body, length, digest, NULL);
+  hexEncode(digest, TOKEN_MAC_LENGTH, mac);
+}
+
+int tokenIssue(const char *username, char *token, size_t size) {
+  size_t nameLength = strlen(username);
+  if (nameLength >= USER_NAME_MAX) return 1;
+
+  char name[2 * USER_NAME_MAX + 1];
+  hexEncode((const unsigned char *)username, nameLength, name);
+
+  int64_t expires = (int64_t)time(NULL) + TOKEN_LIFETIME_SECONDS;
+  int length = snprintf(token, size, "%lld.%s.", (long long)expires, name);
+  if (length < 0 || (size_t)length + 2 * TOKEN_MAC_LENGTH >= size) return 1;
+
+  // The MAC covers everything before the final dot
+  sign(expires, token, (size_t)length - 1, token + length);
+  return 0;
+}
+
+int tokenVerify(const char *token, char *username, size_t size) {
+  // expires: decimal digits only
+  int64_t expires = 0;
+  const char *cursor = token;
+  while (*cursor >= '0' && *cursor <= '9' && cursor - token < 18) {
+    expires = expires * 10 + (*cursor++ - '0');
+  }
+  if (cursor == token || *cursor != '.') return 0;
+
+  const char *name = cursor + 1;
+  const char *macStart = strchr(name, '.');
+  if (!macStart) return 0;
+  size_t nameHexLength = (size_t)(macStart - name);
+  macStart++;
+
+  // Expired, or claiming a lifetime we never issue
+  int64_t now = (int64_t)time(NULL);
+  if (expires <= now || expires > now + TOKEN_LIFETIME_SECONDS) return 0;
+
+  char expected[2 * TOKEN_MAC_LENGTH + 1];
+  sign(expires, token, (size_t)(macStart - 1 - token), expected);
+  if (strlen(macStart) != 2 * TOKEN_MAC_LENGTH ||
+      CRYPTO_memcmp(macStart, expected, 2 * TOKEN_MAC_LENGTH) != 0) {
+    return 0;
+  }
+
+  // Signed, so the name is ours; decode it for the caller
+  if (nameHexLength % 2 != 0 || nameHexLength / 2 >= size) return 0;
+  char nameHex[2 * USER_NAME_MAX + 1];
+  if (nameHexLength >= sizeof(nameHex)) return 0;
+  memcpy(nameHex, name, nameHexLength);
+  nameHex[nameHexLength] = '\0';
+  if (hexDecode(nameHex, (unsigned char *)username, nameHexLength / 2) != 0) return 0;
+  username[nameHexLength / 2] = '\0';
+  return 1;
+}
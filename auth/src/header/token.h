@@ -0,0 +1,28 @@
+// token.h - Short-lived session tokens signed with rotating HMAC keys
+#ifndef TOKEN_H
+#define TOKEN_H
+
+#include <stddef.h>
+
+#include "userstore.h"
+
+#define TOKEN_LIFETIME_SECONDS 900    // How long an issued token is accepted
+#define TOKEN_EPOCH_SECONDS 3600      // Signing keys rotate this often (at least the lifetime)
+#define TOKEN_MASTER_KEY_LENGTH 32    // Secret the epoch keys are derived from, in bytes
+#define TOKEN_MAX_LENGTH (24 + 2 * USER_NAME_MAX + 64)  // "expires.hex(username).hex(mac)"
+
+// Load the master key from keyPath, creating the file with a random key if it doesn't
+// exist, so tokens survive restarts and upgrades. Returns 0 on success.
+int tokenInit(const char *keyPath);
+
+// Re-read the master key, invalidating tokens signed with the old one. Keeps the old key on failure.
+void tokenReload(const char *keyPath);
+
+// Issue a token for username into token (at least TOKEN_MAX_LENGTH bytes). Returns 0 on success.
+int tokenIssue(const char *username, char *token, size_t size);
+
+// Check a token's signature and expiry without touching the database.
+// Returns 1 and copies out the username if it's valid, 0 otherwise.
+int tokenVerify(const char *token, char *username, size_t size);
+
+#endif // TOKEN_H
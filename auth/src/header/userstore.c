@@ -0,0 +1,371 @@
+// userstore.c - Implementation of the SQLite user store
+#include "userstore.h"
+
+#include <stdio.h>          // For fprintf, printf, snprintf
+#include <stdint.h>         // For uint32_t
+#include <string.h>         // For strlen, strncpy, memcpy, strrchr
+#include <unistd.h>         // For access
+#include <pthread.h>        // For pthread_mutex_t
+#include <sqlite3.h>        // For SQLite3
+#include <openssl/crypto.h> // For CRYPTO_memcmp, OPENSSL_cleanse
+#include <openssl/rand.h>   // For RAND_bytes
+
+#include "hex.h"            // For hexEncode, hexDecode
+#include "sha256mb.h"       // For pbkdf2Sha256Batch
+
+#define WRITE_BUSY_TIMEOUT_MS 1000  // How long a write waits for lookups in progress to finish
+
+// One database file and its statements, prepared once per handle. Lookups run on the
+// event loop thread; writes have their own connection so they can run on another thread.
+typedef struct {
+  sqlite3 *db;
+  sqlite3_stmt *lookupStmt;
+  sqlite3 *writeDb;
+  sqlite3_stmt *updateStmt;
+  sqlite3_stmt *setStmt;
+} Shard;
+
+static Shard shards[USER_SHARDS_MAX];
+static pthread_mutex_t writeLocks[USER_SHARDS_MAX];  // Held while a shard's write handle is used or replaced
+static int shardCount;
+
+// Add a column to the users table if an older schema lacks it
+static int ensureColumn(sqlite3 *handle, const char *name, const char *definition) {
+  sqlite3_stmt *stmt;
+  if (sqlite3_prepare_v2(handle, "PRAGMA table_info(users);", -1, &stmt, NULL) != SQLITE_OK) {
+    return 1;
+  }
+
+  int found = 0;
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    if (strcmp((const char *)sqlite3_column_text(stmt, 1), name) == 0) found = 1;
+  }
+  sqlite3_finalize(stmt);
+  if (found) return 0;
+
+  char sql[256];
+  snprintf(sql, sizeof(sql), "ALTER TABLE users ADD COLUMN %s %s;", name, definition);
+  char *errMsg = NULL;
+  if (sqlite3_exec(handle, sql, 0, 0, &errMsg) != SQLITE_OK) {
+    fprintf(stderr, "SQL error: %s\n", errMsg);
+    sqlite3_free(errMsg);
+    return 1;
+  }
+  return 0;
+}
+
+// Opens a database file and ensures the "users" table has the current schema.
+static int openDatabase(const char *dbPath, Shard *shard) {
+  int rc = sqlite3_open(dbPath, &shard->db);
+  if (rc == SQLITE_OK) rc = sqlite3_open(dbPath, &shard->writeDb);
+  if (rc) {
+    fprintf(stderr, "Cannot open database: %s\n", sqlite3_errmsg(shard->writeDb ? shard->writeDb : shard->db));
+    return 1;
+  }
+  // Lookups never wait: one that meets a commit in progress reports the shard busy
+  sqlite3_busy_timeout(shard->writeDb, WRITE_BUSY_TIMEOUT_MS);
+
+  const char *sql =
+    "CREATE TABLE IF NOT EXISTS users ("
+    "username TEXT PRIMARY KEY, "
+    "password_hash TEXT NOT NULL, "
+    "salt BLOB, "
+    "iterations INTEGER NOT NULL DEFAULT 0);";
+
+  char *errMsg = NULL;
+  rc = sqlite3_exec(shard->db, sql, 0, 0, &errMsg);
+  if (rc != SQLITE_OK) {
+    fprintf(stderr, "SQL error: %s\n", errMsg);
+    sqlite3_free(errMsg);
+    return 1;
+  }
+
+  // Databases from before salted hashes get the new columns; their rows stay legacy
+  if (ensureColumn(shard->db, "salt", "BLOB") != 0 ||
+      ensureColumn(shard->db, "iterations", "INTEGER NOT NULL DEFAULT 0") != 0) {
+    return 1;
+  }
+
+  const char *lookup = "SELECT password_hash, salt, iterations FROM users WHERE username = ?;";
+  const char *update = "UPDATE users SET password_hash = ?, salt = ?, iterations = ? WHERE username = ?;";
+  const char *set = "INSERT OR REPLACE INTO users (password_hash, salt, iterations, username) VALUES (?, ?, ?, ?);";
+  if (sqlite3_prepare_v2(shard->db, lookup, -1, &shard->lookupStmt, NULL) != SQLITE_OK ||
+      sqlite3_prepare_v2(shard->writeDb, update, -1, &shard->updateStmt, NULL) != SQLITE_OK ||
+      sqlite3_prepare_v2(shard->writeDb, set, -1, &shard->setStmt, NULL) != SQLITE_OK) {
+    fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(shard->writeDb));
+    return 1;
+  }
+
+  return 0;
+}
+
+static void closeDatabase(Shard *shard) {
+  sqlite3_finalize(shard->lookupStmt);
+  sqlite3_finalize(shard->updateStmt);
+  sqlite3_finalize(shard->setStmt);
+  sqlite3_close(shard->db);
+  sqlite3_close(shard->writeDb);
+  memset(shard, 0, sizeof(Shard));
+}
+
+// Open count shards of dbPath into opened. Returns 0, or 1 with nothing left open.
+static int openShards(const char *dbPath, int count, Shard *opened) {
+  for (int i = 0; i < count; i++) {
+    char path[512];
+    if (userStoreShardPath(dbPath, i, count, path, sizeof(path)) != 0 ||
+        openDatabase(path, &opened[i]) != 0) {
+      for (int j = 0; j <= i; j++) closeDatabase(&opened[j]);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int fileExists(const char *path) {
+  return access(path, F_OK) == 0;
+}
+
+// Whether the files on disk were split for count shards (or there are none yet).
+// Opening the wrong layout would create empty shards and lose track of users.
+static int layoutMatches(const char *dbPath, int count) {
+  char path[512];
+  int present = 0;
+  for (int i = 0; i < count; i++) {
+    if (userStoreShardPath(dbPath, i, count, path, sizeof(path)) != 0) return 0;
+    present += fileExists(path);
+  }
+
+  // One shard past the end, or the other naming scheme, means a different count
+  if (userStoreShardPath(dbPath, count > 1 ? count : 0, count + 1, path, sizeof(path)) != 0) return 0;
+  int other = fileExists(path) || (count > 1 && present == 0 && fileExists(dbPath));
+  return !other && (present == 0 || present == count);
+}
+
+int userStoreShardOf(const char *username, int count) {
+  // FNV-1a; the reshard tool relies on this staying the same
+  uint32_t hash = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)username; *p; p++) {
+    hash ^= *p;
+    hash *= 16777619u;
+  }
+  return count > 1 ? (int)(hash % (uint32_t)count) : 0;
+}
+
+int userStoreShardPath(const char *dbPath, int index, int count, char *path, size_t size) {
+  int written;
+  if (count <= 1) {
+    written = snprintf(path, size, "%s", dbPath);
+  } else {
+    // users.db -> users.<index>.db; a path without an extension just gets the suffix
+    const char *slash = strrchr(dbPath, '/');
+    const char *dot = strrchr(dbPath, '.');
+    if (!dot || (slash && dot < slash)) dot = dbPath + strlen(dbPath);
+    written = snprintf(path, size, "%.*s.%d%s", (int)(dot - dbPath), dbPath, index, dot);
+  }
+  return written >= 0 && (size_t)written < size ? 0 : -1;
+}
+
+int userStoreOpen(const char *dbPath, int count) {
+  if (count < 1 || count > USER_SHARDS_MAX) {
+    fprintf(stderr, "[!] user_shards must be between 1 and %d\n", USER_SHARDS_MAX);
+    return 1;
+  }
+  if (!layoutMatches(dbPath, count)) {
+    fprintf(stderr, "[!] %s is not split into %d shard(s); run reshard first\n", dbPath, count);
+    return 1;
+  }
+  if (openShards(dbPath, count, shards) != 0) return 1;
+
+  for (int i = 0; i < count; i++) pthread_mutex_init(&writeLocks[i], NULL);
+  shardCount = count;
+  if (count > 1) printf("[*] Users spread across %d database shards\n", count);
+  return 0;
+}
+
+void userStoreReload(const char *dbPath) {
+  Shard fresh[USER_SHARDS_MAX] = { 0 };
+  if (openShards(dbPath, shardCount, fresh) != 0) {
+    fprintf(stderr, "[!] Database reload failed, keeping current database\n");
+    return;
+  }
+
+  // A write in progress on another thread finishes on the old handle first
+  for (int i = 0; i < shardCount; i++) {
+    pthread_mutex_lock(&writeLocks[i]);
+    closeDatabase(&shards[i]);
+    shards[i] = fresh[i];
+    pthread_mutex_unlock(&writeLocks[i]);
+  }
+}
+
+// Decode password_hash, salt and iterations from the current row, starting at column first
+static void readRecord(sqlite3_stmt *stmt, int first, UserRecord *record) {
+  const unsigned char *hash = sqlite3_column_text(stmt, first);
+  strncpy(record->passwordHash, hash ? (const char *)hash : "", sizeof(record->passwordHash) - 1);
+  record->passwordHash[sizeof(record->passwordHash) - 1] = '\0';
+
+  // A row with a missing or short salt can't be verified as salted; treat it as legacy
+  const void *salt = sqlite3_column_blob(stmt, first + 1);
+  record->iterations = sqlite3_column_int(stmt, first + 2);
+  if (record->iterations > 0 && salt && sqlite3_column_bytes(stmt, first + 1) == USER_SALT_LENGTH) {
+    memcpy(record->salt, salt, USER_SALT_LENGTH);
+    // Decode once here so the compute thread compares raw bytes
+    record->keyValid = hexDecode(record->passwordHash, record->key, USER_KEY_LENGTH) == 0;
+  } else {
+    record->iterations = 0;
+    record->keyValid = 0;
+  }
+}
+
+int userStoreLookup(const char *username, UserRecord *record) {
+  sqlite3_stmt *lookupStmt = shards[userStoreShardOf(username, shardCount)].lookupStmt;
+  sqlite3_reset(lookupStmt);
+  sqlite3_bind_text(lookupStmt, 1, username, -1, SQLITE_STATIC);
+
+  int rc = sqlite3_step(lookupStmt);
+  if (rc != SQLITE_ROW) {
+    sqlite3_reset(lookupStmt);
+    return rc == SQLITE_DONE ? 0 : -1;
+  }
+
+  readRecord(lookupStmt, 0, record);
+  sqlite3_reset(lookupStmt);
+  return 1;
+}
+
+// Bind a record and username to an update or insert, in that column order, and run it.
+// The caller holds the shard's write lock.
+static int writeRecord(sqlite3_stmt *stmt, const char *username, const UserRecord *record) {
+  sqlite3_reset(stmt);
+  sqlite3_bind_text(stmt, 1, record->passwordHash, -1, SQLITE_STATIC);
+  if (record->iterations > 0) {
+    sqlite3_bind_blob(stmt, 2, record->salt, USER_SALT_LENGTH, SQLITE_STATIC);
+  } else {
+    sqlite3_bind_null(stmt, 2);
+  }
+  sqlite3_bind_int(stmt, 3, record->iterations);
+  sqlite3_bind_text(stmt, 4, username, -1, SQLITE_STATIC);
+
+  int rc = sqlite3_step(stmt);
+  sqlite3_reset(stmt);
+  return rc == SQLITE_DONE ? 0 : 1;
+}
+
+int userStoreUpdate(const char *username, const UserRecord *record) {
+  // Only this user's shard is locked for the write
+  int shard = userStoreShardOf(username, shardCount);
+  pthread_mutex_lock(&writeLocks[shard]);
+  int status = writeRecord(shards[shard].updateStmt, username, record);
+  pthread_mutex_unlock(&writeLocks[shard]);
+  return status;
+}
+
+int userStoreSet(const char *username, const UserRecord *record) {
+  int shard = userStoreShardOf(username, shardCount);
+  pthread_mutex_lock(&writeLocks[shard]);
+  int status = writeRecord(shards[shard].setStmt, username, record);
+  pthread_mutex_unlock(&writeLocks[shard]);
+  return status;
+}
+
+void userStoreTransaction(int begin) {
+  for (int i = 0; i < shardCount; i++) {
+    char *errMsg = NULL;
+    pthread_mutex_lock(&writeLocks[i]);
+    if (sqlite3_exec(shards[i].writeDb, begin ? "BEGIN;" : "COMMIT;", 0, 0, &errMsg) != SQLITE_OK) {
+      fprintf(stderr, "SQL error: %s\n", errMsg);
+      sqlite3_free(errMsg);
+    }
+    pthread_mutex_unlock(&writeLocks[i]);
+  }
+}
+
+size_t userStoreForEach(void (*visit)(const char *username, const UserRecord *record, void *data), void *data) {
+  size_t visited = 0;
+  for (int i = 0; i < shardCount; i++) {
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(shards[i].db, "SELECT username, password_hash, salt, iterations FROM users;",
+                           -1, &stmt, NULL) != SQLITE_OK) {
+      continue;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      UserRecord record;
+      readRecord(stmt, 1, &record);
+      visit((const char *)sqlite3_column_text(stmt, 0), &record, data);
+      visited++;
+    }
+    sqlite3_finalize(stmt);
+  }
+  return visited;
+}
+
+// Queue a PBKDF2 job for a client hash under a record's salt and iterations
+static void addJob(PBKDF2Job *job, const char *clientHash, const UserRecord *record) {
+  job->password = clientHash;
+  job->passwordLength = strlen(clientHash);
+  job->salt = record->salt;
+  job->saltLength = USER_SALT_LENGTH;
+  job->iterations = (uint32_t)record->iterations;
+}
+
+// Check and upgrade at most SHA256MB_MAX_LANES records, two KDF batches in total
+static void checkGroup(UserCheck *checks, size_t count) {
+  PBKDF2Job jobs[SHA256MB_MAX_LANES];
+  UserCheck *owners[SHA256MB_MAX_LANES];
+  size_t queued = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    UserRecord *record = checks[i].record;
+    checks[i].authenticated = 0;
+    checks[i].upgraded = 0;
+
+    if (record->iterations == 0) {
+      // Legacy row: the stored value is the client hash itself
+      size_t length = strlen(checks[i].clientHash);
+      checks[i].authenticated = length == strlen(record->passwordHash) &&
+                                CRYPTO_memcmp(checks[i].clientHash, record->passwordHash, length) == 0;
+      continue;
+    }
+
+    // Always run the KDF, so a malformed row takes as long to reject as a wrong password
+    addJob(&jobs[queued], checks[i].clientHash, record);
+    owners[queued++] = &checks[i];
+  }
+
+  pbkdf2Sha256Batch(jobs, queued);
+  for (size_t i = 0; i < queued; i++) {
+    const UserRecord *record = owners[i]->record;
+    owners[i]->authenticated = record->keyValid &&
+                               CRYPTO_memcmp(jobs[i].key, record->key, USER_KEY_LENGTH) == 0;
+  }
+
+  // Legacy or under-iterated rows are re-salted with the password just confirmed
+  queued = 0;
+  for (size_t i = 0; i < count; i++) {
+    UserRecord *record = checks[i].record;
+    if (!checks[i].authenticated || record->iterations >= USER_KDF_ITERATIONS) continue;
+    if (RAND_bytes(record->salt, USER_SALT_LENGTH) != 1) continue;
+
+    record->iterations = USER_KDF_ITERATIONS;
+    addJob(&jobs[queued], checks[i].clientHash, record);
+    owners[queued++] = &checks[i];
+  }
+
+  pbkdf2Sha256Batch(jobs, queued);
+  for (size_t i = 0; i < queued; i++) {
+    UserRecord *record = owners[i]->record;
+    memcpy(record->key, jobs[i].key, USER_KEY_LENGTH);
+    record->keyValid = 1;
+    hexEncode(record->key, USER_KEY_LENGTH, record->passwordHash);
+    owners[i]->upgraded = 1;
+  }
+
+  OPENSSL_cleanse(jobs, sizeof(jobs));
+}
+
+void userStoreCheckBatch(UserCheck *checks, size_t count) {
+  for (size_t start = 0; start < count; start += SHA256MB_MAX_LANES) {
+    size_t group = count - start;
+    checkGroup(checks + start, group < SHA256MB_MAX_LANES ? group : SHA256MB_MAX_LANES);
+  }
+}
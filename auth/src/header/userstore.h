@@ -0,0 +1,72 @@
+// userstore.h - User records in SQLite with salted, iterated password hashes
+#ifndef USERSTORE_H
+#define USERSTORE_H
+
+#include <stddef.h>
+
+#define USER_NAME_MAX 128             // Longest username accepted
+#define USER_HASH_MAX 256             // Longest stored or client-supplied hash (hex)
+#define USER_SALT_LENGTH 16           // Random salt per user, in bytes
+#define USER_KEY_LENGTH 32            // PBKDF2-HMAC-SHA256 output, in bytes
+#define USER_KDF_ITERATIONS 100000    // PBKDF2 iterations for new and upgraded rows
+#define USER_SHARDS_MAX 64            // Most database files users can be spread across
+
+// A user row. Legacy rows (iterations == 0) store the client hash as-is;
+// upgraded rows store hex(PBKDF2(client hash, salt, iterations)).
+typedef struct {
+  char passwordHash[USER_HASH_MAX];
+  unsigned char salt[USER_SALT_LENGTH];
+  int iterations;
+  unsigned char key[USER_KEY_LENGTH];   // passwordHash decoded at lookup (salted rows)
+  int keyValid;                         // 0 if passwordHash isn't a well-formed key
+} UserRecord;
+
+// One password check within a batch
+typedef struct {
+  const char *clientHash;
+  UserRecord *record;
+  int authenticated;                    // Result of the check
+  int upgraded;                         // record now holds a freshly salted hash to store
+} UserCheck;
+
+// Open the database, creating the table or adding the salt/iterations columns as needed.
+// With more than one shard, users are spread by username hash across files named after
+// dbPath (users.0.db, users.1.db, ...), each with its own connection. Refuses to start
+// if the files on disk were split for a different shard count. Returns 0 on success or 1 on failure.
+int userStoreOpen(const char *dbPath, int shards);
+
+// Reopen every shard so replaced files take effect. Keeps the old handles if any fails.
+void userStoreReload(const char *dbPath);
+
+// Which of count shards holds a user
+int userStoreShardOf(const char *username, int count);
+
+// Path of shard index out of count for dbPath (dbPath itself for a single shard).
+// Returns 0 on success, or -1 if it doesn't fit in size.
+int userStoreShardPath(const char *dbPath, int index, int count, char *path, size_t size);
+
+// Fetch a user's record on the event loop thread. Returns 1 if found, 0 if not, or -1
+// if the shard is busy committing a write.
+int userStoreLookup(const char *username, UserRecord *record);
+
+// Replace a user's stored hash with a salted one. Returns 0 on success.
+// May be called off the event loop thread, and for different shards from different
+// threads at once; waits for lookups in progress to finish.
+int userStoreUpdate(const char *username, const UserRecord *record);
+
+// Create or replace a user's row. Returns 0 on success. May be called off the event loop thread.
+int userStoreSet(const char *username, const UserRecord *record);
+
+// Begin (begin = 1) or commit (begin = 0) a transaction on every shard, so a run of
+// writes is synced to disk once rather than per row
+void userStoreTransaction(int begin);
+
+// Call visit for every user, shard by shard. Returns the number of users visited.
+size_t userStoreForEach(void (*visit)(const char *username, const UserRecord *record, void *data), void *data);
+
+// Check client hashes against their records in constant time (for the given record shape),
+// and re-salt legacy or under-iterated records that matched. The KDFs of the whole batch
+// run side by side in SIMD lanes, so call it off the event loop with as many checks as are waiting.
+void userStoreCheckBatch(UserCheck *checks, size_t count);
+
+#endif // USERSTORE_H
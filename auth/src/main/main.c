@@ -1,136 +1,654 @@
 // main.c - Main authentication server
 
 #include <stdio.h>        // printf, fprintf
-#include <stdlib.h>       // exit, atoi
-#include <string.h>       // memset, strtok, strcmp, strncpy
-#include <unistd.h>       // close
-#include <openssl/sha.h>  // SHA256_DIGEST_LENGTH
-#include <sqlite3.h>      // SQLite3
-
-#include "../header/sslsocket.h"   // TLS socket functions
-#include "../header/socket.h"      // Raw socket functions
-
-// Global database handle
-sqlite3 *db;
-
-// Opens the database file and ensures the "users" table exists.
-int initDatabase(const char *dbPath) {
-  int rc = sqlite3_open(dbPath, &db);
-  if (rc) {
-    fprintf(stderr, "Cannot open database: %s\n", sqlite3_errmsg(db));
-    return 1;
+#include <stdlib.h>       // exit, atoi, strtoull, calloc, free
+#include <string.h>       // memset, memchr, memmove, strtok, strlen, strcpy
+#include <stdarg.h>       // va_list
+#include <unistd.h>       // sysconf, getuid
+#include <signal.h>       // signal, SIGPIPE
+#include <openssl/crypto.h> // OPENSSL_cleanse
+
+#include "../header/userstore.h"   // Users and salted password hashes
+#include "../header/sha256mb.h"    // Multi-buffer SHA-256 selection, for logging
+#include "../header/token.h"       // Signed session tokens
+#include "../header/changelog.h"   // User changes kept for replicas
+#include "../header/replica.h"     // Following a primary's changes
+#include "../../../common/src/header/engine.h"    // Listeners, TLS, admission, deadlines and draining
+#include "../../../common/src/header/config.h"   // Settings from auth.conf
+#include "../../../common/src/header/sockopts.h" // Corking pipelined replies
+#include "../../../common/src/header/metrics.h"   // Counters for the METRICS command
+#include "../../../common/src/header/handoff.h"  // Zero-downtime reload and upgrade
+#include "../../../common/src/header/connection.h"  // Pooled connection state
+#include "../../../common/src/header/pool.h"        // Pooled I/O buffers and replies
+#include "../../../common/src/header/eventloop.h"   // epoll loop and connection deadlines
+#include "../../../common/src/header/threadpool.h"  // Compute threads for password hashing
+#include "../../../common/src/header/trace.h"       // Tracepoints and slow request reports
+#include "../../../common/src/header/capture.h"     // Recording requests for replay
+
+#define COMPUTE_QUEUE_LIMIT 64  // Logins that may wait for a hashing thread before clients get "busy"
+#define WRITE_QUEUE_LIMIT 64    // Rows that may wait for a shard's writer thread; past that, upgrades wait for the next login
+#define PIPELINE_DEPTH 64       // Requests a pipelined connection may have waiting for replies
+#define REPLY_MAX (TOKEN_MAX_LENGTH + 8)  // Longest reply line ("true <token>\n")
+
+// Server state shared by the event loop callbacks
+static EventLoop *serverLoop;
+static ThreadPool *computePool;        // Password hashing, kept off the event loop
+static ThreadPool *writerPools[USER_SHARDS_MAX];  // One per shard: writes, so their syncs don't hold up the loop
+static int userShards;                 // Database files users are spread across
+static const char *changeLogPath;      // Primary: user changes are logged for replicas, or NULL
+static int tcpReplicas;                // Replicas may stream over TCP, not just the Unix socket
+static int replicating;                // Read-only replica: rows only change through replication
+
+typedef struct LoginCheck LoginCheck;
+
+// A reply owed to a client, queued in request order on connection->pendingWork
+typedef struct Reply {
+  struct Reply *next;
+  LoginCheck *check;                   // Login still being hashed, or NULL once text is set
+  size_t length;
+  char *longText;                      // Pooled buffer for a reply too long for text (METRICS), or NULL
+  char text[REPLY_MAX];
+} Reply;
+
+static __thread Slab replySlab = SLAB_INITIALIZER(Reply);
+
+// A login being checked on a compute thread
+struct LoginCheck {
+  ThreadTask task;
+  Connection *connection;              // NULL once the client has gone away
+  Reply *reply;                        // Where the answer goes on the connection
+  char username[USER_NAME_MAX];
+  char clientHash[USER_HASH_MAX];
+  UserRecord record;                   // Stored row, or a dummy so unknown users cost the same
+  int found;
+  int authenticated;                   // Result of the check
+  int upgraded;                        // record now holds a freshly salted hash to store
+  int stored;                          // The writer thread wrote record
+  int issueToken;                      // LOGIN: answer with a session token
+  int create;                          // SETUSER: store the row once it is salted
+};
+
+// A replica streaming the change log, kept in connection->session
+typedef struct {
+  uint64_t position;                   // Last change queued for the replica
+} Subscriber;
+
+// Take the next place in the connection's reply queue. Returns NULL when out of memory.
+Reply *addReply(Connection *connection) {
+  Reply *reply = slabAlloc(&replySlab);
+  if (!reply) return NULL;
+  reply->next = NULL;
+  reply->check = NULL;
+  reply->length = 0;
+  reply->longText = NULL;
+
+  Reply **link = (Reply **)&connection->pendingWork;
+  while (*link) link = &(*link)->next;
+  *link = reply;
+  return reply;
+}
+
+// Fill in a reply, making it ready to send
+__attribute__((format(printf, 2, 3)))
+void setReply(Reply *reply, const char *format, ...) {
+  va_list arguments;
+  va_start(arguments, format);
+  int length = vsnprintf(reply->text, sizeof(reply->text), format, arguments);
+  va_end(arguments);
+
+  reply->length = length < 0 ? 0 : (size_t)length < sizeof(reply->text) ? (size_t)length : sizeof(reply->text) - 1;
+  reply->check = NULL;
+}
+
+// Return a reply and anything it holds to the pools
+void freeReply(Reply *reply) {
+  if (reply->longText) bufferRelease(reply->longText);
+  slabFree(&replySlab, reply);
+}
+
+void serveConnection(Connection *connection);
+
+// Release the replies and replica state of a connection the engine is about to close
+void releaseConnection(Connection *connection) {
+  // A request cut short is charged to whatever it was waiting on
+  Reply *first = connection->pendingWork;
+  if (first) traceEnd(&connection->span, first->check ? TRACE_COMPUTE : TRACE_SEND, connection->id);
+
+  // Logins still being hashed finish without a client to answer
+  while (connection->pendingWork) {
+    Reply *reply = connection->pendingWork;
+    connection->pendingWork = reply->next;
+    if (reply->check) reply->check->connection = NULL;
+    freeReply(reply);
   }
+  free(connection->session);
+  connection->session = NULL;
+}
 
-  const char *sql =
-    "CREATE TABLE IF NOT EXISTS users ("
-    "username TEXT PRIMARY KEY, "
-    "password_hash TEXT NOT NULL);";
+// Tell a quiet replica where the log ends, so it can report its lag and knows we're alive
+void sendHeartbeat(Connection *connection) {
+  Reply *reply = addReply(connection);
+  if (!reply) {
+    engineClose(connection);
+    return;
+  }
+  setReply(reply, "HEAD %llu\n", (unsigned long long)changeLogLastSeq());
+  serveConnection(connection);
+}
 
-  char *errMsg = NULL;
-  rc = sqlite3_exec(db, sql, 0, 0, &errMsg);
-  if (rc != SQLITE_OK) {
-    fprintf(stderr, "SQL error: %s\n", errMsg);
-    sqlite3_free(errMsg);
-    return 1;
+// Drop a client that missed the deadline for its current phase; a quiet replica gets a heartbeat
+void onConnectionTimeout(Connection *connection) {
+  if (connection->session && connection->phase == PHASE_IDLE) {
+    sendHeartbeat(connection);
+    return;
   }
+  engineClose(connection);
+}
 
-  return 0;
+// Push new changes to every replica that is waiting for them
+void wakeSubscribers(void) {
+  Connection *next;
+  for (Connection *connection = connectionFirst(); connection; connection = next) {
+    next = connection->next;
+    if (connection->session && !connection->pendingWork) serveConnection(connection);
+  }
+}
+
+// Whether this process writes users. A replica's rows only change through replication,
+// and a draining primary leaves the log to the process that replaced it.
+int canStoreUsers(void) {
+  return !replicating && !(changeLogPath && engineDraining());
+}
+
+// Runs on a compute thread: the slow, salted comparisons and any rehashes for every
+// login that was waiting, hashed side by side
+void runLoginChecks(ThreadTask **tasks, size_t count) {
+  UserCheck checks[THREAD_BATCH_MAX];
+  for (size_t i = 0; i < count; i++) {
+    LoginCheck *check = (LoginCheck *)tasks[i];
+    checks[i] = (UserCheck){ check->clientHash, &check->record, 0, 0 };
+  }
+
+  userStoreCheckBatch(checks, count);
+
+  for (size_t i = 0; i < count; i++) {
+    LoginCheck *check = (LoginCheck *)tasks[i];
+    check->authenticated = checks[i].authenticated && check->found;
+    check->upgraded = checks[i].upgraded && check->found;
+  }
 }
 
-// Fetch stored hash for a username. Returns 1 if found.
-int getUserHash(const char *username, char *outputBuffer, size_t bufferSize) {
-  const char *sql = "SELECT password_hash FROM users WHERE username = ?;";
-  sqlite3_stmt *stmt;
+// Runs on a shard's writer thread: store the row a login upgraded or SETUSER salted
+void writeUser(ThreadTask *task) {
+  LoginCheck *check = (LoginCheck *)task;
+  int status = check->create ? userStoreSet(check->username, &check->record)
+                             : userStoreUpdate(check->username, &check->record);
+  check->stored = status == 0;
+}
+
+// Runs on the event loop once any row is stored: log it for replicas and answer the client
+void finishLoginCheck(ThreadTask *task) {
+  LoginCheck *check = (LoginCheck *)task;
+
+  if (check->stored) {
+    if (check->create) printf("[+] Stored user %s\n", check->username);
+    else printf("[*] Upgraded password hash for %s\n", check->username);
+
+    // The log may have been handed over while the row was being written
+    if (changeLogPath && engineDraining()) {
+      fprintf(stderr, "[!] Stored %s after handing over the change log; replicas miss it until it changes again\n", check->username);
+    } else if (changeLogPath && changeLogAppend(check->username, &check->record) == 0) {
+      wakeSubscribers();
+    }
+  }
+
+  Connection *connection = check->connection;
+  if (connection) {
+    if (check->upgraded) traceMark(&connection->span, TRACE_LOOKUP);
+    char token[TOKEN_MAX_LENGTH];
+    if (check->create) {
+      setReply(check->reply, "%s\n", check->stored ? "true" : "false");
+    } else if (check->authenticated && check->issueToken &&
+        tokenIssue(check->username, token, sizeof(token)) == 0) {
+      setReply(check->reply, "true %s\n", token);
+    } else {
+      setReply(check->reply, "%s\n", check->authenticated ? "true" : "false");
+    }
+    serveConnection(connection);
+  }
+
+  OPENSSL_cleanse(check, sizeof(LoginCheck));
+  free(check);
+}
+
+// Runs on the event loop after hashing: a login's upgraded hash and SETUSER's salted row
+// go to their shard's writer thread, and the client is answered once they are on disk
+void completeLoginCheck(ThreadTask *task) {
+  LoginCheck *check = (LoginCheck *)task;
+  if (check->connection) traceMark(&check->connection->span, TRACE_COMPUTE);
 
-  if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+  if (check->upgraded && canStoreUsers()) {
+    check->task.run = writeUser;
+    check->task.runBatch = NULL;
+    check->task.complete = finishLoginCheck;
+    ThreadPool *writer = writerPools[userStoreShardOf(check->username, userShards)];
+    if (threadPoolSubmit(writer, &check->task) == 0) return;
+  }
+  finishLoginCheck(task);
+}
+
+// Answers "VERIFY token" from the token alone, without the database or a compute thread
+void verifyToken(Reply *reply, const char *token) {
+  char username[USER_NAME_MAX];
+  if (token && tokenVerify(token, username, sizeof(username))) {
+    setReply(reply, "true %s\n", username);
+  } else {
+    setReply(reply, "false\n");
+  }
+}
+
+// Answers "METRICS" with every registered metric, ended by an empty line
+void reportMetrics(Reply *reply) {
+  reply->longText = bufferAcquire();
+  if (!reply->longText) {
+    setReply(reply, "busy\n");
+    return;
+  }
+
+  size_t length = metricsFormat(reply->longText, POOL_BUFFER_SIZE - 1);
+  reply->longText[length++] = '\n';
+  reply->length = length;
+  reply->check = NULL;
+}
+
+// Answers "REPLICATE logId seq" by turning the connection into a stream of the changes after
+// seq, announcing the log and where it ends first. A replica of another (or recreated) log
+// starts over from the first change. Only a primary streams, and over TCP only if allowed.
+void startReplication(Connection *connection, Reply *reply, const char *logId, const char *after) {
+  char *end = NULL;
+  uint64_t position = after ? strtoull(after, &end, 10) : 0;
+  Subscriber *subscriber = NULL;
+  if (!changeLogPath || engineDraining() || !logId || !after || *end != '\0' ||
+      (connection->peerUid == (uid_t)-1 && !tcpReplicas) ||
+      !(subscriber = calloc(1, sizeof(Subscriber)))) {
+    setReply(reply, "false\n");
+    return;
+  }
+
+  uint64_t last = changeLogLastSeq();
+  if (strcmp(logId, changeLogId()) != 0 || position > last) position = 0;
+  setReply(reply, "LOG %s\nHEAD %llu\n", changeLogId(), (unsigned long long)last);
+
+  printf("[+] Replica connected after change %llu of %llu\n", (unsigned long long)position, (unsigned long long)last);
+  subscriber->position = position;
+  connection->session = subscriber;
+  connection->keepAlive = 1;
+}
+
+// Queue the next stretch of the change log for a replica that is behind
+void streamChanges(Connection *connection) {
+  Subscriber *subscriber = connection->session;
+  if (connection->pendingWork || subscriber->position >= changeLogLastSeq()) return;
+
+  Reply *reply = addReply(connection);
+  if (!reply) return;
+  reply->longText = bufferAcquire();
+
+  // Without a buffer, the next heartbeat tries again
+  uint64_t through = subscriber->position;
+  reply->length = reply->longText
+    ? changeLogRead(subscriber->position, reply->longText, POOL_BUFFER_SIZE, &through)
+    : 0;
+  if (reply->length == 0) {
+    connection->pendingWork = NULL;
+    freeReply(reply);
+    return;
+  }
+  subscriber->position = through;
+}
+
+// Handle one request: "username hash", "LOGIN username hash", "VERIFY token", "METRICS",
+// "SETUSER username hash" or "REPLICATE logId seq". Logins and SETUSER are queued for the compute
+// threads; everything else is answered right here.
+// Either way the reply takes the next place in the connection's reply queue.
+// Returns -1 if there is no memory for the reply.
+int handleRequest(Connection *connection, char *request) {
+  // A pipelined connection times each burst of requests, from the first until its replies are sent
+  if (connection->keepAlive && !connection->pendingWork && !traceActive(&connection->span)) {
+    traceBegin(&connection->span);
+  }
+  traceMark(&connection->span, TRACE_READ);
+
+  // Recorded as received, before strtok splits it
+  if (captureEnabled()) {
+    unsigned flags = connection->keepAlive ? CAPTURE_PIPELINED : 0;
+    if (connection->ssl) flags |= CAPTURE_TLS;
+    if (connection->peerUid != (uid_t)-1) flags |= CAPTURE_LOCAL;
+    captureRequest(connection->id, flags, request, strlen(request));
+  }
+
+  Reply *reply = addReply(connection);
+  if (!reply) return -1;
+
+  // Shed by admission control: one cheap refusal, then the connection closes
+  if (connection->shed) {
+    setReply(reply, "busy\n");
+    connection->keepAlive = 0;
     return 0;
   }
 
-  sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
+  char *command = strtok(request, " \r\n");
+  TRACE_PROBE3(request, connection->id, 0, command ? command : "");
+  traceDetail(&connection->span, "%s", command ? command : "");
+  if (command && strcmp(command, "VERIFY") == 0) {
+    verifyToken(reply, strtok(NULL, " \r\n"));
+    return 0;
+  }
+  if (command && strcmp(command, "METRICS") == 0) {
+    reportMetrics(reply);
+    return 0;
+  }
+  if (command && strcmp(command, "REPLICATE") == 0) {
+    char *logId = strtok(NULL, " \r\n");
+    startReplication(connection, reply, logId, strtok(NULL, " \r\n"));
+    return 0;
+  }
 
-  int rc = sqlite3_step(stmt);
-  if (rc == SQLITE_ROW) {
-    const unsigned char *hash = sqlite3_column_text(stmt, 0);
-    strncpy(outputBuffer, (const char *)hash, bufferSize - 1);
-    outputBuffer[bufferSize - 1] = '\0';
-    sqlite3_finalize(stmt);
-    return 1;
+  // Users are only created or replaced on the primary, by a local client running as the server's user
+  int create = command && strcmp(command, "SETUSER") == 0;
+  if (create && (replicating || connection->peerUid != getuid())) {
+    setReply(reply, "false\n");
+    return 0;
+  }
+
+  int issueToken = command && strcmp(command, "LOGIN") == 0;
+  char *username = issueToken || create ? strtok(NULL, " \r\n") : command;
+  char *receivedHash = strtok(NULL, " \r\n");
+  if (!username || !receivedHash ||
+      strlen(username) >= USER_NAME_MAX || strlen(receivedHash) >= USER_HASH_MAX) {
+    setReply(reply, "false\n");
+    return 0;
+  }
+
+  // Look the user up here; the hashing happens on a compute thread
+  LoginCheck *check = calloc(1, sizeof(LoginCheck));
+  if (!check) {
+    setReply(reply, "busy\n");
+    return 0;
+  }
+  check->task.runBatch = runLoginChecks;
+  check->task.complete = completeLoginCheck;
+  check->connection = connection;
+  check->reply = reply;
+  check->issueToken = issueToken;
+  check->create = create;
+  strcpy(check->username, username);
+  strcpy(check->clientHash, receivedHash);
+
+  if (create) {
+    // A legacy row holding the new hash matches itself, and is salted like any legacy login
+    strcpy(check->record.passwordHash, receivedHash);
+    check->found = 1;
+  } else {
+    TRACE_PROBE3(lookup_start, connection->id, 0, username);
+    int found = userStoreLookup(username, &check->record);
+    TRACE_PROBE3(lookup_end, connection->id, 0, found);
+    if (found < 0) {
+      // The user's shard is committing a write; the client may retry
+      OPENSSL_cleanse(check, sizeof(LoginCheck));
+      free(check);
+      setReply(reply, "busy\n");
+      return 0;
+    }
+    check->found = found;
+    if (!check->found) {
+      check->record.iterations = USER_KDF_ITERATIONS;  // Same work as a real user, never matches
+    }
+    traceMark(&connection->span, TRACE_LOOKUP);
   }
 
-  sqlite3_finalize(stmt);
+  if (threadPoolSubmit(computePool, &check->task) != 0) {
+    OPENSSL_cleanse(check, sizeof(LoginCheck));
+    free(check);
+    setReply(reply, "busy\n");
+    return 0;
+  }
+  reply->check = check;
   return 0;
 }
 
-// Reads "username hash" from client, checks DB, responds true/false.
-void HandleClient(void *connection, int isSSL) {
-  char buffer[2048];
-  memset(buffer, 0, sizeof(buffer));
+// Whether the connection may take another request. A plain connection takes exactly one;
+// a pipelined one takes requests until PIPELINE_DEPTH replies are outstanding.
+int acceptsRequests(Connection *connection) {
+  if (connection->session) return 0;  // A replica's stream takes no more requests
+  if (!connection->keepAlive) return connection->pendingWork == NULL;
 
-  int bytesRead = 0;
-  if (isSSL) {
-    bytesRead = SSLReceiveData((SSL *)connection, buffer, sizeof(buffer) - 1);
-  } else {
-    bytesRead = rawReceiveData(*(int *)connection, buffer, sizeof(buffer) - 1);
+  size_t outstanding = 0;
+  for (Reply *reply = connection->pendingWork; reply; reply = reply->next) outstanding++;
+  return outstanding < PIPELINE_DEPTH;
+}
+
+// Turn buffered input into requests. A plain connection's first read is its whole request,
+// unless it is the "PIPELINE" line, after which requests are newline-terminated.
+// Returns -1 if the connection has to be closed.
+int takeRequests(Connection *connection) {
+  char *buffer = connection->buffer;
+  char *start = buffer;
+  char *end = buffer + connection->length;
+  *end = '\0';
+
+  while (start < end && acceptsRequests(connection)) {
+    char *newline = memchr(start, '\n', (size_t)(end - start));
+    if (!connection->keepAlive) {
+      if (newline && strncmp(start, "PIPELINE", 8) == 0 && strspn(start + 8, "\r") == (size_t)(newline - start - 8)) {
+        connection->keepAlive = 1;
+        start = newline + 1;
+        continue;
+      }
+      if (handleRequest(connection, start) != 0) return -1;
+      start = end;
+      break;
+    }
+
+    if (!newline) break;  // Wait for the rest of the line
+    *newline = '\0';
+    if (handleRequest(connection, start) != 0) return -1;
+    start = newline + 1;
+  }
+
+  // Keep any partial request at the front of the buffer
+  connection->length = (size_t)(end - start);
+  memmove(buffer, start, connection->length);
+  return 0;
+}
+
+// The reply to send next. A replica's queue is refilled from the change log as it empties.
+Reply *nextReply(Connection *connection) {
+  if (connection->session) streamChanges(connection);
+  return connection->pendingWork;
+}
+
+// Move a connection forward: read and queue requests while there is room, send
+// the replies that are ready in request order, then choose the next wakeup and deadline
+void serveConnection(Connection *connection) {
+  TimerWheel *timers = eventLoopTimers(serverLoop);
+  int readWantsWrite = 0;   // TLS has to write before it can read on
+
+  while (acceptsRequests(connection)) {
+    char *buffer = connectionBuffer(connection);
+    if (!buffer || connection->length == POOL_BUFFER_SIZE - 1) {
+      engineClose(connection);  // Out of buffers, or a request longer than one
+      return;
+    }
+
+    // Receive after any partial request; only the bytes read are valid, so no zeroing is needed
+    size_t room = POOL_BUFFER_SIZE - 1 - connection->length;
+    int bytesRead = connection->transport->receive(connection, buffer + connection->length, room,
+                                                   &readWantsWrite);
+    if (bytesRead == SOCKET_WOULD_BLOCK) break;  // Wait for more
+    if (bytesRead <= 0) {
+      engineClose(connection);
+      return;
+    }
+
+    connection->length += (size_t)bytesRead;
+    if (takeRequests(connection) != 0) {
+      engineClose(connection);
+      return;
+    }
   }
-  if (bytesRead <= 0) return;
 
-  buffer[bytesRead] = '\0';
+  // Send finished replies, stopping at the first one still being computed. A burst of
+  // pipelined replies is corked so it leaves in full segments rather than one per line.
+  Reply *reply = connection->pendingWork;
+  int corked = reply && !reply->check && reply->next && !reply->next->check &&
+               connection->peerUid == (uid_t)-1;
+  if (corked) socketCork(connection->fd, engineSocketOptions(), 1);
+
+  int blocked = 0;
+  while ((reply = nextReply(connection)) && !reply->check) {
+    if (connection->sent == 0) TRACE_PROBE3(send_start, connection->id, 0, reply->length);
+    const char *data = (reply->longText ? reply->longText : reply->text) + connection->sent;
+    size_t length = reply->length - connection->sent;
+    int bytesSent = connection->transport->send(connection, data, length);
+    if (bytesSent == SOCKET_WOULD_BLOCK) {
+      blocked = 1;
+      break;
+    }
+    if (bytesSent < 0) {
+      engineClose(connection);
+      return;
+    }
 
-  char *username = strtok(buffer, " ");
-  char *receivedHash = strtok(NULL, " ");
+    connection->sent += (size_t)bytesSent;
+    if (connection->sent < reply->length) continue;
 
-  if (!username || !receivedHash) {
-    const char *resp = "false\n";
-    if (isSSL) SSLSendData((SSL *)connection, resp);
-    else rawSendData(*(int *)connection, resp);
+    TRACE_PROBE3(send_end, connection->id, 0, reply->length);
+    connection->pendingWork = reply->next;
+    connection->sent = 0;
+    freeReply(reply);
+    if (!connection->pendingWork) traceEnd(&connection->span, TRACE_SEND, connection->id);
+    if (!connection->keepAlive) {
+      engineClose(connection);  // One request per plain connection
+      return;
+    }
+  }
+  if (corked) socketCork(connection->fd, engineSocketOptions(), 0);
+
+  // A replica's stream stays open, with heartbeats while it is quiet. A hangup is noticed at once.
+  if (connection->session) {
+    if (engineDraining() && !connection->pendingWork) {
+      engineClose(connection);  // The replica reconnects to the new process
+      return;
+    }
+    eventLoopModify(serverLoop, &connection->handler, EPOLLRDHUP | (blocked || readWantsWrite ? EPOLLOUT : 0));
+    if (connection->pendingWork) {
+      connectionSetPhase(connection, timers, PHASE_WRITE, CONNECTION_WRITE_TIMEOUT_MS);
+    } else {
+      connectionReleaseBuffer(connection);
+      connectionSetPhase(connection, timers, PHASE_IDLE, REPLICA_HEARTBEAT_MS);
+    }
+    return;
+  }
+
+  int idle = connection->keepAlive && !connection->pendingWork && connection->length == 0;
+  if (idle && engineDraining()) {
+    engineClose(connection);  // Pipelined clients reconnect to the new process
     return;
   }
 
-  char storedHash[256];
-  if (!getUserHash(username, storedHash, sizeof(storedHash))) {
-    const char *resp = "false\n";
-    if (isSSL) SSLSendData((SSL *)connection, resp);
-    else rawSendData(*(int *)connection, resp);
+  uint32_t events = acceptsRequests(connection) ? EPOLLIN : 0;
+  if (blocked || readWantsWrite) events |= EPOLLOUT;
+  eventLoopModify(serverLoop, &connection->handler, events);
+
+  // Replies in progress are held to the write deadline, a partial request to the read
+  // deadline from its start, and an empty pipelined connection to the idle one
+  if (connection->pendingWork) {
+    connectionSetPhase(connection, timers, PHASE_WRITE, CONNECTION_WRITE_TIMEOUT_MS);
+  } else if (!idle) {
+    if (connection->phase != PHASE_READ) {
+      connectionSetPhase(connection, timers, PHASE_READ, CONNECTION_READ_TIMEOUT_MS);
+    }
+  } else if (connection->phase != PHASE_IDLE) {
+    connectionReleaseBuffer(connection);
+    connectionSetPhase(connection, timers, PHASE_IDLE, CONNECTION_IDLE_TIMEOUT_MS);
+  }
+}
+
+// Move a connection forward on readiness
+void onClientReady(Connection *connection, uint32_t events) {
+  // A hangup ends the connection even while replies are still being computed
+  if (events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
+    engineClose(connection);
     return;
   }
+  serveConnection(connection);
+}
 
-  int authSuccess = strcmp(receivedHash, storedHash) == 0;
+// Once the engine stops accepting, leave the log to the new process and close
+// idle pipelined connections; their clients reconnect to the new process
+void drainConnections(void) {
+  if (changeLogPath) changeLogClose();  // The new process appends from here on
 
-  const char *resp = authSuccess ? "true\n" : "false\n";
-  if (isSSL) SSLSendData((SSL *)connection, resp);
-  else rawSendData(*(int *)connection, resp);
+  Connection *next;
+  for (Connection *connection = connectionFirst(); connection; connection = next) {
+    next = connection->next;
+    if (connection->phase == PHASE_IDLE) engineClose(connection);
+  }
 }
 
-// Accepts TLS connections and handles them in a loop.
-void SSLServerLoop(int port) {
-  SSL_CTX *sslContext = initTLSContext();
-  loadCertificates(sslContext, "cert.pem", "key.pem");
+// Pick up replaced users and a new token key on SIGHUP
+void reloadFiles(void) {
+  userStoreReload("users.db");
+  tokenReload("token.key");
+}
 
-  int serverSocketFD = newServerSocket(port);
-  if (serverSocketFD < 0) return;
+// Append an existing user to a new change log
+void logUser(const char *username, const UserRecord *record, void *data) {
+  (void)data;
+  changeLogAppend(username, record);
+}
 
-  while (1) {
-    SSL *ssl = acceptClientConnection(serverSocketFD, sslContext);
-    if (!ssl) continue;
-    HandleClient(ssl, 1);
-    SSL_shutdown(ssl);
-    int clientFD = SSL_get_fd(ssl);
-    SSL_free(ssl);
-    close(clientFD);
+// Metric: number of the last logged change
+double readLastChange(const void *data) {
+  (void)data;
+  return (double)changeLogLastSeq();
+}
+
+// Metric: connections streaming the change log
+double countSubscribers(const void *data) {
+  (void)data;
+  size_t count = 0;
+  for (Connection *connection = connectionFirst(); connection; connection = connection->next) {
+    count += connection->session != NULL;
   }
+  return (double)count;
 }
 
-// Accepts plaintext TCP connections and handles them in a loop.
-void HTTPServerLoop(int port) {
-  int serverSocketFD = rawNewServerSocket(port);
-  if (serverSocketFD < 0) return;
+// The auth protocol on the shared connection engine. A pipelined burst is timed from
+// its first request until its replies are sent; other requests from accept.
+static const ProtocolHandler authProtocol = {
+  .name = "auth",
+  .start = serveConnection,
+  .ready = onClientReady,
+  .timeout = onConnectionTimeout,
+  .release = releaseConnection,
+  .drain = drainConnections,
+  .reload = reloadFiles,
+};
+
+// Serves TLS or plaintext connections from one event loop until an upgrade has drained.
+void runServer(int port, int SSLMode) {
+  if (engineListen(&authProtocol, port, SSLMode, configGet("unix_socket")) != 0) return;
 
-  while (1) {
-    int clientSocketFD = rawAcceptClientConnection(serverSocketFD);
-    if (clientSocketFD < 0) continue;
-    HandleClient(&clientSocketFD, 0);
-    rawCloseSocket(clientSocketFD);
+  serverLoop = engineStart();
+  if (!serverLoop || threadPoolAttach(computePool, serverLoop) != 0) return;
+  for (int i = 0; i < userShards; i++) {
+    if (threadPoolAttach(writerPools[i], serverLoop) != 0) return;
   }
+  if (replicating && replicaStart(serverLoop, configGet("replicate_from"), "replica.seq") != 0) return;
+
+  engineRun();
 }
 
 // ==== ENTRY ====
@@ -143,17 +661,75 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  // Handle SIGHUP (reload), SIGUSR2 (binary upgrade with socket handoff) and SIGQUIT (drain)
+  if (handoffInit(argv) != 0) {
+    return 1;
+  }
+
+  // A client that disconnects mid-write must not kill the server (TLS writes can't use MSG_NOSIGNAL)
+  signal(SIGPIPE, SIG_IGN);
+
+  // Optional settings; everything has a default
+  if (configLoad("auth.conf") != 0) {
+    return 1;
+  }
+
   // Initialize the database
-  if (initDatabase("users.db") != 0) {
+  userShards = (int)configGetInt("user_shards", 1);
+  if (userStoreOpen("users.db", userShards) != 0) {
+    return 1;
+  }
+
+  // A primary logs every change for replicas, starting a new log with every existing user.
+  // A replica applies its primary's changes and makes none of its own.
+  changeLogPath = configGet("change_log");
+  replicating = configGet("replicate_from") != NULL;
+  tcpReplicas = configGetInt("replication_tcp", 0) != 0;
+  if (changeLogPath && replicating) {
+    fprintf(stderr, "[!] A replica can't keep its own change_log\n");
     return 1;
   }
+  if (changeLogPath) {
+    if (changeLogOpen(changeLogPath) != 0) return 1;
+    if (changeLogLastSeq() == 0) {
+      printf("[*] Logged %zu existing users for replicas\n", userStoreForEach(logUser, NULL));
+    }
+    metricsRegister("auth_change_log_last_change", "Number of the last change in the change log",
+                    METRIC_GAUGE, readLastChange, NULL);
+    metricsRegister("auth_replicas_streaming", "Replicas connected to the change log",
+                    METRIC_GAUGE, countSubscribers, NULL);
+  }
+
+  // Key for signing session tokens, shared with later processes through the file
+  if (tokenInit("token.key") != 0) {
+    return 1;
+  }
+
+  // Password hashing runs on its own threads, one per CPU, with a bounded queue.
+  // Logins queued together are hashed together, one per SIMD lane.
+  printf("[*] Password hashing: %s, %d lanes\n", sha256mbName(), sha256mbLanes());
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  computePool = threadPoolNew("kdf", cpus > 0 ? (int)cpus : 1, COMPUTE_QUEUE_LIMIT);
+  if (!computePool) {
+    return 1;
+  }
+
+  // Each shard's rows are written, and synced, by a thread of its own, so shards
+  // take writes side by side
+  for (int i = 0; i < userShards; i++) {
+    char name[16];
+    snprintf(name, sizeof(name), "writer%d", i);
+    writerPools[i] = threadPoolNew(name, 1, WRITE_QUEUE_LIMIT);
+    if (!writerPools[i]) {
+      return 1;
+    }
+  }
 
   // Extract arguments
   int port = atoi(argv[1]);
   int SSLMode = (strcmp(argv[2], "HTTPS") == 0);
 
   // Run SSL or raw HTTP mode
-  if (SSLMode) SSLServerLoop(port);
-  else HTTPServerLoop(port);
+  runServer(port, SSLMode);
 }
 
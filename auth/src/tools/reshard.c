@@ -0,0 +1,212 @@
+// reshard.c - Offline tool to split the user database into shards, or merge them back
+//
+// Usage: reshard <database> <current shards> <new shards>, e.g. `reshard users.db 1 4`
+// from the auth server's directory. The new shards are written beside the old files
+// and only swapped in once every user has been copied. Files that are not part of
+// the new layout are kept with a ".old" suffix.
+
+#include <stdio.h>        // printf, fprintf, snprintf, rename
+#include <stdlib.h>       // atoi
+#include <string.h>       // strcmp
+#include <unistd.h>       // unlink
+#include <sqlite3.h>      // SQLite3
+
+#include "../header/userstore.h"   // Shard routing and file names, shared with the server
+
+#define PATH_LENGTH 512
+
+static char sourcePaths[USER_SHARDS_MAX][PATH_LENGTH];
+static char targetPaths[USER_SHARDS_MAX][PATH_LENGTH];
+static char tempPaths[USER_SHARDS_MAX][PATH_LENGTH + 4];
+static sqlite3 *targets[USER_SHARDS_MAX];
+static sqlite3_stmt *inserts[USER_SHARDS_MAX];
+
+// Report the last error on a handle
+int fail(sqlite3 *db, const char *what) {
+  fprintf(stderr, "[!] %s: %s\n", what, db ? sqlite3_errmsg(db) : "out of memory");
+  return 1;
+}
+
+// Read the users table definition and column count from the first current shard
+int readSchema(const char *path, char *schema, size_t size, int *columns) {
+  sqlite3 *db = NULL;
+  sqlite3_stmt *stmt = NULL;
+  int rc = 1;
+
+  if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+    fail(db, path);
+  } else if (sqlite3_prepare_v2(db, "SELECT sql FROM sqlite_master WHERE type = 'table' AND name = 'users';",
+                                -1, &stmt, NULL) != SQLITE_OK || sqlite3_step(stmt) != SQLITE_ROW) {
+    fail(db, "No users table");
+  } else {
+    snprintf(schema, size, "%s;", (const char *)sqlite3_column_text(stmt, 0));
+    sqlite3_finalize(stmt);
+    stmt = NULL;
+    if (sqlite3_prepare_v2(db, "SELECT * FROM users;", -1, &stmt, NULL) == SQLITE_OK) {
+      *columns = sqlite3_column_count(stmt);
+      rc = 0;
+    } else {
+      fail(db, path);
+    }
+  }
+
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+  return rc;
+}
+
+// Create one new shard beside its final name, ready to take rows in a single transaction
+int openTarget(int index, const char *schema, int columns) {
+  snprintf(tempPaths[index], sizeof(tempPaths[index]), "%s.new", targetPaths[index]);
+  unlink(tempPaths[index]);
+
+  if (sqlite3_open(tempPaths[index], &targets[index]) != SQLITE_OK) return fail(targets[index], tempPaths[index]);
+  if (sqlite3_exec(targets[index], schema, 0, 0, NULL) != SQLITE_OK ||
+      sqlite3_exec(targets[index], "BEGIN;", 0, 0, NULL) != SQLITE_OK) {
+    return fail(targets[index], tempPaths[index]);
+  }
+
+  char sql[64 + 3 * 32] = "INSERT INTO users VALUES (?";
+  for (int i = 1; i < columns && i < 32; i++) strcat(sql, ", ?");
+  strcat(sql, ");");
+  if (sqlite3_prepare_v2(targets[index], sql, -1, &inserts[index], NULL) != SQLITE_OK) {
+    return fail(targets[index], tempPaths[index]);
+  }
+  return 0;
+}
+
+// Copy every user of one current shard to the new shard its name hashes to
+int copySource(const char *path, int newShards, int columns, long *copied) {
+  sqlite3 *db = NULL;
+  sqlite3_stmt *stmt = NULL;
+  if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK ||
+      sqlite3_prepare_v2(db, "SELECT * FROM users;", -1, &stmt, NULL) != SQLITE_OK) {
+    fail(db, path);
+    sqlite3_close(db);
+    return 1;
+  }
+
+  // Shards written by the server all share one schema
+  int usernameColumn = -1;
+  for (int i = 0; i < sqlite3_column_count(stmt); i++) {
+    if (strcmp(sqlite3_column_name(stmt, i), "username") == 0) usernameColumn = i;
+  }
+  if (usernameColumn < 0 || sqlite3_column_count(stmt) != columns) {
+    fprintf(stderr, "[!] %s: users table differs from the first shard\n", path);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return 1;
+  }
+
+  int rc = 0;
+  int step;
+  while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const char *username = (const char *)sqlite3_column_text(stmt, usernameColumn);
+    int shard = userStoreShardOf(username ? username : "", newShards);
+    sqlite3_stmt *insert = inserts[shard];
+
+    for (int i = 0; i < columns; i++) sqlite3_bind_value(insert, i + 1, sqlite3_column_value(stmt, i));
+    if (sqlite3_step(insert) != SQLITE_DONE) {
+      rc = fail(targets[shard], tempPaths[shard]);
+      break;
+    }
+    sqlite3_reset(insert);
+    (*copied)++;
+  }
+  if (rc == 0 && step != SQLITE_DONE) rc = fail(db, path);
+
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+  return rc;
+}
+
+// Commit and close the new shards; on failure (or if commit is 0) their files are removed
+int closeTargets(int count, int commit) {
+  int rc = 0;
+  for (int i = 0; i < count; i++) {
+    sqlite3_finalize(inserts[i]);
+    if (commit && targets[i] && sqlite3_exec(targets[i], "COMMIT;", 0, 0, NULL) != SQLITE_OK) {
+      rc = fail(targets[i], tempPaths[i]);
+      commit = 0;
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    sqlite3_close(targets[i]);
+    if (!commit) unlink(tempPaths[i]);
+  }
+  return rc;
+}
+
+// Whether a path is one of the new shards (and will be replaced rather than retired)
+int isTarget(const char *path, int count) {
+  for (int i = 0; i < count; i++) {
+    if (strcmp(path, targetPaths[i]) == 0) return 1;
+  }
+  return 0;
+}
+
+// ==== ENTRY ====
+int main(int argc, char **argv) {
+  if (argc != 4) {
+    fprintf(stderr, "Usage: %s <database> <current shards> <new shards>\n", argv[0]);
+    return 1;
+  }
+
+  const char *database = argv[1];
+  int currentShards = atoi(argv[2]);
+  int newShards = atoi(argv[3]);
+  if (currentShards < 1 || currentShards > USER_SHARDS_MAX || newShards < 1 || newShards > USER_SHARDS_MAX) {
+    fprintf(stderr, "[!] Shard counts must be between 1 and %d\n", USER_SHARDS_MAX);
+    return 1;
+  }
+
+  for (int i = 0; i < currentShards; i++) {
+    if (userStoreShardPath(database, i, currentShards, sourcePaths[i], PATH_LENGTH) != 0) return 1;
+  }
+  for (int i = 0; i < newShards; i++) {
+    if (userStoreShardPath(database, i, newShards, targetPaths[i], PATH_LENGTH) != 0) return 1;
+  }
+
+  char schema[4096];
+  int columns;
+  if (readSchema(sourcePaths[0], schema, sizeof(schema), &columns) != 0) return 1;
+  if (columns > 32) {
+    fprintf(stderr, "[!] Too many columns in the users table\n");
+    return 1;
+  }
+
+  for (int i = 0; i < newShards; i++) {
+    if (openTarget(i, schema, columns) != 0) {
+      closeTargets(newShards, 0);
+      return 1;
+    }
+  }
+
+  // Each current shard is read once; rows go straight to their new shard
+  long copied = 0;
+  for (int i = 0; i < currentShards; i++) {
+    if (copySource(sourcePaths[i], newShards, columns, &copied) != 0) {
+      closeTargets(newShards, 0);
+      return 1;
+    }
+  }
+  if (closeTargets(newShards, 1) != 0) return 1;
+
+  // Swap the new shards in, then retire the current files they didn't replace
+  for (int i = 0; i < newShards; i++) {
+    if (rename(tempPaths[i], targetPaths[i]) != 0) {
+      perror("Error replacing shard");
+      return 1;
+    }
+  }
+  for (int i = 0; i < currentShards; i++) {
+    if (isTarget(sourcePaths[i], newShards)) continue;
+    char retired[PATH_LENGTH + 4];
+    snprintf(retired, sizeof(retired), "%s.old", sourcePaths[i]);
+    if (rename(sourcePaths[i], retired) != 0) perror("Error retiring old shard");
+  }
+
+  printf("[+] Moved %ld users from %d to %d shard(s); set user_shards %d in auth.conf\n",
+         copied, currentShards, newShards, newShards);
+  return 0;
+}
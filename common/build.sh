@@ -0,0 +1,11 @@
+#!/bin/bash
+# Build the code both servers share into build/libnoble.a
+set -e
+cd "$(dirname "$0")"
+
+mkdir -p build/obj
+for source in src/header/*.c; do
+  gcc -c "$source" -o "build/obj/$(basename "$source" .c).o" -O2
+done
+rm -f build/libnoble.a
+ar rcs build/libnoble.a build/obj/*.o
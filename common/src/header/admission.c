@@ -0,0 +1,81 @@
+// admission.c - Implementation of CoDel-style admission control
+#include "admission.h"
+
+#include <stdio.h>        // For snprintf
+
+#include "metrics.h"      // For metricsRegister
+
+static double readTarget(const void *data) {
+  return ((const Admission *)data)->targetMs / 1000.0;
+}
+
+static double readOverloaded(const void *data) {
+  return ((const Admission *)data)->overloaded;
+}
+
+static double readLastMin(const void *data) {
+  return ((const Admission *)data)->lastMin / 1000.0;
+}
+
+static double readShedRatio(const void *data) {
+  return ((const Admission *)data)->lastShedRatio;
+}
+
+static double readAdmitted(const void *data) {
+  return (double)((const Admission *)data)->admitted;
+}
+
+static double readShed(const void *data) {
+  return (double)((const Admission *)data)->shed;
+}
+
+void admissionInit(Admission *admission, const char *prefix, uint64_t targetMs, uint64_t intervalMs) {
+  *admission = (Admission){ .targetMs = targetMs, .intervalMs = intervalMs };
+
+  static const struct {
+    const char *suffix;
+    const char *help;
+    MetricType type;
+    double (*read)(const void *data);
+  } entries[] = {
+    { "target_seconds", "Wait from accept to service above which a queue is standing", METRIC_GAUGE, readTarget },
+    { "overloaded", "1 while new connections are being shed", METRIC_GAUGE, readOverloaded },
+    { "min_wait_seconds", "Shortest wait from accept to service in the last interval", METRIC_GAUGE, readLastMin },
+    { "shed_ratio", "Share of new connections shed in the last interval", METRIC_GAUGE, readShedRatio },
+    { "admitted_total", "Connections served", METRIC_COUNTER, readAdmitted },
+    { "shed_total", "Connections refused because of overload", METRIC_COUNTER, readShed },
+  };
+
+  for (size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); i++) {
+    char name[METRIC_NAME_MAX];
+    snprintf(name, sizeof(name), "%s_admission_%s", prefix, entries[i].suffix);
+    metricsRegister(name, entries[i].help, entries[i].type, entries[i].read, admission);
+  }
+}
+
+int admissionCheck(Admission *admission, uint64_t sojournMs, uint64_t nowMs) {
+  if (nowMs >= admission->intervalEnd) {
+    // Judge the interval that just ended and start the next with this connection.
+    // A whole quiet interval since then means any queue has drained.
+    int recent = nowMs < admission->intervalEnd + admission->intervalMs;
+    admission->overloaded = recent && admission->intervalSeen > 0 && admission->intervalMin > admission->targetMs;
+    admission->lastMin = admission->intervalSeen > 0 ? admission->intervalMin : 0;
+    admission->lastShedRatio = admission->intervalSeen > 0
+      ? (double)admission->intervalShed / (double)admission->intervalSeen : 0.0;
+    admission->intervalEnd = nowMs + admission->intervalMs;
+    admission->intervalMin = sojournMs;
+    admission->intervalSeen = 0;
+    admission->intervalShed = 0;
+  } else if (sojournMs < admission->intervalMin) {
+    admission->intervalMin = sojournMs;
+  }
+  admission->intervalSeen++;
+
+  if (admission->targetMs > 0 && admission->overloaded && sojournMs > 2 * admission->targetMs) {
+    admission->intervalShed++;
+    admission->shed++;
+    return 0;
+  }
+  admission->admitted++;
+  return 1;
+}
@@ -0,0 +1,35 @@
+// admission.h - CoDel-style admission control for new connections
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdint.h>
+
+// Tracks how long new connections wait between accept and the start of service.
+// Each interval is judged by the shortest wait seen in it: if even that exceeded
+// the target, a standing queue has formed and the server is overloaded. While
+// overloaded, connections that waited more than twice the target are shed, so
+// clients get a fast refusal instead of everyone getting a slow answer.
+typedef struct {
+  uint64_t targetMs;        // Acceptable wait (0 disables shedding)
+  uint64_t intervalMs;      // How often the overload state is re-judged
+  uint64_t intervalEnd;     // Loop time the current interval is judged at
+  uint64_t intervalMin;     // Shortest wait in the current interval
+  uint64_t intervalSeen;    // Connections in the current interval
+  uint64_t intervalShed;    // ...of which shed
+  int overloaded;           // Verdict on the last interval
+
+  // Reported through metrics
+  uint64_t admitted;
+  uint64_t shed;
+  uint64_t lastMin;         // Shortest wait in the last judged interval
+  double lastShedRatio;     // Share of connections shed in the last judged interval
+} Admission;
+
+// Set up admission control and register its metrics as <prefix>_admission_*
+void admissionInit(Admission *admission, const char *prefix, uint64_t targetMs, uint64_t intervalMs);
+
+// Decide whether a connection that waited sojournMs may be served.
+// Returns 1 to serve it, 0 to shed it.
+int admissionCheck(Admission *admission, uint64_t sojournMs, uint64_t nowMs);
+
+#endif // ADMISSION_H
@@ -0,0 +1,199 @@
+// capture.c - Implementation of the request capture file
+#include "capture.h"
+
+#include <stdio.h>        // For printf, fprintf, perror, fopen, fread
+#include <stdlib.h>       // For malloc, free, qsort
+#include <string.h>       // For memcpy, memcmp, memset, strlen
+#include <errno.h>        // For errno, EEXIST
+#include <fcntl.h>        // For open, O_APPEND, O_EXCL
+#include <time.h>         // For clock_gettime
+#include <unistd.h>       // For write, close, getpid
+
+#include "timer.h"        // For timerInit, timerArm, timerCancel
+
+// Only used from the event loop thread
+static int captureFD = -1;
+static EventLoop *captureLoop;
+static Timer flushTimer;
+static uint8_t buffer[CAPTURE_BUFFER_SIZE];
+static size_t buffered = 8;       // Records after the block header, which is filled in on flush
+
+static void putLE(uint8_t *out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t getLE(const uint8_t *in, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; i++) value |= (uint64_t)in[i] << (8 * i);
+  return value;
+}
+
+// Append the buffered block in one write, so blocks from several workers stay whole
+static void flush(void) {
+  if (captureFD < 0 || buffered == 8) return;
+
+  putLE(buffer, (uint64_t)getpid(), 4);
+  putLE(buffer + 4, buffered - 8, 4);
+  if (write(captureFD, buffer, buffered) != (ssize_t)buffered) {
+    perror("Error writing capture file, capture stopped");
+    close(captureFD);
+    captureFD = -1;
+  }
+  buffered = 8;
+}
+
+static void onFlushTimer(Timer *timer) {
+  (void)timer;
+  flush();
+}
+
+int captureOpen(EventLoop *loop, const char *path, const char *server) {
+  // Whichever process creates the file writes its header; the rest append
+  int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd >= 0) {
+    uint8_t header[CAPTURE_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, CAPTURE_MAGIC, 8);
+    header[8] = CAPTURE_VERSION;
+    size_t serverLength = strlen(server);   // Fixed width, not terminated when full
+    if (serverLength > CAPTURE_SERVER_LENGTH) serverLength = CAPTURE_SERVER_LENGTH;
+    memcpy(header + 9, server, serverLength);
+    if (write(fd, header, sizeof(header)) != (ssize_t)sizeof(header)) {
+      perror("Error writing capture header");
+      close(fd);
+      return -1;
+    }
+  } else if (errno == EEXIST) {
+    fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+  }
+  if (fd < 0) {
+    perror("Error opening capture file");
+    return -1;
+  }
+
+  captureFD = fd;
+  captureLoop = loop;
+  timerInit(&flushTimer, onFlushTimer, NULL);
+  printf("[*] Capturing requests to %s\n", path);
+  return 0;
+}
+
+int captureEnabled(void) {
+  return captureFD >= 0;
+}
+
+void captureRequest(uint64_t connection, unsigned flags, const char *data, size_t length) {
+  if (captureFD < 0) return;
+  if (length > CAPTURE_RECORD_MAX) length = CAPTURE_RECORD_MAX;
+  if (buffered + CAPTURE_RECORD_HEADER + length > sizeof(buffer)) flush();
+  if (captureFD < 0) return;
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  uint8_t *record = buffer + buffered;
+  putLE(record, (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000, 8);
+  putLE(record + 8, connection, 4);
+  record[12] = (uint8_t)flags;
+  putLE(record + 13, length, 2);
+  memcpy(record + CAPTURE_RECORD_HEADER, data, length);
+  buffered += CAPTURE_RECORD_HEADER + length;
+
+  TimerWheel *timers = eventLoopTimers(captureLoop);
+  if (!timerIsArmed(&flushTimer)) timerArm(timers, &flushTimer, CAPTURE_FLUSH_MS);
+}
+
+void captureClose(void) {
+  if (captureFD < 0) return;
+  flush();
+  timerCancel(eventLoopTimers(captureLoop), &flushTimer);
+  if (captureFD >= 0) close(captureFD);
+  captureFD = -1;
+}
+
+// ==== Reading ====
+
+static int compareArrival(const void *a, const void *b) {
+  const CaptureRecord *left = a, *right = b;
+  if (left->timeUs != right->timeUs) return left->timeUs < right->timeUs ? -1 : 1;
+  return left->data < right->data ? -1 : left->data > right->data;  // File order for equal times
+}
+
+// Walk the blocks after the header, filling records if given. Returns the record count,
+// stopping at a block cut short (a process that died mid-write).
+static size_t parseBlocks(const uint8_t *data, size_t size, CaptureRecord *records) {
+  size_t count = 0;
+  size_t offset = CAPTURE_HEADER_SIZE;
+  while (offset + 8 <= size) {
+    uint32_t process = (uint32_t)getLE(data + offset, 4);
+    size_t end = offset + 8 + getLE(data + offset + 4, 4);
+    if (end > size) break;
+
+    for (offset += 8; offset + CAPTURE_RECORD_HEADER <= end; ) {
+      const uint8_t *record = data + offset;
+      size_t length = getLE(record + 13, 2);
+      if (offset + CAPTURE_RECORD_HEADER + length > end) break;
+      if (records) {
+        records[count] = (CaptureRecord){
+          .timeUs = getLE(record, 8),
+          .process = process,
+          .connection = (uint32_t)getLE(record + 8, 4),
+          .flags = record[12],
+          .length = (uint16_t)length,
+          .data = (const char *)record + CAPTURE_RECORD_HEADER,
+        };
+      }
+      count++;
+      offset += CAPTURE_RECORD_HEADER + length;
+    }
+    offset = end;
+  }
+  return count;
+}
+
+CaptureRecord *captureLoad(const char *path, size_t *count, char server[CAPTURE_SERVER_LENGTH + 1]) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+
+  uint8_t *data = size > 0 ? malloc((size_t)size) : NULL;
+  if (!data || fread(data, 1, (size_t)size, file) != (size_t)size) {
+    fprintf(stderr, "[!] Could not read %s\n", path);
+    free(data);
+    fclose(file);
+    return NULL;
+  }
+  fclose(file);
+
+  if ((size_t)size < CAPTURE_HEADER_SIZE || memcmp(data, CAPTURE_MAGIC, 8) != 0 ||
+      data[8] != CAPTURE_VERSION) {
+    fprintf(stderr, "[!] %s is not a capture file\n", path);
+    free(data);
+    return NULL;
+  }
+
+  // Records and the bytes they point into share one allocation
+  *count = parseBlocks(data, (size_t)size, NULL);
+  CaptureRecord *records = malloc(*count * sizeof(CaptureRecord) + (size_t)size);
+  if (!records) {
+    free(data);
+    return NULL;
+  }
+  uint8_t *copy = (uint8_t *)(records + *count);
+  memcpy(copy, data, (size_t)size);
+  free(data);
+
+  memcpy(server, copy + 9, CAPTURE_SERVER_LENGTH);
+  server[CAPTURE_SERVER_LENGTH] = '\0';
+  parseBlocks(copy, (size_t)size, records);
+  qsort(records, *count, sizeof(CaptureRecord), compareArrival);
+  return records;
+}
+
+void captureFree(CaptureRecord *records) {
+  free(records);
+}
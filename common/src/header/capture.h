@@ -0,0 +1,65 @@
+// capture.h - Recording of arriving requests for later replay
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "eventloop.h"
+
+// A capture file starts with CAPTURE_MAGIC, a version byte and the server's name
+// padded to CAPTURE_SERVER_LENGTH. Every process serving the file then appends
+// blocks of records, each block in a single write so workers never interleave:
+//
+//   block:  u32 pid, u32 length of the records that follow
+//   record: u64 arrival (microseconds since the epoch), u32 connection id,
+//           u8 flags, u16 length, then the request bytes
+//
+// All integers are little-endian. Records are in arrival order within a block;
+// blocks from different processes overlap in time.
+#define CAPTURE_MAGIC "NOBLECAP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_SERVER_LENGTH 7
+#define CAPTURE_HEADER_SIZE (8 + 1 + CAPTURE_SERVER_LENGTH)
+#define CAPTURE_RECORD_HEADER 15
+#define CAPTURE_BUFFER_SIZE 65536      // Block held in memory before a write
+#define CAPTURE_RECORD_MAX (CAPTURE_BUFFER_SIZE - 8 - CAPTURE_RECORD_HEADER)  // Longer requests are cut short, so a record fits in an empty block
+#define CAPTURE_FLUSH_MS 1000          // Longest a record waits in memory
+
+// How a request arrived
+#define CAPTURE_PIPELINED 0x1          // Auth: one line on a PIPELINE connection
+#define CAPTURE_HTTP2 0x2              // HTTP: an HTTP/2 stream, rewritten as an HTTP/1.1 request
+#define CAPTURE_TLS 0x4                // Came in over TLS
+#define CAPTURE_LOCAL 0x8              // Came in over the Unix socket
+
+// One request read back from a capture file
+typedef struct {
+  uint64_t timeUs;
+  uint32_t process;
+  uint32_t connection;
+  uint8_t flags;
+  uint16_t length;
+  const char *data;
+} CaptureRecord;
+
+// Start appending requests to path for the named server, creating it (mode 0600,
+// since requests carry credentials) if needed. Records are written from loop at
+// least every CAPTURE_FLUSH_MS. Returns 0 on success.
+int captureOpen(EventLoop *loop, const char *path, const char *server);
+
+// Whether requests are being captured
+int captureEnabled(void);
+
+// Record a request as it arrives. Does nothing unless capturing.
+void captureRequest(uint64_t connection, unsigned flags, const char *data, size_t length);
+
+// Write out what is buffered and stop capturing
+void captureClose(void);
+
+// Read a whole capture file. Returns the records sorted by arrival, with *count set and
+// the server's name copied into server, or NULL on failure. Free with captureFree.
+CaptureRecord *captureLoad(const char *path, size_t *count, char server[CAPTURE_SERVER_LENGTH + 1]);
+
+void captureFree(CaptureRecord *records);
+
+#endif // CAPTURE_H
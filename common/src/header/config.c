@@ -0,0 +1,86 @@
+// config.c - Implementation of the configuration file reader
+#include "config.h"
+
+#include <stdio.h>        // For fopen, fgets, fprintf, perror
+#include <stdlib.h>       // For strtol
+#include <string.h>       // For strcmp, strlen, strdup, strspn, strcspn
+#include <errno.h>        // For errno, ENOENT
+
+typedef struct {
+  char *key;
+  char *value;
+} ConfigEntry;
+
+// Loaded once at startup and never freed; values are handed out as-is
+static ConfigEntry entries[CONFIG_MAX_ENTRIES];
+static size_t entryCount;
+
+int configLoad(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    if (errno == ENOENT) return 0;
+    perror("Error opening configuration file");
+    return -1;
+  }
+
+  char line[CONFIG_LINE_MAX];
+  int lineNumber = 0;
+  while (fgets(line, sizeof(line), file)) {
+    lineNumber++;
+    line[strcspn(line, "\r\n")] = '\0';
+
+    // Split into key and the rest of the line, trimming surrounding blanks
+    char *key = line + strspn(line, " \t");
+    if (*key == '\0' || *key == '#') continue;
+    char *value = key + strcspn(key, " \t");
+    if (*value) *value++ = '\0';
+    value += strspn(value, " \t");
+    size_t valueLength = strlen(value);
+    while (valueLength > 0 && (value[valueLength - 1] == ' ' || value[valueLength - 1] == '\t')) {
+      value[--valueLength] = '\0';
+    }
+
+    if (entryCount == CONFIG_MAX_ENTRIES) {
+      fprintf(stderr, "[!] %s:%d: too many settings, ignoring the rest\n", path, lineNumber);
+      break;
+    }
+    entries[entryCount].key = strdup(key);
+    entries[entryCount].value = strdup(value);
+    if (!entries[entryCount].key || !entries[entryCount].value) break;
+    entryCount++;
+  }
+
+  fclose(file);
+  printf("[*] Loaded %zu settings from %s\n", entryCount, path);
+  return 0;
+}
+
+const char *configGet(const char *key) {
+  for (size_t i = entryCount; i > 0; i--) {
+    if (strcmp(entries[i - 1].key, key) == 0) return entries[i - 1].value;
+  }
+  return NULL;
+}
+
+long configGetInt(const char *key, long fallback) {
+  const char *value = configGet(key);
+  if (!value || !*value) return fallback;
+
+  char *end;
+  long number = strtol(value, &end, 10);
+  if (*end != '\0') {
+    fprintf(stderr, "[!] Setting %s needs a number, using %ld\n", key, fallback);
+    return fallback;
+  }
+  return number;
+}
+
+size_t configGetAll(const char *key, const char **values, size_t max) {
+  size_t found = 0;
+  for (size_t i = 0; i < entryCount; i++) {
+    if (strcmp(entries[i].key, key) != 0) continue;
+    if (found < max) values[found] = entries[i].value;
+    found++;
+  }
+  return found;
+}
@@ -0,0 +1,25 @@
+// config.h - Optional "key value" configuration files shared by both servers
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+
+#define CONFIG_MAX_ENTRIES 256   // Lines kept from one file
+#define CONFIG_LINE_MAX 512      // Longest line accepted
+
+// Read a configuration file of "key value" lines; blank lines and lines starting
+// with '#' are ignored. A missing file is not an error: every setting keeps its
+// default. Returns 0 on success or -1 if the file exists but can't be read.
+int configLoad(const char *path);
+
+// Value of the last line with this key, or NULL if there is none
+const char *configGet(const char *key);
+
+// Integer value of a key, or fallback if it is missing or not a number
+long configGetInt(const char *key, long fallback);
+
+// Collect the values of every line with this key, in file order (for repeatable keys).
+// Returns the number found, of which at most max are stored.
+size_t configGetAll(const char *key, const char **values, size_t max);
+
+#endif // CONFIG_H
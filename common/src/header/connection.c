@@ -0,0 +1,93 @@
+// connection.c - Implementation of pooled per-connection state
+#include "connection.h"
+#include "pool.h"
+
+static __thread Slab connectionSlab = SLAB_INITIALIZER(Connection);
+static __thread Connection *openConnections;
+static uint64_t nextConnectionId = 1;
+
+Connection *connectionNew(int fd, SSL *ssl) {
+  Connection *connection = slabAlloc(&connectionSlab);
+  if (!connection) return NULL;
+
+  connection->id = nextConnectionId++;
+  connection->fd = fd;
+  connection->ssl = ssl;
+  connection->transport = ssl ? &tlsTransport : &plainTransport;
+  connection->peerUid = (uid_t)-1;
+  connection->phase = ssl ? PHASE_HANDSHAKE : PHASE_READ;
+  connection->buffer = NULL;
+  connection->length = 0;
+  connection->sent = 0;
+  connection->body = NULL;
+  connection->bodyFD = -1;
+  connection->bodyOffset = 0;
+  connection->bodyRemaining = 0;
+  connection->bodyOwner = NULL;
+  connection->releaseBody = NULL;
+  connection->keepAlive = 0;
+  connection->acceptedMs = 0;
+  connection->shed = 0;
+  connection->session = NULL;
+  connection->pendingWork = NULL;
+  connection->span.startNs = 0;
+  timerInit(&connection->timer, NULL, connection);
+
+  // Link into the list of open connections
+  connection->prev = NULL;
+  connection->next = openConnections;
+  if (openConnections) openConnections->prev = connection;
+  openConnections = connection;
+
+  return connection;
+}
+
+char *connectionBuffer(Connection *connection) {
+  if (!connection->buffer) {
+    connection->buffer = bufferAcquire();
+    connection->length = 0;
+    connection->sent = 0;
+  }
+  return connection->buffer;
+}
+
+void connectionReleaseBuffer(Connection *connection) {
+  bufferRelease(connection->buffer);
+  connection->buffer = NULL;
+  connection->length = 0;
+  connection->sent = 0;
+}
+
+void connectionSetPhase(Connection *connection, TimerWheel *timers,
+                        ConnectionPhase phase, uint64_t timeoutMs) {
+  connection->phase = phase;
+  timerArm(timers, &connection->timer, timeoutMs);
+}
+
+const char *connectionPhaseName(ConnectionPhase phase) {
+  switch (phase) {
+    case PHASE_HANDSHAKE: return "handshake";
+    case PHASE_READ: return "read";
+    case PHASE_WRITE: return "write";
+    case PHASE_IDLE: return "idle";
+  }
+  return "unknown";
+}
+
+Connection *connectionFirst(void) {
+  return openConnections;
+}
+
+size_t connectionCount(void) {
+  return connectionSlab.live;
+}
+
+void connectionFree(Connection *connection) {
+  connectionReleaseBuffer(connection);
+
+  if (connection->prev) connection->prev->next = connection->next;
+  else openConnections = connection->next;
+  if (connection->next) connection->next->prev = connection->prev;
+
+  slabFree(&connectionSlab, connection);
+}
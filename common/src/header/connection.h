@@ -0,0 +1,88 @@
+// connection.h - Pooled per-connection state shared by both servers
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <openssl/ssl.h>
+
+#include "eventloop.h"
+#include "timer.h"
+#include "trace.h"
+#include "transport.h"
+
+// Deadlines for each phase of a connection's life
+#define CONNECTION_HANDSHAKE_TIMEOUT_MS 10000  // TLS handshake must finish
+#define CONNECTION_READ_TIMEOUT_MS 10000       // Whole request must arrive
+#define CONNECTION_WRITE_TIMEOUT_MS 30000      // Longest stall while sending a response
+#define CONNECTION_IDLE_TIMEOUT_MS 60000       // Keep-alive connection with nothing in flight
+
+typedef enum {
+  PHASE_HANDSHAKE,   // TLS handshake in progress
+  PHASE_READ,        // Waiting for (the rest of) a request
+  PHASE_WRITE,       // Sending a response
+  PHASE_IDLE         // Kept open between requests
+} ConnectionPhase;
+
+// State for one client connection. Allocated from a per-thread slab; the
+// I/O buffer is only held while the connection has work in progress.
+typedef struct Connection {
+  uint64_t id;              // Unique per process, for logging
+  int fd;                   // Client socket (non-blocking)
+  SSL *ssl;                 // TLS session, or NULL for plaintext connections
+  const Transport *transport;  // Moves the connection's bytes (TLS when ssl is set)
+  uid_t peerUid;            // User on the other end of a Unix socket, or (uid_t)-1 over TCP
+  ConnectionPhase phase;
+  EventHandler handler;     // Readiness registration in the event loop
+  Timer timer;              // Deadline for the current phase
+
+  char *buffer;             // Pooled POOL_BUFFER_SIZE buffer, or NULL while idle
+  size_t length;            // Bytes of buffer in use
+  size_t sent;              // Bytes of buffer already written (while sending)
+
+  const char *body;         // In-memory body still to send, or NULL
+  int bodyFD;               // File the body is streamed from, or -1
+  off_t bodyOffset;         // Body bytes sent so far (the next file offset to send)
+  size_t bodyRemaining;     // Body bytes not yet copied into the buffer
+  void *bodyOwner;          // Keeps body or bodyFD valid while sending, or NULL
+  void (*releaseBody)(void *bodyOwner);
+
+  int keepAlive;            // More requests may follow once the current ones are answered
+  uint64_t acceptedMs;      // Loop time at accept, or 0 once admission has been decided
+  int shed;                 // Refused by admission control: answer "busy" and close
+  void *session;            // Protocol state for long-lived connections, or NULL
+  void *pendingWork;        // Server-specific list of background work for this connection
+  TraceSpan span;           // Timing of the current request, when sampled
+
+  struct Connection *next;  // Thread-local list of open connections
+  struct Connection *prev;
+} Connection;
+
+// Create the state for an accepted connection. Returns NULL when out of memory.
+Connection *connectionNew(int fd, SSL *ssl);
+
+// Get the connection's I/O buffer, taking one from the pool if it has none
+char *connectionBuffer(Connection *connection);
+
+// Give the I/O buffer back to the pool while the connection is idle
+void connectionReleaseBuffer(Connection *connection);
+
+// Enter a phase and (re)arm its deadline
+void connectionSetPhase(Connection *connection, TimerWheel *timers,
+                        ConnectionPhase phase, uint64_t timeoutMs);
+
+// Name of a phase, for logging
+const char *connectionPhaseName(ConnectionPhase phase);
+
+// First open connection on this thread, for walking the list with ->next
+Connection *connectionFirst(void);
+
+// Number of open connections on this thread
+size_t connectionCount(void);
+
+// Release the connection state. The caller has already removed it from the
+// event loop, cancelled its timer and closed the socket and TLS session.
+void connectionFree(Connection *connection);
+
+#endif // CONNECTION_H
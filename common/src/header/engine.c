@@ -0,0 +1,415 @@
+// engine.c - Implementation of the shared connection engine
+#include "engine.h"
+
+#include <stdio.h>        // For printf, fprintf
+#include <stdlib.h>       // For strtoul
+#include <fcntl.h>        // For fcntl, O_NONBLOCK
+#include <unistd.h>       // For close
+
+#include "socket.h"       // For rawNewServerSocket, rawAcceptNonBlocking, rawPeerUid
+#include "sslsocket.h"    // For initTLSContext, newServerSession
+#include "config.h"       // For configGet, configGetInt, configGetAll
+#include "admission.h"    // For admissionInit, admissionCheck
+#include "handoff.h"      // For handoffInherit, handoffUpgrade, handoffReady
+#include "metrics.h"      // For metricsRegister
+#include "capture.h"      // For captureOpen, captureClose
+
+// Only used from the event loop thread
+static const ProtocolHandler *protocol;
+static EventLoop *loop;
+static SSL_CTX *sslContext;            // NULL without TLS
+static int serverSocketFD = -1;
+static EventHandler listenerHandler;
+static int unixSocketFD = -1;          // Local listener, or -1 without unix_socket
+static EventHandler unixListenerHandler;
+static const char *unixSocketPath;
+static int listenPort;
+static uid_t allowedUids[ENGINE_MAX_ALLOWED_UIDS];  // Users local clients must run as (any if none)
+static size_t allowedUidCount;
+static SocketOptions socketOptions;
+static Admission admission;            // Sheds new connections while a queue is standing
+static EventHandler signalHandler;     // Readiness of the reload/upgrade signal pipe
+static Timer drainTimer;               // Deadline for connections left after an upgrade
+static int draining;                   // Listening sockets closed, waiting for connections to finish
+static int following;                  // Forked worker: drains with the first process, never upgrades
+
+// Reported through metrics
+static uint64_t acceptedTotal;
+static uint64_t handshakeFailures;
+static uint64_t timedOut;
+
+static double readOpen(const void *data) {
+  (void)data;
+  return (double)connectionCount();
+}
+
+static double readCounter(const void *data) {
+  return (double)*(const uint64_t *)data;
+}
+
+// ==== Connections ====
+
+// Decide once, when service starts, whether a new connection is served or shed.
+// Returns 1 if it is served.
+static int admit(Connection *connection) {
+  traceMark(&connection->span, TRACE_QUEUE);
+  uint64_t now = eventLoopNow(loop);
+  connection->shed = !admissionCheck(&admission, now - connection->acceptedMs, now);
+  connection->acceptedMs = 0;
+  return !connection->shed;
+}
+
+// Advance the TLS handshake, then hand the connection to the protocol
+static void continueHandshake(Connection *connection) {
+  int wantWrite = 0;
+  int status = connection->transport->handshake(connection, &wantWrite);
+  if (status == SOCKET_WOULD_BLOCK) {
+    eventLoopModify(loop, &connection->handler, wantWrite ? EPOLLOUT : EPOLLIN);
+    return;
+  }
+  TRACE_PROBE2(handshake_end, connection->id, status > 0);
+  if (status < 0) {
+    fprintf(stderr, "[!] TLS handshake failed\n");
+    handshakeFailures++;
+    engineClose(connection);
+    return;
+  }
+  traceMark(&connection->span, TRACE_HANDSHAKE);
+
+  eventLoopModify(loop, &connection->handler, EPOLLIN);
+  connectionSetPhase(connection, eventLoopTimers(loop), PHASE_READ, CONNECTION_READ_TIMEOUT_MS);
+  protocol->start(connection);  // The request may have arrived with the final handshake flight
+}
+
+// Admit a connection on its first readiness, then dispatch to the handshake or the protocol
+static void onClientReady(EventLoop *eventLoop, EventHandler *handler, uint32_t events) {
+  (void)eventLoop;
+  Connection *connection = handler->data;
+
+  if (connection->acceptedMs) {
+    // A shed plaintext client still gets its refusal, so it isn't lost to a reset
+    int admitted = admit(connection);
+    if (connection->phase != PHASE_HANDSHAKE) {
+      protocol->start(connection);
+      return;
+    }
+
+    // Under overload the handshake is the expensive part, so shed clients never get one
+    if (!admitted) {
+      engineClose(connection);
+      return;
+    }
+    TRACE_PROBE1(handshake_start, connection->id);
+  }
+
+  if (connection->phase == PHASE_HANDSHAKE) {
+    continueHandshake(connection);
+  } else {
+    protocol->ready(connection, events);
+  }
+}
+
+// A connection missed the deadline for its current phase (slow or stalled client)
+static void onConnectionTimeout(Timer *timer) {
+  Connection *connection = timer->data;
+  timedOut++;
+  if (protocol->timeout) {
+    protocol->timeout(connection);
+    return;
+  }
+  printf("[!] Client connection timed out during %s\n", connectionPhaseName(connection->phase));
+  engineClose(connection);
+}
+
+void engineClose(Connection *connection) {
+  if (protocol->release) protocol->release(connection);
+
+  // Otherwise whatever the request was doing when it ended takes the rest of its time
+  TracePhase lastPhase = TRACE_SEND;
+  if (connection->phase == PHASE_HANDSHAKE) lastPhase = TRACE_HANDSHAKE;
+  else if (connection->phase == PHASE_READ) lastPhase = TRACE_READ;
+  traceEnd(&connection->span, lastPhase, connection->id);
+
+  eventLoopRemove(loop, &connection->handler);
+  timerCancel(eventLoopTimers(loop), &connection->timer);
+  connection->transport->shutdown(connection);
+  close(connection->fd);
+  connectionFree(connection);
+
+  // After an upgrade, the old process exits once its last connection is done
+  if (draining && connectionCount() == 0) eventLoopStop(loop);
+}
+
+// Check a local client's user against the unix_allow_uid list, recording it on success
+static int peerAllowed(int clientFD, uid_t *peerUid) {
+  if (rawPeerUid(clientFD, peerUid) != 0) return 0;
+  if (allowedUidCount == 0) return 1;  // Only the socket file's permissions apply
+
+  for (size_t i = 0; i < allowedUidCount; i++) {
+    if (allowedUids[i] == *peerUid) return 1;
+  }
+  fprintf(stderr, "[!] Refused local client running as uid %u\n", (unsigned)*peerUid);
+  return 0;
+}
+
+// Accept every pending client on the TCP or Unix listener and register it with the event loop
+static void onListenerReady(EventLoop *eventLoop, EventHandler *handler, uint32_t events) {
+  (void)events;
+  int local = handler == &unixListenerHandler;
+
+  while (1) {
+    int clientFD = rawAcceptNonBlocking(handler->fd);
+    if (clientFD < 0) return;  // No more pending connections
+
+    // Local clients are identified by the kernel instead of TLS
+    uid_t peerUid = (uid_t)-1;
+    if (local && !peerAllowed(clientFD, &peerUid)) {
+      close(clientFD);
+      continue;
+    }
+
+    // The TLS handshake runs on the event loop like any other phase
+    int useTLS = sslContext && !local;
+    SSL *ssl = useTLS ? newServerSession(sslContext, clientFD) : NULL;
+    Connection *connection = (!useTLS || ssl) ? connectionNew(clientFD, ssl) : NULL;
+    if (!connection ||
+        eventLoopAdd(eventLoop, &connection->handler, clientFD, EPOLLIN, onClientReady, connection) != 0) {
+      if (connection) connectionFree(connection);
+      if (ssl) SSL_free(ssl);
+      close(clientFD);
+      continue;
+    }
+
+    acceptedTotal++;
+    connection->peerUid = peerUid;
+    connection->acceptedMs = eventLoopNow(eventLoop);
+    TRACE_PROBE2(accept, connection->id, clientFD);
+    traceBegin(&connection->span);
+    if (!local) socketOptionsApplyClient(clientFD, &socketOptions);
+    timerInit(&connection->timer, onConnectionTimeout, connection);
+    connectionSetPhase(connection, eventLoopTimers(eventLoop), connection->phase,
+                       ssl ? CONNECTION_HANDSHAKE_TIMEOUT_MS : CONNECTION_READ_TIMEOUT_MS);
+  }
+}
+
+// ==== Draining ====
+
+// Close whatever is still open once the drain period after an upgrade ends
+static void onDrainTimeout(Timer *timer) {
+  (void)timer;
+  printf("[!] Drain period over, closing %zu remaining connections\n", connectionCount());
+  while (connectionFirst()) engineClose(connectionFirst());
+  eventLoopStop(loop);
+}
+
+// Stop accepting after the listening sockets were handed to a new process (or on
+// SIGQUIT), and let the connections in progress finish
+static void startDrain(void) {
+  printf("[*] Stopped accepting, draining %zu connections\n", connectionCount());
+  draining = 1;
+
+  eventLoopRemove(loop, &listenerHandler);
+  close(serverSocketFD);
+  serverSocketFD = -1;
+
+  // The socket file stays in place for the new process, or is replaced at the next start
+  if (unixSocketFD >= 0) {
+    eventLoopRemove(loop, &unixListenerHandler);
+    close(unixSocketFD);
+    unixSocketFD = -1;
+  }
+
+  timerInit(&drainTimer, onDrainTimeout, NULL);
+  timerArm(eventLoopTimers(loop), &drainTimer, ENGINE_DRAIN_TIMEOUT_MS);
+
+  if (protocol->drain) protocol->drain();
+  if (connectionCount() == 0) eventLoopStop(loop);
+}
+
+// Swap in a TLS context with the current certificate files, keeping the old one on failure.
+// Sessions already accepted hold their own reference to the old context.
+static void reloadCertificates(void) {
+  printf("[*] Reloading certificates\n");
+  SSL_CTX *freshContext = initTLSContext();
+  if (protocol->alpn) SSLOfferProtocols(freshContext, protocol->alpn);
+  if (tryLoadCertificates(freshContext, "cert.pem", "key.pem") == 0) {
+    SSL_CTX_free(sslContext);
+    sslContext = freshContext;
+  } else {
+    fprintf(stderr, "[!] Certificate reload failed, keeping current certificates\n");
+    SSL_CTX_free(freshContext);
+  }
+}
+
+// The new process is serving, or failed to start and this one carries on
+static void onUpgradeDone(int ready) {
+  if (ready && !draining) startDrain();
+}
+
+// Handle reload (SIGHUP), upgrade (SIGUSR2) and drain (SIGQUIT) requests from the signal pipe
+static void onControlSignal(EventLoop *eventLoop, EventHandler *handler, uint32_t events) {
+  (void)eventLoop;
+  (void)handler;
+  (void)events;
+
+  HandoffSignal control = handoffTakeSignal();
+  if (control == HANDOFF_RELOAD) {
+    if (protocol->reload) protocol->reload();
+    if (sslContext) reloadCertificates();
+  } else if (control == HANDOFF_UPGRADE && !draining && !following) {
+    int listeners[2] = { serverSocketFD, unixSocketFD };
+    handoffUpgrade(loop, listeners, unixSocketFD >= 0 ? 2 : 1, onUpgradeDone);
+  } else if (control == HANDOFF_DRAIN && !draining) {
+    startDrain();
+  }
+}
+
+// ==== Setup ====
+
+// Reuse the listening sockets handed over by a previous process during an upgrade
+// (TCP first, then the Unix socket if it had one), or create new ones
+static int openServerSockets(int useTLS) {
+  int inherited[2];
+  int count = handoffInherit(inherited, 2);
+
+  if (count >= 1) {
+    printf("[*] Inherited server socket on port %d from previous process\n", listenPort);
+    serverSocketFD = inherited[0];
+  } else {
+    printf("[*] Creating new server socket on port %d\n", listenPort);
+    serverSocketFD = useTLS ? newServerSocket(listenPort) : rawNewServerSocket(listenPort);
+    if (serverSocketFD < 0) return -1;
+  }
+
+  if (count >= 2 && unixSocketPath) {
+    printf("[*] Inherited Unix socket %s from previous process\n", unixSocketPath);
+    unixSocketFD = inherited[1];
+  } else {
+    if (count >= 2) close(inherited[1]);  // No longer configured
+    if (unixSocketPath) {
+      printf("[*] Creating new Unix socket %s\n", unixSocketPath);
+      unixSocketFD = rawNewUnixServerSocket(unixSocketPath);
+      if (unixSocketFD < 0) return -1;
+    }
+  }
+  return 0;
+}
+
+// Read the users allowed on the Unix socket from "unix_allow_uid" lines
+static void loadAllowedUids(void) {
+  const char *values[ENGINE_MAX_ALLOWED_UIDS];
+  size_t count = configGetAll("unix_allow_uid", values, ENGINE_MAX_ALLOWED_UIDS);
+  if (count > ENGINE_MAX_ALLOWED_UIDS) count = ENGINE_MAX_ALLOWED_UIDS;
+
+  allowedUidCount = 0;
+  for (size_t i = 0; i < count; i++) {
+    char *end;
+    unsigned long uid = strtoul(values[i], &end, 10);
+    if (end == values[i] || *end != '\0') {
+      fprintf(stderr, "[!] Ignoring unix_allow_uid %s\n", values[i]);
+      continue;
+    }
+    allowedUids[allowedUidCount++] = (uid_t)uid;
+  }
+}
+
+int engineListen(const ProtocolHandler *handler, int port, int useTLS, const char *unixPath) {
+  protocol = handler;
+  listenPort = port;
+  unixSocketPath = unixPath;
+
+  if (useTLS) {
+    printf("[*] Initializing SSL context\n");
+    sslContext = initTLSContext();
+    if (protocol->alpn) SSLOfferProtocols(sslContext, protocol->alpn);
+    loadCertificates(sslContext, "cert.pem", "key.pem");
+  }
+
+  if (openServerSockets(useTLS) != 0) {
+    fprintf(stderr, "[!] Failed to create server socket\n");
+    return -1;
+  }
+  loadAllowedUids();
+
+  // Inherited listeners take the current settings too
+  socketOptionsLoad(&socketOptions);
+  socketOptionsApplyListener(serverSocketFD, &socketOptions);
+  if (unixSocketFD >= 0) socketOptionsApplyListener(unixSocketFD, &socketOptions);
+  return 0;
+}
+
+void engineFollow(void) {
+  following = 1;
+}
+
+EventLoop *engineStart(void) {
+  // Accept until the queue is empty on each wakeup, so the listener must not block
+  fcntl(serverSocketFD, F_SETFL, fcntl(serverSocketFD, F_GETFL) | O_NONBLOCK);
+  if (unixSocketFD >= 0) fcntl(unixSocketFD, F_SETFL, fcntl(unixSocketFD, F_GETFL) | O_NONBLOCK);
+
+  // With several workers on the same listeners, only one is woken per incoming connection
+  uint32_t listenEvents = EPOLLIN | EPOLLEXCLUSIVE;
+
+  loop = eventLoopNew();
+  if (!loop ||
+      eventLoopAdd(loop, &listenerHandler, serverSocketFD, listenEvents, onListenerReady, NULL) != 0 ||
+      (unixSocketFD >= 0 &&
+       eventLoopAdd(loop, &unixListenerHandler, unixSocketFD, listenEvents, onListenerReady, NULL) != 0) ||
+      eventLoopAdd(loop, &signalHandler, handoffSignalFd(), EPOLLIN, onControlSignal, NULL) != 0) {
+    fprintf(stderr, "[!] Failed to set up event loop\n");
+    return NULL;
+  }
+
+  // Shed new connections once the shortest wait for service stays above the target
+  admissionInit(&admission, protocol->name, (uint64_t)configGetInt("shed_target_ms", 5),
+                (uint64_t)configGetInt("shed_interval_ms", 100));
+
+  // Report sampled requests that take longer than trace_slow_ms, phase by phase
+  traceInit(protocol->name, (uint64_t)configGetInt("trace_slow_ms", 0), (uint32_t)configGetInt("trace_sample", 1));
+
+  // Record arriving requests for the replay tool; every worker appends to the same file
+  const char *capturePath = configGet("capture_file");
+  if (capturePath && captureOpen(loop, capturePath, protocol->name) != 0) {
+    fprintf(stderr, "[!] Continuing without capturing requests\n");
+  }
+
+  static const struct {
+    const char *suffix;
+    const char *help;
+    MetricType type;
+    double (*read)(const void *data);
+    const void *data;
+  } entries[] = {
+    { "connections_open", "Client connections open in this process", METRIC_GAUGE, readOpen, NULL },
+    { "connections_accepted_total", "Client connections accepted", METRIC_COUNTER, readCounter, &acceptedTotal },
+    { "connections_timed_out_total", "Connections that missed the deadline for their phase", METRIC_COUNTER, readCounter, &timedOut },
+    { "tls_handshake_failures_total", "TLS handshakes that failed", METRIC_COUNTER, readCounter, &handshakeFailures },
+  };
+  for (size_t i = 0; i < sizeof(entries) / sizeof(entries[0]); i++) {
+    char name[METRIC_NAME_MAX];
+    snprintf(name, sizeof(name), "%s_%s", protocol->name, entries[i].suffix);
+    metricsRegister(name, entries[i].help, entries[i].type, entries[i].read, entries[i].data);
+  }
+  return loop;
+}
+
+void engineRun(void) {
+  if (!following) handoffReady();  // Let a previous process stop accepting
+
+  printf("[*] Waiting for %s connections on port %d%s\n", protocol->name, listenPort, sslContext ? " (TLS)" : "");
+  if (unixSocketFD >= 0) printf("[*] Waiting for local %s connections on %s\n", protocol->name, unixSocketPath);
+  eventLoopRun(loop);
+
+  printf("[*] All connections drained, exiting\n");
+  captureClose();
+  eventLoopFree(loop);
+  if (sslContext) SSL_CTX_free(sslContext);
+}
+
+int engineDraining(void) {
+  return draining;
+}
+
+const SocketOptions *engineSocketOptions(void) {
+  return &socketOptions;
+}
@@ -0,0 +1,69 @@
+// engine.h - Connection engine shared by the servers
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+
+#include "connection.h"
+#include "eventloop.h"
+#include "sockopts.h"
+
+#define ENGINE_DRAIN_TIMEOUT_MS 30000  // Longest an old process keeps serving after an upgrade
+#define ENGINE_MAX_ALLOWED_UIDS 16     // "unix_allow_uid" lines read from the settings
+
+// A server's protocol, plugged into the engine. The engine owns everything up to
+// the first request: the listeners (TCP, with TLS when enabled, and the optional
+// Unix socket), accepting, admission control, the TLS handshake, phase deadlines,
+// closing, draining and the reload/upgrade signals. The protocol reads requests
+// and writes replies through connection->transport.
+typedef struct {
+  const char *name;         // Prefix for metrics and the capture file ("http", "auth")
+  const char *alpn;         // Protocols offered during the TLS handshake (see SSLOfferProtocols), or NULL
+
+  // Service starts: after the TLS handshake, or at a plaintext connection's first
+  // readiness. connection->shed is set if admission control refused a plaintext
+  // connection; a refused TLS connection is closed before its handshake.
+  void (*start)(Connection *connection);
+
+  // Readiness on a connection that has started
+  void (*ready)(Connection *connection, uint32_t events);
+
+  // The connection missed the deadline for its phase. NULL closes it.
+  void (*timeout)(Connection *connection);
+
+  // The connection is about to close: give up its background work and protocol state.
+  // A request cut short can end its span here with the phase it was in. Optional.
+  void (*release)(Connection *connection);
+
+  // Accepting has stopped after an upgrade or SIGQUIT: wind down long-lived connections. Optional.
+  void (*drain)(void);
+
+  // SIGHUP, before the certificates are reloaded. Optional.
+  void (*reload)(void);
+} ProtocolHandler;
+
+// Set up TLS (exiting if the certificates can't be loaded) and the listening sockets,
+// inheriting them from a previous process during an upgrade. unixPath is NULL without
+// a local listener. Call before forking workers. Returns 0 on success.
+int engineListen(const ProtocolHandler *protocol, int port, int useTLS, const char *unixPath);
+
+// Mark this process as a forked worker: it drains along with the first process and never upgrades
+void engineFollow(void);
+
+// Create the event loop and start accepting, along with admission control, tracing and
+// capture as configured. Returns the loop for the protocol's own handlers, or NULL.
+EventLoop *engineStart(void);
+
+// Let a previous process stop accepting, then serve until draining is done
+void engineRun(void);
+
+// Close a connection in any phase and release all of its state
+void engineClose(Connection *connection);
+
+// Whether accepting has stopped and the process is waiting for its connections to finish
+int engineDraining(void);
+
+// Socket tuning from the settings, for corking replies
+const SocketOptions *engineSocketOptions(void);
+
+#endif // ENGINE_H
@@ -0,0 +1,133 @@
+// eventloop.c - Implementation of the epoll event loop
+#include "eventloop.h"
+
+#include <stdio.h>    // For perror
+#include <stdlib.h>   // For malloc, free
+#include <errno.h>    // For errno, EINTR
+#include <time.h>     // For clock_gettime
+#include <unistd.h>   // For close
+
+struct EventLoop {
+  int epollFD;
+  int running;
+  uint64_t nowMs;
+  TimerWheel timers;
+
+  // The batch being dispatched, so a removed handler's later events can be dropped
+  struct epoll_event *batch;
+  int batchNext;
+  int batchSize;
+};
+
+uint64_t monotonicMs(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+EventLoop *eventLoopNew(void) {
+  EventLoop *loop = malloc(sizeof(EventLoop));
+  if (!loop) return NULL;
+
+  loop->epollFD = epoll_create1(EPOLL_CLOEXEC);
+  if (loop->epollFD < 0) {
+    perror("Error creating epoll instance");
+    free(loop);
+    return NULL;
+  }
+
+  loop->running = 0;
+  loop->batch = NULL;
+  loop->batchNext = 0;
+  loop->batchSize = 0;
+  loop->nowMs = monotonicMs();
+  timerWheelInit(&loop->timers, loop->nowMs);
+  return loop;
+}
+
+void eventLoopFree(EventLoop *loop) {
+  if (!loop) return;
+  close(loop->epollFD);
+  free(loop);
+}
+
+int eventLoopAdd(EventLoop *loop, EventHandler *handler, int fd, uint32_t events,
+                 EventCallback callback, void *data) {
+  handler->fd = fd;
+  handler->events = events;
+  handler->callback = callback;
+  handler->data = data;
+
+  struct epoll_event event = { .events = events, .data.ptr = handler };
+  if (epoll_ctl(loop->epollFD, EPOLL_CTL_ADD, fd, &event) < 0) {
+    perror("Error registering file descriptor");
+    return -1;
+  }
+  return 0;
+}
+
+int eventLoopModify(EventLoop *loop, EventHandler *handler, uint32_t events) {
+  if (handler->events == events) return 0;
+
+  struct epoll_event event = { .events = events, .data.ptr = handler };
+  if (epoll_ctl(loop->epollFD, EPOLL_CTL_MOD, handler->fd, &event) < 0) {
+    perror("Error modifying file descriptor events");
+    return -1;
+  }
+  handler->events = events;
+  return 0;
+}
+
+void eventLoopRemove(EventLoop *loop, EventHandler *handler) {
+  epoll_ctl(loop->epollFD, EPOLL_CTL_DEL, handler->fd, NULL);
+  handler->events = 0;
+
+  // Its owner is about to be freed, and its memory may be reused within this batch
+  for (int i = loop->batchNext; i < loop->batchSize; i++) {
+    if (loop->batch[i].data.ptr == handler) loop->batch[i].data.ptr = NULL;
+  }
+}
+
+void eventLoopRun(EventLoop *loop) {
+  struct epoll_event events[EVENTLOOP_MAX_EVENTS];
+  loop->running = 1;
+
+  while (loop->running) {
+    // Sleep until the next fd event or the next tick with timer work
+    int timeout = timerWheelNextTimeout(&loop->timers, loop->nowMs);
+    int ready = epoll_wait(loop->epollFD, events, EVENTLOOP_MAX_EVENTS, timeout);
+    if (ready < 0 && errno != EINTR) {
+      perror("Error waiting for events");
+      break;
+    }
+
+    loop->nowMs = monotonicMs();
+
+    loop->batch = events;
+    loop->batchNext = 0;
+    loop->batchSize = ready > 0 ? ready : 0;
+
+    // Run expired timers first, so the handlers below arm deadlines from the current
+    // tick rather than the one before the wait. Connections they close drop out of the batch.
+    timerWheelAdvance(&loop->timers, loop->nowMs);
+
+    while (loop->batchNext < loop->batchSize) {
+      struct epoll_event *event = &events[loop->batchNext++];
+      EventHandler *handler = event->data.ptr;
+      if (handler) handler->callback(loop, handler, event->events);
+    }
+    loop->batchSize = 0;
+  }
+}
+
+void eventLoopStop(EventLoop *loop) {
+  loop->running = 0;
+}
+
+TimerWheel *eventLoopTimers(EventLoop *loop) {
+  return &loop->timers;
+}
+
+uint64_t eventLoopNow(EventLoop *loop) {
+  return loop->nowMs;
+}
@@ -0,0 +1,58 @@
+// eventloop.h - epoll-based event loop with an integrated timer wheel
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#include "timer.h"
+
+#define EVENTLOOP_MAX_EVENTS 256  // Readiness events handled per wakeup
+
+typedef struct EventLoop EventLoop;
+typedef struct EventHandler EventHandler;
+
+// Called when a registered file descriptor is ready (events is an EPOLL* mask)
+typedef void (*EventCallback)(EventLoop *loop, EventHandler *handler, uint32_t events);
+
+// Registration for one file descriptor, embedded in the object that owns it
+struct EventHandler {
+  int fd;
+  uint32_t events;          // Currently requested EPOLL* mask
+  EventCallback callback;
+  void *data;               // Owner of the handler
+};
+
+// Create an event loop. Returns NULL on failure.
+EventLoop *eventLoopNew(void);
+
+// Destroy an event loop. Registered handlers are not touched.
+void eventLoopFree(EventLoop *loop);
+
+// Start watching a file descriptor for the given events
+int eventLoopAdd(EventLoop *loop, EventHandler *handler, int fd, uint32_t events,
+                 EventCallback callback, void *data);
+
+// Change the events watched for a registered file descriptor (no-op if unchanged)
+int eventLoopModify(EventLoop *loop, EventHandler *handler, uint32_t events);
+
+// Stop watching a file descriptor. Must be called before it is closed; events for it
+// still pending in the current batch are dropped, so its owner may then be freed.
+void eventLoopRemove(EventLoop *loop, EventHandler *handler);
+
+// Run until eventLoopStop is called
+void eventLoopRun(EventLoop *loop);
+
+// Make eventLoopRun return after the current iteration
+void eventLoopStop(EventLoop *loop);
+
+// The loop's timer wheel, advanced on every iteration
+TimerWheel *eventLoopTimers(EventLoop *loop);
+
+// Monotonic clock in milliseconds, as sampled at the start of the current iteration
+uint64_t eventLoopNow(EventLoop *loop);
+
+// Read the monotonic clock in milliseconds
+uint64_t monotonicMs(void);
+
+#endif // EVENTLOOP_H
@@ -0,0 +1,296 @@
+// handoff.c - Passing listening sockets to a new process over a Unix socket (SCM_RIGHTS)
+#define _GNU_SOURCE
+#include "handoff.h"
+
+#include <stdio.h>        // For printf, perror, snprintf
+#include <stdlib.h>       // For getenv, unsetenv, realpath, strtol, malloc, free
+#include <string.h>       // For memset, memcpy, strncmp
+#include <errno.h>        // For errno, EINTR
+#include <fcntl.h>        // For fcntl, O_NONBLOCK, FD_CLOEXEC
+#include <limits.h>       // For PATH_MAX
+#include <signal.h>       // For sigaction, kill
+#include <unistd.h>       // For fork, execve, pipe, close, close_range
+#include <sys/socket.h>   // For socketpair, sendmsg, recvmsg
+#include <sys/wait.h>     // For waitpid
+
+static char executablePath[PATH_MAX];  // Resolved at startup so a replaced binary is picked up
+static char **savedArgv;               // Arguments to restart with
+static int signalPipe[2] = { -1, -1 }; // Self-pipe written by the signal handler
+static int handoffChannel = -1;        // Channel to the previous process during an upgrade
+
+// An upgrade waiting for the new process to report ready, finished from the event loop
+static EventLoop *upgradeLoop;
+static EventHandler upgradeHandler;    // Readiness of the channel to the new process
+static Timer upgradeTimer;             // Gives up on a new process that never gets ready
+static pid_t upgradeChild = -1;        // New process, or -1 when no upgrade is running
+static void (*upgradeDone)(int ready);
+
+extern char **environ;
+
+static volatile sig_atomic_t reloadPending;
+static volatile sig_atomic_t upgradePending;
+static volatile sig_atomic_t drainPending;
+
+// Record the signal and wake the server loop
+static void handleControlSignal(int signum) {
+  int savedErrno = errno;
+
+  if (signum == SIGUSR2) upgradePending = 1;
+  else if (signum == SIGQUIT) drainPending = 1;
+  else reloadPending = 1;
+
+  char byte = 1;
+  (void)write(signalPipe[1], &byte, 1);
+  errno = savedErrno;
+}
+
+int handoffInit(char **argv) {
+  savedArgv = argv;
+  if (!realpath(argv[0], executablePath)) {
+    perror("Error resolving executable path");
+    return -1;
+  }
+
+  if (pipe2(signalPipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+    perror("Error creating signal pipe");
+    return -1;
+  }
+
+  // SA_RESTART keeps in-flight reads and writes from failing with EINTR
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handleControlSignal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+
+  if (sigaction(SIGHUP, &action, NULL) < 0 || sigaction(SIGUSR2, &action, NULL) < 0 ||
+      sigaction(SIGQUIT, &action, NULL) < 0) {
+    perror("Error installing signal handlers");
+    return -1;
+  }
+
+  return 0;
+}
+
+int handoffSignalFd(void) {
+  return signalPipe[0];
+}
+
+HandoffSignal handoffTakeSignal(void) {
+  // Drain the wakeup bytes; the flags carry the actual requests
+  char drain[64];
+  while (read(signalPipe[0], drain, sizeof(drain)) > 0) {}
+
+  HandoffSignal control = HANDOFF_NONE;
+  if (drainPending) {
+    drainPending = 0;
+    control = HANDOFF_DRAIN;
+  } else if (upgradePending) {
+    upgradePending = 0;
+    control = HANDOFF_UPGRADE;
+  } else if (reloadPending) {
+    reloadPending = 0;
+    control = HANDOFF_RELOAD;
+  }
+
+  // Come back for any other signal that arrived at the same time
+  if (drainPending || upgradePending || reloadPending) {
+    char byte = 1;
+    (void)write(signalPipe[1], &byte, 1);
+  }
+  return control;
+}
+
+int handoffForked(void) {
+  close(signalPipe[0]);
+  close(signalPipe[1]);
+  if (pipe2(signalPipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+    perror("Error creating signal pipe");
+    return -1;
+  }
+  return 0;
+}
+
+int handoffInherit(int *fds, int maxFds) {
+  const char *channelText = getenv(HANDOFF_ENV);
+  if (!channelText) return 0;
+
+  handoffChannel = (int)strtol(channelText, NULL, 10);
+  unsetenv(HANDOFF_ENV);  // Later upgrades of this process start fresh
+
+  // The payload is the number of descriptors; the descriptors travel as ancillary data
+  int count = 0;
+  struct iovec iov = { .iov_base = &count, .iov_len = sizeof(count) };
+  char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+
+  ssize_t received;
+  do {
+    received = recvmsg(handoffChannel, &message, MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+
+  if (received != sizeof(count)) {
+    perror("Error receiving listening sockets");
+    close(handoffChannel);
+    handoffChannel = -1;
+    return -1;
+  }
+
+  struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+  if (!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS ||
+      count > maxFds || header->cmsg_len != CMSG_LEN(sizeof(int) * count)) {
+    fprintf(stderr, "[!] Invalid listening socket handoff\n");
+    close(handoffChannel);
+    handoffChannel = -1;
+    return -1;
+  }
+
+  memcpy(fds, CMSG_DATA(header), sizeof(int) * count);
+  return count;
+}
+
+void handoffReady(void) {
+  if (handoffChannel < 0) return;
+
+  char ready = 'R';
+  if (write(handoffChannel, &ready, 1) != 1) {
+    perror("Error signalling handoff readiness");
+  }
+  close(handoffChannel);
+  handoffChannel = -1;
+}
+
+// The environment for the new process: ours, with the channel at descriptor 3.
+// Built before forking, since the child may only make async-signal-safe calls.
+static char **childEnvironment(void) {
+  static char channelEntry[] = HANDOFF_ENV "=3";
+  size_t count = 0;
+  while (environ[count]) count++;
+
+  char **environment = malloc((count + 2) * sizeof(char *));
+  if (!environment) return NULL;
+
+  size_t used = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (strncmp(environ[i], HANDOFF_ENV "=", sizeof(HANDOFF_ENV)) != 0) environment[used++] = environ[i];
+  }
+  environment[used++] = channelEntry;
+  environment[used] = NULL;
+  return environment;
+}
+
+// Stop a new process that won't take over
+static void abandonChild(pid_t child) {
+  fprintf(stderr, "[!] New server process did not become ready, continuing\n");
+  kill(child, SIGTERM);
+  waitpid(child, NULL, 0);
+}
+
+// End the upgrade in progress, keeping the new process if it got ready
+static void finishUpgrade(int ready) {
+  eventLoopRemove(upgradeLoop, &upgradeHandler);
+  close(upgradeHandler.fd);
+  timerCancel(eventLoopTimers(upgradeLoop), &upgradeTimer);
+
+  pid_t child = upgradeChild;
+  upgradeChild = -1;
+  if (ready) {
+    printf("[*] Handed listening sockets to new process %d\n", (int)child);
+  } else {
+    abandonChild(child);
+  }
+  upgradeDone(ready);
+}
+
+// The new process reported ready, or closed the channel by exiting
+static void onUpgradeReply(EventLoop *loop, EventHandler *handler, uint32_t events) {
+  (void)loop;
+  (void)events;
+  char reply = 0;
+  ssize_t received = read(handler->fd, &reply, 1);
+  if (received < 0 && (errno == EAGAIN || errno == EINTR)) return;
+  finishUpgrade(received == 1 && reply == 'R');
+}
+
+static void onUpgradeTimeout(Timer *timer) {
+  (void)timer;
+  finishUpgrade(0);
+}
+
+int handoffUpgrade(EventLoop *loop, const int *fds, int count, void (*done)(int ready)) {
+  if (count > HANDOFF_MAX_FDS || upgradeChild >= 0) return -1;
+
+  char **environment = childEnvironment();
+  if (!environment) return -1;
+
+  int channel[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) < 0) {
+    perror("Error creating handoff channel");
+    free(environment);
+    return -1;
+  }
+
+  pid_t child = fork();
+  if (child < 0) {
+    perror("Error forking new server process");
+    free(environment);
+    close(channel[0]);
+    close(channel[1]);
+    return -1;
+  }
+
+  if (child == 0) {
+    // New process: keep only stdio and the channel, then run the (possibly replaced) binary
+    if (channel[1] == 3) {
+      fcntl(3, F_SETFD, 0);  // dup2 onto itself would keep close-on-exec
+    } else if (dup2(channel[1], 3) < 0) {
+      _exit(127);
+    }
+    close_range(4, ~0U, 0);
+
+    execve(executablePath, savedArgv, environment);
+    _exit(127);
+  }
+
+  free(environment);
+  close(channel[1]);
+
+  // Pass the listening sockets
+  struct iovec iov = { .iov_base = &count, .iov_len = sizeof(count) };
+  char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+  memset(control, 0, sizeof(control));
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+  struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+  memcpy(CMSG_DATA(header), fds, sizeof(int) * count);
+
+  // The loop keeps serving while the new process initializes; its 'R' finishes the handoff
+  fcntl(channel[0], F_SETFL, fcntl(channel[0], F_GETFL) | O_NONBLOCK);
+  if (sendmsg(channel[0], &message, MSG_NOSIGNAL) != sizeof(count) ||
+      eventLoopAdd(loop, &upgradeHandler, channel[0], EPOLLIN, onUpgradeReply, NULL) != 0) {
+    perror("Error sending listening sockets");
+    close(channel[0]);
+    abandonChild(child);
+    return -1;
+  }
+
+  upgradeLoop = loop;
+  upgradeChild = child;
+  upgradeDone = done;
+  timerInit(&upgradeTimer, onUpgradeTimeout, NULL);
+  timerArm(eventLoopTimers(loop), &upgradeTimer, HANDOFF_READY_TIMEOUT_MS);
+  return 0;
+}
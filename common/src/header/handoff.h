@@ -0,0 +1,46 @@
+// handoff.h - Zero-downtime reload and binary upgrade via listening-socket handoff
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include "eventloop.h"
+
+#define HANDOFF_ENV "NOBLE_HANDOFF_FD"     // Environment variable naming the handoff channel
+#define HANDOFF_MAX_FDS 8                  // Most listening sockets passed in one handoff
+#define HANDOFF_READY_TIMEOUT_MS 10000     // How long to wait for the new process to take over
+
+// Control signals delivered to the server loop
+typedef enum {
+  HANDOFF_NONE = 0,
+  HANDOFF_RELOAD,    // SIGHUP: reload certificates and data in place
+  HANDOFF_UPGRADE,   // SIGUSR2: start a new binary and hand it the listening sockets
+  HANDOFF_DRAIN      // SIGQUIT: stop accepting and exit once the open connections finish
+} HandoffSignal;
+
+// Remember how the server was started and install the SIGHUP/SIGUSR2/SIGQUIT handlers.
+// Returns 0 on success or -1 on failure.
+int handoffInit(char **argv);
+
+// File descriptor that becomes readable when a control signal is pending
+int handoffSignalFd(void);
+
+// Give a process forked after handoffInit its own signal pipe, so each process
+// only wakes for signals sent to it. Returns 0 on success.
+int handoffForked(void);
+
+// Return and clear the most important pending control signal
+HandoffSignal handoffTakeSignal(void);
+
+// Receive listening sockets from the previous process, if started by an upgrade.
+// Returns the number of sockets received, 0 for a normal start, or -1 on error.
+int handoffInherit(int *fds, int maxFds);
+
+// Tell the previous process that this one is serving and it may stop accepting
+void handoffReady(void);
+
+// Start a new copy of the binary and pass it the listening sockets. The loop keeps
+// serving while the new process starts; done is called from loop with 1 once it is
+// serving, or 0 if it failed or wasn't ready within HANDOFF_READY_TIMEOUT_MS (keep
+// serving). Returns 0 if the handoff started, or -1 if it couldn't or one is running.
+int handoffUpgrade(EventLoop *loop, const int *fds, int count, void (*done)(int ready));
+
+#endif // HANDOFF_H
@@ -0,0 +1,55 @@
+// metrics.c - Implementation of the metrics registry
+#include "metrics.h"
+
+#include <stdio.h>        // For snprintf, fprintf
+
+typedef struct {
+  char name[METRIC_NAME_MAX];
+  const char *help;
+  MetricType type;
+  double (*read)(const void *data);
+  const void *data;
+} Metric;
+
+// Registered at startup and kept for the life of the process
+static Metric metrics[METRICS_MAX];
+static size_t metricCount;
+
+int metricsRegister(const char *name, const char *help, MetricType type,
+                    double (*read)(const void *data), const void *data) {
+  if (metricCount == METRICS_MAX) {
+    fprintf(stderr, "[!] Too many metrics, not reporting %s\n", name);
+    return -1;
+  }
+
+  Metric *metric = &metrics[metricCount];
+  if ((size_t)snprintf(metric->name, sizeof(metric->name), "%s", name) >= sizeof(metric->name)) {
+    fprintf(stderr, "[!] Metric name too long: %s\n", name);
+    return -1;
+  }
+  metric->help = help;
+  metric->type = type;
+  metric->read = read;
+  metric->data = data;
+  metricCount++;
+  return 0;
+}
+
+size_t metricsFormat(char *buffer, size_t size) {
+  size_t length = 0;
+  if (size > 0) buffer[0] = '\0';
+
+  for (size_t i = 0; i < metricCount; i++) {
+    const Metric *metric = &metrics[i];
+    int written = snprintf(buffer + length, size - length, "# HELP %s %s\n# TYPE %s %s\n%s %.9g\n",
+                           metric->name, metric->help,
+                           metric->name, metric->type == METRIC_COUNTER ? "counter" : "gauge",
+                           metric->name, metric->read(metric->data));
+    if (written < 0 || (size_t)written >= size - length) {
+      buffer[length] = '\0';  // Drop the partial entry
+      break;
+    }
+    length += (size_t)written;
+  }
+  return length;
+}
@@ -0,0 +1,24 @@
+// metrics.h - Named counters and gauges reported in Prometheus text format
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+
+#define METRICS_MAX 64          // Metrics one process can register
+#define METRIC_NAME_MAX 64      // Longest metric name, including the terminator
+
+typedef enum {
+  METRIC_COUNTER,   // Only goes up; rates come from the difference between scrapes
+  METRIC_GAUGE      // Current value
+} MetricType;
+
+// Report a value under name. read is called with data each time the metrics are
+// formatted, on the thread that formats them. Returns 0 on success.
+int metricsRegister(const char *name, const char *help, MetricType type,
+                    double (*read)(const void *data), const void *data);
+
+// Write every registered metric into buffer, stopping before one that doesn't fit.
+// Returns the length written, excluding the terminator.
+size_t metricsFormat(char *buffer, size_t size);
+
+#endif // METRICS_H
@@ -0,0 +1,66 @@
+// pool.c - Implementation of per-thread slab and buffer pools
+#include "pool.h"
+
+#include <stdlib.h>   // For aligned_alloc, free
+
+// Free buffers are linked through their first bytes
+typedef struct FreeNode {
+  struct FreeNode *next;
+} FreeNode;
+
+// Per-thread cache of idle I/O buffers
+static __thread FreeNode *idleBuffers;
+static __thread size_t idleBufferCount;
+
+void *slabAlloc(Slab *slab) {
+  if (!slab->freeList) {
+    // Carve a fresh cache-line-aligned chunk into objects and thread them onto the free list
+    char *chunk = aligned_alloc(CACHE_LINE_SIZE, POOL_SLAB_BYTES);
+    if (!chunk) return NULL;
+
+    size_t count = POOL_SLAB_BYTES / slab->objectSize;
+    for (size_t i = 0; i < count; i++) {
+      FreeNode *node = (FreeNode *)(chunk + i * slab->objectSize);
+      node->next = slab->freeList;
+      slab->freeList = node;
+    }
+  }
+
+  FreeNode *node = slab->freeList;
+  slab->freeList = node->next;
+  slab->live++;
+  return node;
+}
+
+void slabFree(Slab *slab, void *object) {
+  FreeNode *node = object;
+  node->next = slab->freeList;
+  slab->freeList = node;
+  slab->live--;
+}
+
+char *bufferAcquire(void) {
+  if (idleBuffers) {
+    FreeNode *node = idleBuffers;
+    idleBuffers = node->next;
+    idleBufferCount--;
+    return (char *)node;
+  }
+
+  return aligned_alloc(CACHE_LINE_SIZE, POOL_BUFFER_SIZE);
+}
+
+void bufferRelease(char *buffer) {
+  if (!buffer) return;
+
+  // Keep a bounded number of buffers warm; give the rest back to the allocator
+  if (idleBufferCount >= POOL_MAX_IDLE_BUFFERS) {
+    free(buffer);
+    return;
+  }
+
+  FreeNode *node = (FreeNode *)buffer;
+  node->next = idleBuffers;
+  idleBuffers = node;
+  idleBufferCount++;
+}
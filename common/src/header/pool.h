@@ -0,0 +1,36 @@
+// pool.h - Per-thread slab pools for connection objects and I/O buffers
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+#define CACHE_LINE_SIZE 64            // Alignment for pooled objects and buffers
+#define POOL_BUFFER_SIZE 16384        // Size of one I/O buffer (a full TLS record)
+#define POOL_SLAB_BYTES (64 * 1024)   // Memory carved into objects at a time
+#define POOL_MAX_IDLE_BUFFERS 32      // Free buffers cached per thread before memory is returned
+
+// Fixed-size object allocator. Objects are cache-line aligned and are not zeroed.
+// A Slab must only be used by one thread; declare it __thread to get one per thread.
+typedef struct {
+  size_t objectSize;  // Object size rounded up to a cache line
+  void *freeList;     // Intrusive list of free objects
+  size_t live;        // Objects currently handed out
+} Slab;
+
+// Static initializer for a slab holding objects of the given type
+#define SLAB_INITIALIZER(type) \
+  { (sizeof(type) + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1), NULL, 0 }
+
+// Take an object from the slab, growing it if needed. Returns NULL when out of memory.
+void *slabAlloc(Slab *slab);
+
+// Return an object to the slab it came from
+void slabFree(Slab *slab, void *object);
+
+// Take a POOL_BUFFER_SIZE buffer from this thread's pool. Contents are undefined.
+char *bufferAcquire(void);
+
+// Return a buffer to this thread's pool
+void bufferRelease(char *buffer);
+
+#endif // POOL_H
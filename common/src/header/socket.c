@@ -0,0 +1,194 @@
+// socket.c - Functions for handling plain TCP sockets (non-SSL/HTTPS)
+#define _GNU_SOURCE
+#include "socket.h"
+
+#include <stdio.h>        // For printf, perror
+#include <stdlib.h>       // For exit
+#include <string.h>       // For memset, strlen
+#include <errno.h>        // For errno, EAGAIN, EINTR
+#include <sys/socket.h>   // For socket functions
+#include <sys/types.h>    // For data types
+#include <sys/stat.h>     // For lstat, S_ISSOCK
+#include <sys/un.h>       // For sockaddr_un
+#include <netinet/in.h>   // For sockaddr_in
+#include <unistd.h>       // For close, unlink
+
+#define BACKLOG 10        // Initial pending connection queue; the servers resize it from their settings
+
+// Create and return a new TCP server socket bound to the specified port.
+int rawNewServerSocket(int port) {
+  // Create a new TCP socket (IPv4)
+  int serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+  if (serverSocket < 0) {
+    perror("Error creating socket");
+    return -1;
+  }
+
+  // Set socket options to allow reuse of address and port
+  int opt = 1;
+  if (setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+    perror("Error setting socket options");
+    close(serverSocket);
+    return -1;
+  }
+
+  // Define the server address structure
+  struct sockaddr_in serverAddr;
+  memset(&serverAddr, 0, sizeof(serverAddr));         // Zero out the structure
+  serverAddr.sin_family = AF_INET;                    // Use IPv4
+  serverAddr.sin_addr.s_addr = INADDR_ANY;            // Bind to any interface
+  serverAddr.sin_port = htons(port);                  // Convert port to network byte order
+
+  // Bind the socket to the address and port
+  if (bind(serverSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) {
+    perror("Error binding socket");
+    close(serverSocket);
+    return -1;
+  }
+
+  // Mark the socket as passive, ready to accept incoming connections
+  if (listen(serverSocket, BACKLOG) < 0) {
+    perror("Error listening on socket");
+    close(serverSocket);
+    return -1;
+  }
+
+  // Return the server socket file descriptor
+  return serverSocket;
+}
+
+// Create and return a new Unix domain stream server socket bound to path.
+// A socket file left behind by an earlier run is replaced; any other file is not.
+int rawNewUnixServerSocket(const char *path) {
+  struct sockaddr_un serverAddr;
+  memset(&serverAddr, 0, sizeof(serverAddr));
+  serverAddr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(serverAddr.sun_path)) {
+    fprintf(stderr, "[!] Unix socket path too long: %s\n", path);
+    return -1;
+  }
+  strcpy(serverAddr.sun_path, path);
+
+  struct stat existing;
+  if (lstat(path, &existing) == 0) {
+    if (!S_ISSOCK(existing.st_mode)) {
+      fprintf(stderr, "[!] %s exists and is not a socket\n", path);
+      return -1;
+    }
+    unlink(path);
+  }
+
+  int serverSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (serverSocket < 0) {
+    perror("Error creating Unix socket");
+    return -1;
+  }
+
+  if (bind(serverSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) < 0) {
+    perror("Error binding Unix socket");
+    close(serverSocket);
+    return -1;
+  }
+
+  if (listen(serverSocket, BACKLOG) < 0) {
+    perror("Error listening on Unix socket");
+    close(serverSocket);
+    return -1;
+  }
+
+  return serverSocket;
+}
+
+// Look up the user id of the process on the other end of a Unix domain socket.
+// Returns 0 on success, or -1 if the kernel has no credentials for it.
+int rawPeerUid(int clientSocket, uid_t *uid) {
+  struct ucred credentials;
+  socklen_t length = sizeof(credentials);
+  if (getsockopt(clientSocket, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0) {
+    perror("Error reading peer credentials");
+    return -1;
+  }
+
+  *uid = credentials.uid;
+  return 0;
+}
+
+// Accept a new TCP client connection and return the client socket file descriptor.
+int rawAcceptClientConnection(int serverSocket) {
+  // Define structure to hold client address information
+  struct sockaddr_in clientAddr;
+  socklen_t addrLen = sizeof(clientAddr);
+
+  // Accept the incoming connection
+  int clientSocket = accept(serverSocket, (struct sockaddr *)&clientAddr, &addrLen);
+  if (clientSocket < 0) {
+    perror("Error accepting client connection");
+    return -1;
+  }
+
+  // Return the client socket file descriptor
+  return clientSocket;
+}
+
+// Accept a pending TCP client connection as a non-blocking socket.
+// Returns the client socket, SOCKET_WOULD_BLOCK if none is pending, or -1 on failure.
+int rawAcceptNonBlocking(int serverSocket) {
+  int clientSocket;
+  do {
+    clientSocket = accept4(serverSocket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  } while (clientSocket < 0 && errno == EINTR);
+
+  if (clientSocket < 0) {
+    // ECONNABORTED: the client gave up while queued, so just move on
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED) return SOCKET_WOULD_BLOCK;
+    perror("Error accepting client connection");
+    return -1;
+  }
+
+  return clientSocket;
+}
+
+// Receive data from the specified TCP client socket and store it in the buffer.
+// The buffer is not cleared; only the returned number of bytes is valid.
+// Returns the number of bytes received, SOCKET_WOULD_BLOCK if a non-blocking
+// socket has nothing to read, or -1 on failure.
+int rawReceiveData(int clientSocket, char *buffer, size_t receiveSize) {
+  // Receive data over TCP connection
+  int bytesReceived = recv(clientSocket, buffer, receiveSize, 0);
+  if (bytesReceived < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return SOCKET_WOULD_BLOCK;
+    perror("Error receiving data");
+    return -1;
+  }
+
+  // Return number of bytes successfully received
+  return bytesReceived;
+}
+
+// Send a string of data through the specified TCP client socket.
+// Returns the number of bytes sent, or -1 on failure.
+int rawSendData(int clientSocket, const char *data) {
+  return rawSendBuffer(clientSocket, data, strlen(data));
+}
+
+// Send a buffer of the given length through the specified TCP client socket.
+// Returns the number of bytes sent, SOCKET_WOULD_BLOCK if a non-blocking
+// socket's send buffer is full, or -1 on failure.
+int rawSendBuffer(int clientSocket, const char *data, size_t length) {
+  // Send the data over TCP connection
+  int bytesSent = send(clientSocket, data, length, MSG_NOSIGNAL);
+  if (bytesSent < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return SOCKET_WOULD_BLOCK;
+    perror("Error sending data");
+    return -1;
+  }
+
+  // Return number of bytes successfully sent
+  return bytesSent;
+}
+
+// Close a TCP socket (server or client).
+void rawCloseSocket(int sock) {
+  close(sock);
+}
+
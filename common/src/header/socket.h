@@ -0,0 +1,41 @@
+// socket.h - Plain TCP socket handling simplification
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifndef SOCKET_WOULD_BLOCK
+#define SOCKET_WOULD_BLOCK -2   // Non-blocking operation cannot make progress yet
+#endif
+
+// Create and return a new TCP server socket bound to the specified port
+int rawNewServerSocket(int port);
+
+// Create and return a new Unix domain stream server socket bound to path
+int rawNewUnixServerSocket(const char *path);
+
+// Get the user id of the process connected to a Unix domain socket. Returns 0 on success.
+int rawPeerUid(int clientSocket, uid_t *uid);
+
+// Accept a new TCP client connection
+int rawAcceptClientConnection(int serverSocket);
+
+// Accept a pending TCP client connection as a non-blocking socket.
+// Returns SOCKET_WOULD_BLOCK once no more connections are pending.
+int rawAcceptNonBlocking(int serverSocket);
+
+// Receive data from a TCP client socket into the buffer
+int rawReceiveData(int clientSocket, char *buffer, size_t receiveSize);
+
+// Send data through a TCP client socket
+int rawSendData(int clientSocket, const char *data);
+
+// Send a buffer of known length through a TCP client socket
+int rawSendBuffer(int clientSocket, const char *data, size_t length);
+
+// Close a TCP socket
+void rawCloseSocket(int sock);
+
+#endif // SOCKET_H
+
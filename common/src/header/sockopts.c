@@ -0,0 +1,115 @@
+// sockopts.c - Implementation of the shared socket options
+#include "sockopts.h"
+
+#include <stdio.h>          // For printf, fprintf, perror, fopen
+#include <sys/socket.h>     // For setsockopt, getsockopt, listen, SOMAXCONN
+#include <netinet/in.h>     // For IPPROTO_TCP
+#include <netinet/tcp.h>    // For TCP_NODELAY, TCP_CORK, TCP_DEFER_ACCEPT, TCP_FASTOPEN
+
+#include "config.h"         // For configGetInt
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+
+void socketOptionsLoad(SocketOptions *options) {
+  options->backlog = (int)configGetInt("listen_backlog", SOMAXCONN);
+  options->deferAcceptSeconds = (int)configGetInt("tcp_defer_accept_s", 5);
+  options->fastOpenQueue = (int)configGetInt("tcp_fastopen", 0);
+  options->noDelay = configGetInt("tcp_nodelay", 1) != 0;
+  options->cork = configGetInt("tcp_cork", 1) != 0;
+  options->busyPollMicros = (int)configGetInt("busy_poll_us", 0);
+  options->sendBuffer = (int)configGetInt("send_buffer", 0);
+  options->receiveBuffer = (int)configGetInt("receive_buffer", 0);
+}
+
+// Set an integer option, reporting failures by option name
+static int setOption(int fd, int level, int name, int value, const char *label) {
+  if (setsockopt(fd, level, name, &value, sizeof(value)) < 0) {
+    fprintf(stderr, "[!] Could not set %s: ", label);
+    perror(NULL);
+    return -1;
+  }
+  return 0;
+}
+
+// Read back an integer option, or -1 if the kernel won't say
+static int getOption(int fd, int level, int name) {
+  int value;
+  socklen_t length = sizeof(value);
+  if (getsockopt(fd, level, name, &value, &length) < 0) return -1;
+  return value;
+}
+
+// Read a single integer from a sysctl file, or fallback if it can't be read
+static int readSysctl(const char *path, int fallback) {
+  FILE *file = fopen(path, "r");
+  if (!file) return fallback;
+  int value;
+  if (fscanf(file, "%d", &value) != 1) value = fallback;
+  fclose(file);
+  return value;
+}
+
+int socketOptionsApplyListener(int fd, const SocketOptions *options) {
+  int tcp = getOption(fd, SOL_SOCKET, SO_DOMAIN) != AF_UNIX;
+  int status = 0;
+
+  // Buffer sizes and busy polling are inherited by accepted sockets; the receive
+  // buffer also decides the window scale offered in the SYN-ACK
+  if (options->sendBuffer > 0) {
+    status |= setOption(fd, SOL_SOCKET, SO_SNDBUF, options->sendBuffer, "send buffer");
+  }
+  if (options->receiveBuffer > 0) {
+    status |= setOption(fd, SOL_SOCKET, SO_RCVBUF, options->receiveBuffer, "receive buffer");
+  }
+  if (options->busyPollMicros > 0) {
+    status |= setOption(fd, SOL_SOCKET, SO_BUSY_POLL, options->busyPollMicros, "busy poll");
+  }
+
+  if (tcp) {
+    status |= setOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, options->deferAcceptSeconds, "defer accept");
+    if (options->fastOpenQueue > 0) {
+      status |= setOption(fd, IPPROTO_TCP, TCP_FASTOPEN, options->fastOpenQueue, "fast open");
+    }
+  }
+
+  // Listening again only changes the queue length, so this also resizes inherited sockets
+  if (listen(fd, options->backlog) < 0) {
+    perror("Error setting listen backlog");
+    status = -1;
+  }
+
+  int somaxconn = readSysctl("/proc/sys/net/core/somaxconn", SOMAXCONN);
+  int backlog = options->backlog < somaxconn ? options->backlog : somaxconn;
+  if (!tcp) {
+    printf("[*] Unix socket options: backlog %d\n", backlog);
+    return status;
+  }
+
+  // Report what the kernel took: buffer sizes are doubled and deferral is rounded
+  // to whole SYN-ACK retransmits. Servers only use fast open if the sysctl allows it.
+  int fastOpen = options->fastOpenQueue > 0 ? getOption(fd, IPPROTO_TCP, TCP_FASTOPEN) : 0;
+  int fastOpenServer = (readSysctl("/proc/sys/net/ipv4/tcp_fastopen", 0) & 2) != 0;
+  printf("[*] Socket options: backlog %d, defer accept %ds, fast open %d%s, nodelay %s, cork %s, "
+         "busy poll %dus, send buffer %d, receive buffer %d\n",
+         backlog, getOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT),
+         fastOpen, fastOpen > 0 && !fastOpenServer ? " (disabled by net.ipv4.tcp_fastopen)" : "",
+         options->noDelay ? "on" : "off", options->cork ? "on" : "off",
+         getOption(fd, SOL_SOCKET, SO_BUSY_POLL),
+         getOption(fd, SOL_SOCKET, SO_SNDBUF), getOption(fd, SOL_SOCKET, SO_RCVBUF));
+  return status;
+}
+
+void socketOptionsApplyClient(int fd, const SocketOptions *options) {
+  if (options->noDelay) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+}
+
+void socketCork(int fd, const SocketOptions *options, int on) {
+  if (options->cork) {
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+  }
+}
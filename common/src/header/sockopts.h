@@ -0,0 +1,33 @@
+// sockopts.h - Tunable socket options shared by both servers
+#ifndef SOCKOPTS_H
+#define SOCKOPTS_H
+
+// Settings read from the configuration file. Zero leaves the kernel default
+// in place, except where noted.
+typedef struct {
+  int backlog;              // listen() queue length (capped by net.core.somaxconn)
+  int deferAcceptSeconds;   // TCP_DEFER_ACCEPT: only wake the server once a client has sent data
+  int fastOpenQueue;        // TCP_FASTOPEN: handshakes that may carry request data (0 = off)
+  int noDelay;              // TCP_NODELAY on accepted connections: send small writes at once
+  int cork;                 // TCP_CORK while a response is queued, so its parts share segments
+  int busyPollMicros;       // SO_BUSY_POLL: spin on the device queue before sleeping in a read
+  int sendBuffer;           // SO_SNDBUF in bytes
+  int receiveBuffer;        // SO_RCVBUF in bytes
+} SocketOptions;
+
+// Read the options from the loaded configuration, filling in defaults
+void socketOptionsLoad(SocketOptions *options);
+
+// Apply the listener options to a listening socket, which may have been inherited
+// during an upgrade, and print what the kernel actually took. Options that only
+// make sense for TCP are skipped on Unix sockets. Returns 0 on success.
+int socketOptionsApplyListener(int fd, const SocketOptions *options);
+
+// Apply the per-connection options to an accepted TCP socket
+void socketOptionsApplyClient(int fd, const SocketOptions *options);
+
+// Hold back partial segments while a response is being queued (on = 1), then
+// send everything that is left (on = 0). Does nothing if corking is disabled.
+void socketCork(int fd, const SocketOptions *options, int on);
+
+#endif // SOCKOPTS_H
@@ -11,7 +11,22 @@
 #include <openssl/ssl.h>  // For SSL/TLS support
 #include <openssl/err.h>  // For SSL error reporting
 
-#define BACKLOG 10        // Number of pending connections queue will hold
+#define BACKLOG 10        // Initial pending connection queue; the servers resize it from their settings
+
+// Pick the application protocol from the client's ALPN list, taking the first of
+// ours (arg, in wire format) that the client also offers.
+static int selectALPNProtocol(SSL *ssl, const unsigned char **out, unsigned char *outLen,
+                              const unsigned char *in, unsigned int inLen, void *arg) {
+  (void)ssl;
+  const unsigned char *protocols = arg;
+
+  if (SSL_select_next_proto((unsigned char **)out, outLen, protocols, (unsigned int)strlen((const char *)protocols),
+                            in, inLen) != OPENSSL_NPN_NEGOTIATED) {
+    return SSL_TLSEXT_ERR_NOACK;  // No overlap: continue without ALPN
+  }
+
+  return SSL_TLSEXT_ERR_OK;
+}
 
 // Initializes the OpenSSL library and creates a new SSL context
 // Returns a pointer to the initialized SSL_CTX structure
@@ -29,28 +44,49 @@ SSL_CTX *initTLSContext() {
     exit(EXIT_FAILURE);
   }
 
+  // Non-blocking writes may complete partially and be retried from a different buffer offset.
+  // Record buffers are freed between reads and writes, so an idle connection holds none.
+  SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                   SSL_MODE_RELEASE_BUFFERS);
+
   return ctx;
 }
 
+// Offer application protocols during the handshake. protocols is in ALPN wire
+// format (each name prefixed by its length) and must outlive the context.
+void SSLOfferProtocols(SSL_CTX *ctx, const char *protocols) {
+  SSL_CTX_set_alpn_select_cb(ctx, selectALPNProtocol, (void *)protocols);
+}
+
 // Loads the certificate and private key into the SSL context.
 void loadCertificates(SSL_CTX *ctx, const char *certFile, const char *keyFile) {
+  if (tryLoadCertificates(ctx, certFile, keyFile) != 0) {
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Loads the certificate and private key into the SSL context.
+// Returns 0 on success or -1 on failure, leaving the decision to exit to the caller.
+int tryLoadCertificates(SSL_CTX *ctx, const char *certFile, const char *keyFile) {
   // Load server certificate into SSL context
   if (SSL_CTX_use_certificate_file(ctx, certFile, SSL_FILETYPE_PEM) <= 0) {
     ERR_print_errors_fp(stderr);
-    exit(EXIT_FAILURE);
+    return -1;
   }
 
   // Load private key into SSL context
   if (SSL_CTX_use_PrivateKey_file(ctx, keyFile, SSL_FILETYPE_PEM) <= 0) {
     ERR_print_errors_fp(stderr);
-    exit(EXIT_FAILURE);
+    return -1;
   }
 
   // Verify that the private key matches the certificate
   if (!SSL_CTX_check_private_key(ctx)) {
     fprintf(stderr, "Private key does not match the certificate\n");
-    exit(EXIT_FAILURE);
+    return -1;
   }
+
+  return 0;
 }
 
 // Create and return a new TCP server socket bound to the specified port.
@@ -124,17 +160,58 @@ SSL *acceptClientConnection(int serverSocket, SSL_CTX *ctx) {
   return ssl;
 }
 
-// Receive data from the specified TLS session and store it in the buffer.
-// Returns the number of bytes received, or -1 on failure.
-int SSLReceiveData(SSL *ssl, char *buffer, size_t receiveSize) {
-  // Clear the buffer before receiving data
-  memset(buffer, 0, receiveSize);
+// Create a new SSL object for an accepted non-blocking client socket.
+// The handshake is driven by SSLContinueHandshake as the socket becomes ready.
+SSL *newServerSession(SSL_CTX *ctx, int clientSocket) {
+  SSL *ssl = SSL_new(ctx);
+  if (!ssl) {
+    ERR_print_errors_fp(stderr);
+    return NULL;
+  }
+
+  SSL_set_fd(ssl, clientSocket);  // Bind SSL to the client's socket
+  SSL_set_accept_state(ssl);
+  return ssl;
+}
 
+// Map an SSL_read/SSL_write/SSL_do_handshake result onto the socket return codes
+static int SSLResult(SSL *ssl, int result, int *wantWrite) {
+  switch (SSL_get_error(ssl, result)) {
+    case SSL_ERROR_WANT_READ:
+      if (wantWrite) *wantWrite = 0;
+      return SOCKET_WOULD_BLOCK;
+    case SSL_ERROR_WANT_WRITE:
+      if (wantWrite) *wantWrite = 1;
+      return SOCKET_WOULD_BLOCK;
+    case SSL_ERROR_ZERO_RETURN:
+      return 0;  // Peer sent close_notify
+    default:
+      ERR_print_errors_fp(stderr);
+      ERR_clear_error();
+      return -1;
+  }
+}
+
+// Advance the TLS handshake on a non-blocking socket. Returns 1 once complete,
+// SOCKET_WOULD_BLOCK while waiting (wantWrite says in which direction), or -1 on failure.
+int SSLContinueHandshake(SSL *ssl, int *wantWrite) {
+  int result = SSL_do_handshake(ssl);
+  if (result == 1) return 1;
+
+  int status = SSLResult(ssl, result, wantWrite);
+  return status == SOCKET_WOULD_BLOCK ? status : -1;
+}
+
+// Receive data from the specified TLS session and store it in the buffer.
+// The buffer is not cleared; only the returned number of bytes is valid.
+// Returns the number of bytes received, 0 once the peer has closed the session,
+// SOCKET_WOULD_BLOCK if a non-blocking socket has no complete record yet (wantWrite
+// says in which direction it waits), or -1 on failure.
+int SSLReceiveData(SSL *ssl, char *buffer, size_t receiveSize, int *wantWrite) {
   // Receive data over TLS connection
   int bytesReceived = SSL_read(ssl, buffer, receiveSize);
-  if (bytesReceived < 0) {
-    ERR_print_errors_fp(stderr);
-    return -1;
+  if (bytesReceived <= 0) {
+    return SSLResult(ssl, bytesReceived, wantWrite);
   }
 
   // Return number of bytes successfully received
@@ -143,17 +220,30 @@ int SSLReceiveData(SSL *ssl, char *buffer, size_t receiveSize) {
 
 // Send a string of data through the specified TLS session.
 int SSLSendData(SSL *ssl, const char *data) {
-  // Get the length of the data to be sent
-  int dataLen = strlen(data);
+  return SSLSendBuffer(ssl, data, strlen(data));
+}
 
+// Send a buffer of the given length through the specified TLS session.
+// Returns the number of bytes sent, SOCKET_WOULD_BLOCK if a non-blocking
+// socket cannot take more yet, or -1 on failure.
+int SSLSendBuffer(SSL *ssl, const char *data, size_t length) {
   // Send the data over TLS connection
-  int bytesSent = SSL_write(ssl, data, dataLen);
-  if (bytesSent < 0) {
-    ERR_print_errors_fp(stderr);
-    return -1;
+  int bytesSent = SSL_write(ssl, data, (int)length);
+  if (bytesSent <= 0) {
+    int status = SSLResult(ssl, bytesSent, NULL);
+    return status == SOCKET_WOULD_BLOCK ? status : -1;
   }
 
   // Return number of bytes successfully sent
   return bytesSent;
 }
 
+// Check whether ALPN selected the named protocol for this TLS session.
+int SSLNegotiated(SSL *ssl, const char *name) {
+  const unsigned char *protocol = NULL;
+  unsigned int protocolLen = 0;
+
+  SSL_get0_alpn_selected(ssl, &protocol, &protocolLen);
+  return protocolLen == strlen(name) && memcmp(protocol, name, protocolLen) == 0;
+}
+
@@ -0,0 +1,52 @@
+// sslsocket.h - HTTPS (TLS) socket handling simplification
+#ifndef SSLSOCKET_H
+#define SSLSOCKET_H
+
+#include <stddef.h>
+#include <openssl/ssl.h>
+
+#ifndef SOCKET_WOULD_BLOCK
+#define SOCKET_WOULD_BLOCK -2   // Non-blocking operation cannot make progress yet
+#endif
+
+// Create and return a new TCP server socket bound to the specified port
+int newServerSocket(int port);
+
+// Initialize a new SSL context for the TLS server
+SSL_CTX *initTLSContext(void);
+
+// Offer application protocols via ALPN. protocols is in wire format, each name
+// prefixed by its length (e.g. "\x02h2\x08http/1.1"), and must outlive the context.
+void SSLOfferProtocols(SSL_CTX *ctx, const char *protocols);
+
+// Load TLS certificate and private key into the context
+void loadCertificates(SSL_CTX *ctx, const char *certFile, const char *keyFile);
+
+// Load TLS certificate and private key, returning -1 instead of exiting on failure
+int tryLoadCertificates(SSL_CTX *ctx, const char *certFile, const char *keyFile);
+
+// Accept a new TLS client connection and return an SSL session object
+SSL *acceptClientConnection(int serverSocket, SSL_CTX *ctx);
+
+// Create a TLS session for an accepted non-blocking client socket
+SSL *newServerSession(SSL_CTX *ctx, int clientSocket);
+
+// Continue a non-blocking TLS handshake. Returns 1 once complete,
+// SOCKET_WOULD_BLOCK while it waits on the peer, or -1 on failure.
+int SSLContinueHandshake(SSL *ssl, int *wantWrite);
+
+// Receive data from a TLS session into the buffer. When it would block, wantWrite
+// (if given) says whether the session is waiting to write, such as a KeyUpdate reply.
+int SSLReceiveData(SSL *ssl, char *buffer, size_t receiveSize, int *wantWrite);
+
+// Send data through a TLS session
+int SSLSendData(SSL *ssl, const char *data);
+
+// Send a buffer of known length (which may contain NUL bytes) through a TLS session
+int SSLSendBuffer(SSL *ssl, const char *data, size_t length);
+
+// Return nonzero if the client negotiated the named protocol (e.g. "h2") via ALPN
+int SSLNegotiated(SSL *ssl, const char *name);
+
+#endif // SSLSOCKET_H
+
@@ -0,0 +1,158 @@
+// threadpool.c - Implementation of the worker thread pool
+#define _GNU_SOURCE
+#include "threadpool.h"
+
+#include <stdio.h>          // For perror, snprintf
+#include <stdlib.h>         // For calloc, free
+#include <stdint.h>         // For uint64_t
+#include <pthread.h>        // For threads, mutexes and condition variables
+#include <unistd.h>         // For read, write, close
+#include <sys/eventfd.h>    // For eventfd
+
+// FIFO of tasks linked through ThreadTask.next
+typedef struct {
+  ThreadTask *head;
+  ThreadTask *tail;
+} TaskQueue;
+
+struct ThreadPool {
+  char name[16];
+  pthread_mutex_t lock;
+  pthread_cond_t wake;       // Signalled when a task is queued
+  TaskQueue queued;          // Waiting for a worker
+  TaskQueue finished;        // Run, waiting for the loop to complete them
+  size_t queuedCount;
+  size_t maxQueued;
+  size_t pending;            // Queued or running; only touched by the loop thread
+  int eventFD;               // Counter the workers bump after finishing a task
+  EventHandler handler;
+};
+
+static void pushTask(TaskQueue *queue, ThreadTask *task) {
+  task->next = NULL;
+  if (queue->tail) queue->tail->next = task;
+  else queue->head = task;
+  queue->tail = task;
+}
+
+static ThreadTask *popTask(TaskQueue *queue) {
+  ThreadTask *task = queue->head;
+  if (task) {
+    queue->head = task->next;
+    if (!queue->head) queue->tail = NULL;
+  }
+  return task;
+}
+
+static void *workerMain(void *argument) {
+  ThreadPool *pool = argument;
+
+  while (1) {
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->queued.head) pthread_cond_wait(&pool->wake, &pool->lock);
+
+    // Batchable tasks take their queued neighbours of the same kind along
+    ThreadTask *batch[THREAD_BATCH_MAX];
+    size_t count = 0;
+    do {
+      batch[count++] = popTask(&pool->queued);
+      pool->queuedCount--;
+    } while (batch[0]->runBatch && count < THREAD_BATCH_MAX &&
+             pool->queued.head && pool->queued.head->runBatch == batch[0]->runBatch);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (batch[0]->runBatch) batch[0]->runBatch(batch, count);
+    else batch[0]->run(batch[0]);
+
+    // Hand the tasks back and wake the loop
+    pthread_mutex_lock(&pool->lock);
+    for (size_t i = 0; i < count; i++) pushTask(&pool->finished, batch[i]);
+    pthread_mutex_unlock(&pool->lock);
+
+    uint64_t one = 1;
+    (void)write(pool->eventFD, &one, sizeof(one));
+  }
+
+  return NULL;
+}
+
+// Run the completion callbacks for every finished task, on the loop thread
+static void onTasksFinished(EventLoop *loop, EventHandler *handler, uint32_t events) {
+  (void)loop;
+  (void)events;
+  ThreadPool *pool = handler->data;
+
+  uint64_t count;
+  (void)read(pool->eventFD, &count, sizeof(count));
+
+  pthread_mutex_lock(&pool->lock);
+  TaskQueue finished = pool->finished;
+  pool->finished.head = NULL;
+  pool->finished.tail = NULL;
+  pthread_mutex_unlock(&pool->lock);
+
+  ThreadTask *task;
+  while ((task = popTask(&finished))) {
+    pool->pending--;
+    task->complete(task);
+  }
+}
+
+ThreadPool *threadPoolNew(const char *name, int threads, size_t maxQueued) {
+  ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+  if (!pool) return NULL;
+
+  snprintf(pool->name, sizeof(pool->name), "%s", name);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pool->maxQueued = maxQueued;
+
+  pool->eventFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (pool->eventFD < 0) {
+    perror("Error creating thread pool eventfd");
+    free(pool);
+    return NULL;
+  }
+
+  // Workers live as long as the process
+  for (int i = 0; i < threads; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, workerMain, pool) != 0) {
+      perror("Error starting worker thread");
+      if (i > 0) return pool;  // Run with the threads that did start
+      close(pool->eventFD);
+      free(pool);
+      return NULL;
+    }
+
+    char threadName[24];  // Thread names are limited to 15 characters
+    snprintf(threadName, sizeof(threadName), "%.8s-%d", pool->name, i % 1000);
+    pthread_setname_np(thread, threadName);
+    pthread_detach(thread);
+  }
+
+  return pool;
+}
+
+int threadPoolAttach(ThreadPool *pool, EventLoop *loop) {
+  return eventLoopAdd(loop, &pool->handler, pool->eventFD, EPOLLIN, onTasksFinished, pool);
+}
+
+int threadPoolSubmit(ThreadPool *pool, ThreadTask *task) {
+  pthread_mutex_lock(&pool->lock);
+  if (pool->queuedCount >= pool->maxQueued) {
+    pthread_mutex_unlock(&pool->lock);
+    return -1;
+  }
+  pushTask(&pool->queued, task);
+  pool->queuedCount++;
+  pthread_cond_signal(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  pool->pending++;
+  return 0;
+}
+
+size_t threadPoolPending(ThreadPool *pool) {
+  return pool->pending;
+}
@@ -0,0 +1,38 @@
+// threadpool.h - Worker threads for blocking work, with completions delivered to the event loop
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+
+#include "eventloop.h"
+
+#define THREAD_BATCH_MAX 16  // Most tasks handed to one runBatch call
+
+typedef struct ThreadPool ThreadPool;
+typedef struct ThreadTask ThreadTask;
+
+// A unit of work, embedded in a larger structure that carries its inputs and results.
+// run executes on a worker thread; complete runs afterwards on the event loop thread.
+// Tasks that set runBatch instead are taken off the queue together with the queued
+// tasks right behind them that share the same runBatch, and run in one call.
+struct ThreadTask {
+  void (*run)(ThreadTask *task);
+  void (*runBatch)(ThreadTask **tasks, size_t count);
+  void (*complete)(ThreadTask *task);
+  ThreadTask *next;         // Queue link, owned by the pool
+};
+
+// Start a pool with the given number of threads that holds at most maxQueued
+// tasks waiting for a thread. Returns NULL on failure.
+ThreadPool *threadPoolNew(const char *name, int threads, size_t maxQueued);
+
+// Deliver completions through the event loop. Must be called before tasks are submitted.
+int threadPoolAttach(ThreadPool *pool, EventLoop *loop);
+
+// Queue a task. Returns 0 on success or -1 if the queue is full (the task is not run).
+int threadPoolSubmit(ThreadPool *pool, ThreadTask *task);
+
+// Number of tasks queued or running
+size_t threadPoolPending(ThreadPool *pool);
+
+#endif // THREADPOOL_H
@@ -0,0 +1,197 @@
+// timer.c - Implementation of the hierarchical timer wheel
+#include "timer.h"
+
+#include <limits.h>   // For INT_MAX
+
+#define SLOT_MASK ((uint64_t)TIMER_WHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(level) ((level) * TIMER_WHEEL_BITS)
+#define WHEEL_SPAN ((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+// Rotate a slot bitmap right so that bit 0 corresponds to slot start
+static uint64_t rotateSlots(uint64_t bits, unsigned start) {
+  return start ? (bits >> start) | (bits << (TIMER_WHEEL_SLOTS - start)) : bits;
+}
+
+// Index of a list head within the wheel, or -1 if the pointer is a timer
+static long headIndex(TimerWheel *wheel, Timer *node) {
+  Timer *first = &wheel->slots[0][0];
+  if (node < first || node >= first + TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS) return -1;
+  return node - first;
+}
+
+static void unlinkTimer(TimerWheel *wheel, Timer *timer) {
+  Timer *prev = timer->prev;
+  Timer *next = timer->next;
+  prev->next = next;
+  next->prev = prev;
+  timer->prev = NULL;
+  timer->next = NULL;
+
+  // If only the list head is left, the slot is now empty
+  if (prev == next) {
+    long index = headIndex(wheel, prev);
+    if (index >= 0) {
+      wheel->occupied[index / TIMER_WHEEL_SLOTS] &= ~((uint64_t)1 << (index % TIMER_WHEEL_SLOTS));
+    }
+  }
+}
+
+// Put a timer in the slot matching its distance from the current tick
+static void placeTimer(TimerWheel *wheel, Timer *timer) {
+  uint64_t expires = timer->expires;
+  uint64_t delta = expires > wheel->now ? expires - wheel->now : 0;
+  int level = 0;
+  uint64_t slot;
+
+  if (delta == 0) {
+    slot = wheel->now & SLOT_MASK;  // Overdue: fires on the tick being processed
+  } else {
+    // Timers beyond the wheel's span park in the top level and are re-placed later
+    if (delta >= WHEEL_SPAN) expires = wheel->now + WHEEL_SPAN - 1;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+           delta >= ((uint64_t)1 << LEVEL_SHIFT(level + 1))) {
+      level++;
+    }
+    slot = (expires >> LEVEL_SHIFT(level)) & SLOT_MASK;
+  }
+
+  Timer *head = &wheel->slots[level][slot];
+  timer->next = head->next;
+  timer->prev = head;
+  head->next->prev = timer;
+  head->next = timer;
+  wheel->occupied[level] |= (uint64_t)1 << slot;
+}
+
+// Move every timer in a higher-level slot down to where it now belongs
+static void cascadeSlot(TimerWheel *wheel, int level, uint64_t slot) {
+  Timer *head = &wheel->slots[level][slot];
+  Timer *timer = head->next;
+
+  head->next = head;
+  head->prev = head;
+  wheel->occupied[level] &= ~((uint64_t)1 << slot);
+
+  while (timer != head) {
+    Timer *next = timer->next;
+    placeTimer(wheel, timer);
+    timer = next;
+  }
+}
+
+// Process the current tick: cascade higher levels on wrap-around, then fire level 0
+static size_t runTick(TimerWheel *wheel) {
+  uint64_t index = wheel->now & SLOT_MASK;
+  for (int level = 1; index == 0 && level < TIMER_WHEEL_LEVELS; level++) {
+    index = (wheel->now >> LEVEL_SHIFT(level)) & SLOT_MASK;
+    cascadeSlot(wheel, level, index);
+  }
+
+  size_t fired = 0;
+  Timer *head = &wheel->slots[0][wheel->now & SLOT_MASK];
+
+  // Callbacks may arm or cancel other timers, so re-read the head each time
+  while (head->next != head) {
+    Timer *timer = head->next;
+    unlinkTimer(wheel, timer);
+    wheel->count--;
+    timer->callback(timer);
+    fired++;
+  }
+
+  return fired;
+}
+
+// Next tick at which a timer fires or a higher-level slot must cascade
+static uint64_t nextEventTick(const TimerWheel *wheel) {
+  uint64_t best = UINT64_MAX;
+
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    uint64_t bits = wheel->occupied[level];
+    if (!bits) continue;
+
+    // Slots are visited in order starting just after the current position at this level
+    uint64_t position = wheel->now >> LEVEL_SHIFT(level);
+    uint64_t steps = 1 + (uint64_t)__builtin_ctzll(rotateSlots(bits, (position + 1) & SLOT_MASK));
+    uint64_t tick = (position + steps) << LEVEL_SHIFT(level);
+
+    if (tick < best) best = tick;
+  }
+
+  return best;
+}
+
+void timerWheelInit(TimerWheel *wheel, uint64_t nowMs) {
+  wheel->now = 0;
+  wheel->originMs = nowMs;
+  wheel->count = 0;
+
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    wheel->occupied[level] = 0;
+    for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+      wheel->slots[level][slot].next = &wheel->slots[level][slot];
+      wheel->slots[level][slot].prev = &wheel->slots[level][slot];
+    }
+  }
+}
+
+void timerInit(Timer *timer, void (*callback)(Timer *timer), void *data) {
+  timer->next = NULL;
+  timer->prev = NULL;
+  timer->expires = 0;
+  timer->callback = callback;
+  timer->data = data;
+}
+
+void timerArm(TimerWheel *wheel, Timer *timer, uint64_t delayMs) {
+  if (timer->prev) {
+    unlinkTimer(wheel, timer);
+    wheel->count--;
+  }
+
+  // Round up, plus one tick for the part of the current tick already elapsed. This also
+  // keeps a timer from landing on the tick being processed.
+  timer->expires = wheel->now + (delayMs + TIMER_TICK_MS - 1) / TIMER_TICK_MS + 1;
+
+  placeTimer(wheel, timer);
+  wheel->count++;
+}
+
+void timerCancel(TimerWheel *wheel, Timer *timer) {
+  if (!timer->prev) return;
+  unlinkTimer(wheel, timer);
+  wheel->count--;
+}
+
+int timerIsArmed(const Timer *timer) {
+  return timer->prev != NULL;
+}
+
+size_t timerWheelAdvance(TimerWheel *wheel, uint64_t nowMs) {
+  if (nowMs < wheel->originMs) return 0;
+  uint64_t target = (nowMs - wheel->originMs) / TIMER_TICK_MS;
+  size_t fired = 0;
+
+  // Jump straight between ticks that have work instead of stepping through empty ones
+  while (wheel->now < target) {
+    uint64_t next = wheel->count ? nextEventTick(wheel) : UINT64_MAX;
+    if (next > target) {
+      wheel->now = target;
+      break;
+    }
+
+    wheel->now = next;
+    fired += runTick(wheel);
+  }
+
+  return fired;
+}
+
+int timerWheelNextTimeout(const TimerWheel *wheel, uint64_t nowMs) {
+  if (wheel->count == 0) return -1;
+
+  uint64_t dueMs = wheel->originMs + nextEventTick(wheel) * TIMER_TICK_MS;
+  if (dueMs <= nowMs) return 0;
+  if (dueMs - nowMs > INT_MAX) return INT_MAX;
+  return (int)(dueMs - nowMs);
+}
@@ -0,0 +1,54 @@
+// timer.h - Hierarchical timer wheel for connection deadlines
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_TICK_MS 10          // Expirations are coalesced to this granularity
+#define TIMER_WHEEL_BITS 6        // 64 slots per level
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4      // 64^4 ticks, about 46 hours at 10 ms per tick
+
+// An intrusive timer, embedded in the object it belongs to. Arming, re-arming and
+// cancelling are O(1); a timer is armed while prev is non-NULL.
+typedef struct Timer {
+  struct Timer *next;
+  struct Timer *prev;
+  uint64_t expires;                      // Tick at which the timer fires
+  void (*callback)(struct Timer *timer); // Called once when the timer expires
+  void *data;                            // Owner of the timer
+} Timer;
+
+typedef struct {
+  uint64_t now;                          // Current tick
+  uint64_t originMs;                     // Clock value of tick 0
+  size_t count;                          // Armed timers
+  uint64_t occupied[TIMER_WHEEL_LEVELS]; // Bit per non-empty slot
+  Timer slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];  // List heads
+} TimerWheel;
+
+// Initialize an empty wheel starting at the given clock value (milliseconds)
+void timerWheelInit(TimerWheel *wheel, uint64_t nowMs);
+
+// Prepare a timer for use with the given callback and owner
+void timerInit(Timer *timer, void (*callback)(Timer *timer), void *data);
+
+// Arm (or re-arm) a timer to fire after delayMs, at most two ticks late
+void timerArm(TimerWheel *wheel, Timer *timer, uint64_t delayMs);
+
+// Disarm a timer. Safe to call on a timer that is not armed.
+void timerCancel(TimerWheel *wheel, Timer *timer);
+
+// Whether the timer is currently armed
+int timerIsArmed(const Timer *timer);
+
+// Advance the wheel to the given clock value, running expired timers.
+// Returns the number of timers that fired.
+size_t timerWheelAdvance(TimerWheel *wheel, uint64_t nowMs);
+
+// Milliseconds until the wheel next has work to do, or -1 if no timers are armed.
+// Empty stretches of the wheel are skipped, so idle timers cause no wakeups.
+int timerWheelNextTimeout(const TimerWheel *wheel, uint64_t nowMs);
+
+#endif // TIMER_H
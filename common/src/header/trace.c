@@ -0,0 +1,93 @@
+// trace.c - Implementation of the slow request recorder
+#include "trace.h"
+
+#include <stdio.h>        // For fprintf, printf, snprintf, vsnprintf
+#include <stdarg.h>       // For va_list
+#include <string.h>       // For memset
+#include <time.h>         // For clock_gettime
+
+#include "metrics.h"      // For metricsRegister
+
+// Only used from the event loop thread
+static uint64_t slowNs;           // Report threshold, or 0 with spans off
+static uint32_t sampleEvery;
+static uint32_t sampleCounter;
+static uint64_t slowRequests;
+static const char *serverName;
+
+static const char *phaseNames[TRACE_PHASES] = { "queue", "handshake", "read", "lookup", "compute", "send" };
+
+static uint64_t nowNs(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static double readSlowRequests(const void *data) {
+  (void)data;
+  return (double)slowRequests;
+}
+
+void traceInit(const char *prefix, uint64_t slowMs, uint32_t every) {
+  serverName = prefix;
+  slowNs = slowMs * 1000000ULL;
+  sampleEvery = every > 0 ? every : 1;
+
+  char name[64];
+  snprintf(name, sizeof(name), "%s_slow_requests_total", prefix);
+  metricsRegister(name, "Sampled requests slower than trace_slow_ms", METRIC_COUNTER, readSlowRequests, NULL);
+
+  if (slowNs) {
+    printf("[*] Timing 1 in %u requests, reporting those over %llu ms\n",
+           sampleEvery, (unsigned long long)slowMs);
+  }
+}
+
+void traceBegin(TraceSpan *span) {
+  span->startNs = 0;
+  if (!slowNs || ++sampleCounter % sampleEvery != 0) return;
+
+  memset(span->phaseUs, 0, sizeof(span->phaseUs));
+  span->detail[0] = '\0';
+  span->startNs = nowNs();
+  span->markNs = span->startNs;
+}
+
+int traceActive(const TraceSpan *span) {
+  return span->startNs != 0;
+}
+
+void traceMark(TraceSpan *span, TracePhase phase) {
+  if (!span->startNs) return;
+  uint64_t now = nowNs();
+  span->phaseUs[phase] += (uint32_t)((now - span->markNs) / 1000);
+  span->markNs = now;
+}
+
+void traceDetail(TraceSpan *span, const char *format, ...) {
+  if (!span->startNs) return;
+  va_list arguments;
+  va_start(arguments, format);
+  vsnprintf(span->detail, sizeof(span->detail), format, arguments);
+  va_end(arguments);
+}
+
+void traceEnd(TraceSpan *span, TracePhase phase, uint64_t id) {
+  if (!span->startNs) return;
+  traceMark(span, phase);
+  uint64_t totalNs = span->markNs - span->startNs;
+  span->startNs = 0;
+  if (totalNs < slowNs) return;
+
+  slowRequests++;
+  char breakdown[256];
+  size_t length = 0;
+  breakdown[0] = '\0';
+  for (int i = 0; i < TRACE_PHASES && length < sizeof(breakdown); i++) {
+    if (span->phaseUs[i] == 0) continue;
+    length += (size_t)snprintf(breakdown + length, sizeof(breakdown) - length, "%s%s %.3f",
+                               length ? ", " : "", phaseNames[i], span->phaseUs[i] / 1000.0);
+  }
+  fprintf(stderr, "[!] Slow %s request %llu (%s): %.3f ms = %s\n", serverName, (unsigned long long)id,
+          span->detail[0] ? span->detail : "-", totalNs / 1e6, breakdown);
+}
@@ -0,0 +1,77 @@
+// trace.h - Static tracepoints and sampled timing of slow requests
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// TRACE_PROBEn(name, ...) marks a point on the request path as a USDT probe in the
+// "noble" provider, e.g. `bpftrace -e 'usdt:./http:noble:send_end { ... }'`. A probe
+// is a single nop until a tracer attaches. Built without <sys/sdt.h> (systemtap's
+// sdt headers) or with -DNOBLE_NO_PROBES, the probes compile to nothing.
+//
+// Probes, each led by the connection id (and stream id, 0 outside HTTP/2):
+//   accept(conn, fd)                      handshake_start(conn)
+//   handshake_end(conn, ok)               request(conn, stream, path or command)
+//   lookup_start(conn, stream, key)       lookup_end(conn, stream, found)
+//   send_start(conn, stream, status)      send_end(conn, stream, bytes)
+// The auth server has no streams or statuses: its send_start carries the reply's length.
+#if defined(__has_include) && !defined(NOBLE_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_HAS_PROBES 1
+#endif
+#endif
+
+#ifdef TRACE_HAS_PROBES
+#define TRACE_PROBE1(name, a) DTRACE_PROBE1(noble, name, a)
+#define TRACE_PROBE2(name, a, b) DTRACE_PROBE2(noble, name, a, b)
+#define TRACE_PROBE3(name, a, b, c) DTRACE_PROBE3(noble, name, a, b, c)
+#else
+#define TRACE_PROBE1(name, a) do { (void)(a); } while (0)
+#define TRACE_PROBE2(name, a, b) do { (void)(a); (void)(b); } while (0)
+#define TRACE_PROBE3(name, a, b, c) do { (void)(a); (void)(b); (void)(c); } while (0)
+#endif
+
+// Where a request's time went
+typedef enum {
+  TRACE_QUEUE,       // Accepted, waiting for service
+  TRACE_HANDSHAKE,   // TLS handshake
+  TRACE_READ,        // Receiving and parsing the request
+  TRACE_LOOKUP,      // File cache, credential check or database
+  TRACE_COMPUTE,     // Password hashing
+  TRACE_SEND,        // Writing the response
+  TRACE_PHASES
+} TracePhase;
+
+#define TRACE_DETAIL_MAX 64
+
+// Timing of one request, kept on its connection. Only sampled requests are timed.
+typedef struct {
+  uint64_t startNs;                   // When the request began, or 0 if it isn't being timed
+  uint64_t markNs;                    // End of the last phase charged
+  uint32_t phaseUs[TRACE_PHASES];     // Time charged to each phase
+  char detail[TRACE_DETAIL_MAX];      // What the request was, for the report
+} TraceSpan;
+
+// Time one request in sampleEvery, and report those that take longer than slowMs
+// (0 turns spans off). Registers <prefix>_slow_requests_total.
+void traceInit(const char *prefix, uint64_t slowMs, uint32_t sampleEvery);
+
+// Start timing a new request, if it is sampled
+void traceBegin(TraceSpan *span);
+
+// Whether the span is timing a request
+int traceActive(const TraceSpan *span);
+
+// Charge the time since the previous mark to phase
+void traceMark(TraceSpan *span, TracePhase phase);
+
+// Describe the request for the report (a path or command)
+__attribute__((format(printf, 2, 3)))
+void traceDetail(TraceSpan *span, const char *format, ...);
+
+// Charge the remaining time to phase and finish the span. A request slower than
+// the threshold is printed with its phase breakdown.
+void traceEnd(TraceSpan *span, TracePhase phase, uint64_t id);
+
+#endif // TRACE_H
@@ -0,0 +1,66 @@
+// transport.c - Implementation of the plaintext and TLS transports
+#include "transport.h"
+
+#include <openssl/err.h>  // For ERR_clear_error
+
+#include "connection.h"   // For Connection
+#include "socket.h"       // For rawReceiveData, rawSendBuffer
+#include "sslsocket.h"    // For SSLContinueHandshake, SSLReceiveData, SSLSendBuffer
+
+// ==== Plaintext ====
+
+static int plainHandshake(struct Connection *connection, int *wantWrite) {
+  (void)connection;
+  (void)wantWrite;
+  return 1;
+}
+
+static int plainReceive(struct Connection *connection, char *buffer, size_t size, int *wantWrite) {
+  *wantWrite = 0;
+  return rawReceiveData(connection->fd, buffer, size);
+}
+
+static int plainSend(struct Connection *connection, const char *data, size_t length) {
+  return rawSendBuffer(connection->fd, data, length);
+}
+
+static void plainShutdown(struct Connection *connection) {
+  (void)connection;
+}
+
+const Transport plainTransport = {
+  .name = "plain",
+  .handshake = plainHandshake,
+  .receive = plainReceive,
+  .send = plainSend,
+  .shutdown = plainShutdown,
+};
+
+// ==== TLS ====
+
+static int tlsHandshake(struct Connection *connection, int *wantWrite) {
+  return SSLContinueHandshake(connection->ssl, wantWrite);
+}
+
+static int tlsReceive(struct Connection *connection, char *buffer, size_t size, int *wantWrite) {
+  return SSLReceiveData(connection->ssl, buffer, size, wantWrite);
+}
+
+static int tlsSend(struct Connection *connection, const char *data, size_t length) {
+  return SSLSendBuffer(connection->ssl, data, length);
+}
+
+static void tlsShutdown(struct Connection *connection) {
+  if (SSL_is_init_finished(connection->ssl)) SSL_shutdown(connection->ssl);
+  ERR_clear_error();
+  SSL_free(connection->ssl);
+  connection->ssl = NULL;
+}
+
+const Transport tlsTransport = {
+  .name = "tls",
+  .handshake = tlsHandshake,
+  .receive = tlsReceive,
+  .send = tlsSend,
+  .shutdown = tlsShutdown,
+};
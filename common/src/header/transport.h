@@ -0,0 +1,39 @@
+// transport.h - Plaintext and TLS byte streams behind one interface
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+
+#ifndef SOCKET_WOULD_BLOCK
+#define SOCKET_WOULD_BLOCK -2   // Non-blocking operation cannot make progress yet
+#endif
+
+struct Connection;
+
+// How a connection's bytes move. Chosen once when the connection is created
+// (TLS or not), so the read and write paths call straight through without
+// checking which kind of connection they have. Return values follow socket.h:
+// bytes moved, 0 once the peer has closed, SOCKET_WOULD_BLOCK or -1.
+typedef struct Transport {
+  const char *name;
+
+  // Advance the handshake. Returns 1 once the stream is ready, SOCKET_WOULD_BLOCK
+  // while waiting on the peer (wantWrite says in which direction), or -1 on failure.
+  int (*handshake)(struct Connection *connection, int *wantWrite);
+
+  // Receive into buffer; only the returned number of bytes is valid. On SOCKET_WOULD_BLOCK,
+  // wantWrite says whether the socket must become writable first: TLS may have to send
+  // something of its own, such as a KeyUpdate reply, before it can read on.
+  int (*receive)(struct Connection *connection, char *buffer, size_t size, int *wantWrite);
+
+  // Send from data. May send only part of it.
+  int (*send)(struct Connection *connection, const char *data, size_t length);
+
+  // End the session before the socket is closed, releasing its state
+  void (*shutdown)(struct Connection *connection);
+} Transport;
+
+extern const Transport plainTransport;  // Bytes straight to the socket
+extern const Transport tlsTransport;    // Bytes through the connection's SSL session
+
+#endif // TRANSPORT_H
@@ -1,7 +1,8 @@
 #!/bin/bash
 set -e
 
-gcc src/main/main.c src/header/sslsocket.c src/header/socket.c src/header/parser.c -lssl -lcrypto -o build/http
+../common/build.sh
+gcc src/main/main.c src/header/parser.c src/header/hpack.c src/header/h2.c src/header/filecache.c src/header/authclient.c src/header/sharedcache.c ../common/build/libnoble.a -lssl -lcrypto -lpthread -o build/http
 
 if [[ $1 == "run" ]]; then
   cd build
@@ -0,0 +1,416 @@
+// authclient.c - Implementation of the pooled auth server client
+//
+// Each backend connection starts with "PIPELINE" and then carries one request line
+// per check: "LOGIN username hash" for Basic credentials, "VERIFY token" for
+// Bearer. The auth server answers in request order, so answers are matched to
+// the oldest outstanding request. A connection that fails or stops answering is
+// closed and every check waiting on it gets AUTH_UNAVAILABLE; it is reopened on
+// the next check.
+#define _GNU_SOURCE
+#include "authclient.h"
+
+#include <stdio.h>         // For printf, fprintf, snprintf
+#include <stdlib.h>        // For atoi
+#include <string.h>        // For memcpy, memcmp, memchr, memmove, strchr, strrchr
+#include <errno.h>         // For errno, EINPROGRESS, EAGAIN
+#include <unistd.h>        // For close
+#include <netdb.h>         // For getaddrinfo
+#include <sys/socket.h>    // For socket, connect, send, recv
+#include <sys/un.h>        // For sockaddr_un
+#include <netinet/in.h>    // For IPPROTO_TCP
+#include <netinet/tcp.h>   // For TCP_NODELAY
+#include <openssl/evp.h>   // For EVP_DecodeBlock
+#include <openssl/sha.h>   // For SHA256
+
+#include "../../../common/src/header/pool.h"  // For Slab, bufferAcquire
+#include "parser.h"                           // For MAX_AUTHORIZATION_LEN
+
+#define AUTH_MAX_CONNECTIONS 16
+#define AUTH_LINE_MAX (MAX_AUTHORIZATION_LEN + 16)
+
+typedef struct AuthBackend AuthBackend;
+
+struct AuthRequest {
+  AuthWaiter *waiter;                            // NULL once cancelled
+  unsigned char digest[SHA256_DIGEST_LENGTH];    // Cache key for the credential
+  Timer timer;                                   // Deadline for the answer
+  AuthBackend *backend;
+  AuthRequest *next;                             // Next request on the same connection
+};
+
+// One persistent connection to the auth server
+struct AuthBackend {
+  int fd;                  // -1 while closed
+  int connecting;          // Non-blocking connect still in progress
+  EventHandler handler;
+  char *output;            // Pooled buffer of request lines not yet sent, or NULL
+  size_t outputLength;
+  size_t outputSent;
+  char *input;             // Pooled buffer holding a partial answer, or NULL
+  size_t inputLength;
+  AuthRequest *head;       // Outstanding requests, oldest (next to be answered) first
+  AuthRequest *tail;
+  size_t inFlight;
+};
+
+typedef struct {
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  uint64_t expires;        // Loop clock in milliseconds; 0 for an empty slot
+} AuthCacheEntry;
+
+// Only used from the event loop thread
+static EventLoop *clientLoop;
+static AuthClientConfig settings;
+static struct sockaddr_storage serverAddress;
+static socklen_t serverAddressLength;
+static AuthBackend backends[AUTH_MAX_CONNECTIONS];
+static size_t totalInFlight;
+static AuthCacheEntry cache[AUTH_CACHE_SLOTS];
+static __thread Slab requestSlab = SLAB_INITIALIZER(AuthRequest);
+
+// Parse "unix:/path" or "host:port" into serverAddress
+static int resolveAddress(const char *address) {
+  if (strncmp(address, "unix:", 5) == 0) {
+    struct sockaddr_un *unixAddress = (struct sockaddr_un *)&serverAddress;
+    const char *path = address + 5;
+    if (strlen(path) >= sizeof(unixAddress->sun_path)) {
+      fprintf(stderr, "[!] Auth socket path too long: %s\n", path);
+      return -1;
+    }
+    unixAddress->sun_family = AF_UNIX;
+    strcpy(unixAddress->sun_path, path);
+    serverAddressLength = sizeof(struct sockaddr_un);
+    return 0;
+  }
+
+  char host[256];
+  const char *colon = strrchr(address, ':');
+  if (!colon || (size_t)(colon - address) >= sizeof(host)) {
+    fprintf(stderr, "[!] Auth address must be host:port or unix:/path, got %s\n", address);
+    return -1;
+  }
+  memcpy(host, address, (size_t)(colon - address));
+  host[colon - address] = '\0';
+
+  struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+  struct addrinfo *result;
+  int status = getaddrinfo(host, colon + 1, &hints, &result);
+  if (status != 0) {
+    fprintf(stderr, "[!] Cannot resolve auth server %s: %s\n", address, gai_strerror(status));
+    return -1;
+  }
+  memcpy(&serverAddress, result->ai_addr, result->ai_addrlen);
+  serverAddressLength = result->ai_addrlen;
+  freeaddrinfo(result);
+  return 0;
+}
+
+static void onBackendReady(EventLoop *loop, EventHandler *handler, uint32_t events);
+
+// Close a connection and fail every check waiting on it
+static void resetBackend(AuthBackend *backend) {
+  if (backend->fd >= 0) {
+    eventLoopRemove(clientLoop, &backend->handler);
+    close(backend->fd);
+    backend->fd = -1;
+  }
+  if (backend->output) bufferRelease(backend->output);
+  if (backend->input) bufferRelease(backend->input);
+  backend->output = NULL;
+  backend->input = NULL;
+  backend->outputLength = 0;
+  backend->outputSent = 0;
+  backend->inputLength = 0;
+  backend->connecting = 0;
+
+  // Detach the list first: waiters may start new checks while being told
+  AuthRequest *request = backend->head;
+  backend->head = NULL;
+  backend->tail = NULL;
+  totalInFlight -= backend->inFlight;
+  backend->inFlight = 0;
+
+  while (request) {
+    AuthRequest *next = request->next;
+    AuthWaiter *waiter = request->waiter;
+    timerCancel(eventLoopTimers(clientLoop), &request->timer);
+    slabFree(&requestSlab, request);
+
+    if (waiter) {
+      waiter->request = NULL;
+      waiter->ready(waiter, AUTH_UNAVAILABLE);
+    }
+    request = next;
+  }
+}
+
+// Start connecting. The first line sent switches the auth server to pipelined mode.
+static int openBackend(AuthBackend *backend) {
+  int fd = socket(serverAddress.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    perror("Error creating auth server socket");
+    return -1;
+  }
+
+  if (serverAddress.ss_family != AF_UNIX) {
+    // Request lines are tiny and already batched per loop iteration
+    int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  }
+
+  int status = connect(fd, (struct sockaddr *)&serverAddress, serverAddressLength);
+  if (status != 0 && errno != EINPROGRESS) {
+    perror("Error connecting to auth server");
+    close(fd);
+    return -1;
+  }
+
+  backend->output = bufferAcquire();
+  if (!backend->output ||
+      eventLoopAdd(clientLoop, &backend->handler, fd, EPOLLIN | EPOLLOUT, onBackendReady, backend) != 0) {
+    if (backend->output) bufferRelease(backend->output);
+    backend->output = NULL;
+    close(fd);
+    return -1;
+  }
+
+  backend->fd = fd;
+  backend->connecting = status != 0;
+  backend->outputLength = (size_t)snprintf(backend->output, POOL_BUFFER_SIZE, "PIPELINE\n");
+  backend->outputSent = 0;
+  return 0;
+}
+
+// Remember an accepted credential until the TTL runs out
+static void cacheStore(const unsigned char *digest) {
+  AuthCacheEntry *entry = &cache[(digest[0] | digest[1] << 8 | digest[2] << 16) % AUTH_CACHE_SLOTS];
+  memcpy(entry->digest, digest, SHA256_DIGEST_LENGTH);
+  entry->expires = eventLoopNow(clientLoop) + (uint64_t)settings.cacheTtlMs;
+}
+
+static int cacheLookup(const unsigned char *digest) {
+  AuthCacheEntry *entry = &cache[(digest[0] | digest[1] << 8 | digest[2] << 16) % AUTH_CACHE_SLOTS];
+  return entry->expires > eventLoopNow(clientLoop) &&
+         memcmp(entry->digest, digest, SHA256_DIGEST_LENGTH) == 0;
+}
+
+// Match each complete answer line to the oldest outstanding request. Returns -1 on a
+// protocol error, after which the caller resets the connection.
+static int takeAnswers(AuthBackend *backend) {
+  char *start = backend->input;
+  char *end = backend->input + backend->inputLength;
+  char *newline;
+
+  while ((newline = memchr(start, '\n', (size_t)(end - start)))) {
+    AuthRequest *request = backend->head;
+    if (!request) return -1;  // An answer nobody asked for
+
+    // Anything else means answers and requests no longer line up; resetting fails this
+    // connection's checks
+    size_t length = (size_t)(newline - start);
+    AuthResult result;
+    if (length >= 4 && memcmp(start, "true", 4) == 0 && (length == 4 || start[4] == ' ')) result = AUTH_ALLOWED;
+    else if (length == 5 && memcmp(start, "false", 5) == 0) result = AUTH_DENIED;
+    else if (length == 4 && memcmp(start, "busy", 4) == 0) result = AUTH_UNAVAILABLE;
+    else return -1;
+    start = newline + 1;
+
+    backend->head = request->next;
+    if (!backend->head) backend->tail = NULL;
+    backend->inFlight--;
+    totalInFlight--;
+    timerCancel(eventLoopTimers(clientLoop), &request->timer);
+    if (result == AUTH_ALLOWED) cacheStore(request->digest);
+
+    AuthWaiter *waiter = request->waiter;
+    slabFree(&requestSlab, request);
+    if (waiter) {
+      waiter->request = NULL;
+      waiter->ready(waiter, result);
+    }
+  }
+
+  // Keep a partial answer for the next read
+  backend->inputLength = (size_t)(end - start);
+  memmove(backend->input, start, backend->inputLength);
+  return 0;
+}
+
+// Connection finished, answers arrived, or there is room to send queued requests
+static void onBackendReady(EventLoop *loop, EventHandler *handler, uint32_t events) {
+  (void)loop;
+  AuthBackend *backend = handler->data;
+
+  if (backend->connecting) {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    getsockopt(backend->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+    if (error != 0 || (events & (EPOLLERR | EPOLLHUP))) {
+      fprintf(stderr, "[!] Cannot connect to auth server: %s\n", strerror(error ? error : ECONNREFUSED));
+      resetBackend(backend);
+      return;
+    }
+    backend->connecting = 0;
+  }
+
+  // Read every answer available
+  if (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+    while (1) {
+      if (!backend->input && !(backend->input = bufferAcquire())) {
+        resetBackend(backend);
+        return;
+      }
+      if (backend->inputLength == POOL_BUFFER_SIZE) {
+        resetBackend(backend);  // An answer longer than any we expect
+        return;
+      }
+
+      ssize_t bytesRead = recv(backend->fd, backend->input + backend->inputLength,
+                               POOL_BUFFER_SIZE - backend->inputLength, 0);
+      if (bytesRead < 0 && (errno == EAGAIN || errno == EINTR)) break;
+      if (bytesRead <= 0) {
+        if (backend->inFlight > 0) fprintf(stderr, "[!] Auth server closed the connection\n");
+        resetBackend(backend);
+        return;
+      }
+
+      backend->inputLength += (size_t)bytesRead;
+      if (takeAnswers(backend) != 0) {
+        resetBackend(backend);
+        return;
+      }
+    }
+    if (backend->inputLength == 0) {
+      bufferRelease(backend->input);
+      backend->input = NULL;
+    }
+  }
+
+  // Send queued request lines
+  while (backend->output && backend->outputSent < backend->outputLength) {
+    ssize_t bytesSent = send(backend->fd, backend->output + backend->outputSent,
+                             backend->outputLength - backend->outputSent, MSG_NOSIGNAL);
+    if (bytesSent < 0 && (errno == EAGAIN || errno == EINTR)) break;
+    if (bytesSent < 0) {
+      resetBackend(backend);
+      return;
+    }
+    backend->outputSent += (size_t)bytesSent;
+  }
+
+  if (backend->output && backend->outputSent == backend->outputLength) {
+    bufferRelease(backend->output);
+    backend->output = NULL;
+  }
+  eventLoopModify(clientLoop, &backend->handler, backend->output ? EPOLLIN | EPOLLOUT : EPOLLIN);
+}
+
+// The auth server is not answering on this connection; start over
+static void onRequestTimeout(Timer *timer) {
+  AuthRequest *request = timer->data;
+  fprintf(stderr, "[!] Auth server did not answer within %d ms\n", settings.timeoutMs);
+  resetBackend(request->backend);
+}
+
+// Translate an Authorization header into an auth server request line. Returns its
+// length, or 0 if unusable.
+static size_t requestLine(const char *authorization, char *line, size_t size) {
+  if (strncmp(authorization, "Bearer ", 7) == 0) {
+    const char *token = authorization + 7;
+    if (!*token || strpbrk(token, " \t\r\n")) return 0;
+    int length = snprintf(line, size, "VERIFY %s\n", token);
+    return length > 0 && (size_t)length < size ? (size_t)length : 0;
+  }
+
+  if (strncmp(authorization, "Basic ", 6) == 0) {
+    // base64("username:hash"); the hash is what auth clients send as their password
+    const char *encoded = authorization + 6;
+    size_t encodedLength = strlen(encoded);
+    unsigned char decoded[MAX_AUTHORIZATION_LEN];
+    if (encodedLength == 0 || encodedLength % 4 != 0) return 0;
+    int decodedLength = EVP_DecodeBlock(decoded, (const unsigned char *)encoded, (int)encodedLength);
+    if (decodedLength <= 0) return 0;
+    while (encodedLength > 0 && encoded[--encodedLength] == '=') decodedLength--;
+    decoded[decodedLength] = '\0';
+
+    char *credentials = (char *)decoded;
+    char *colon = strchr(credentials, ':');
+    if (!colon || colon == credentials || !colon[1] ||
+        strlen(credentials) != (size_t)decodedLength || strpbrk(credentials, " \t\r\n")) {
+      return 0;
+    }
+    // Sent as a login, so a user named like a command (METRICS, SETUSER...) is still just a user
+    *colon = '\0';
+    int length = snprintf(line, size, "LOGIN %s %s\n", credentials, colon + 1);
+    return length > 0 && (size_t)length < size ? (size_t)length : 0;
+  }
+
+  return 0;
+}
+
+int authClientInit(EventLoop *loop, const AuthClientConfig *config) {
+  clientLoop = loop;
+  settings = *config;
+  if (settings.connections < 1) settings.connections = 1;
+  if (settings.connections > AUTH_MAX_CONNECTIONS) settings.connections = AUTH_MAX_CONNECTIONS;
+
+  for (int i = 0; i < AUTH_MAX_CONNECTIONS; i++) backends[i].fd = -1;
+  return resolveAddress(config->address);
+}
+
+AuthResult authCheck(const char *authorization, AuthWaiter *waiter) {
+  char line[AUTH_LINE_MAX];
+  size_t lineLength = requestLine(authorization, line, sizeof(line));
+  if (lineLength == 0) return AUTH_DENIED;
+
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256((const unsigned char *)authorization, strlen(authorization), digest);
+  if (cacheLookup(digest)) return AUTH_ALLOWED;
+
+  if (totalInFlight >= (size_t)settings.maxInFlight) return AUTH_UNAVAILABLE;
+
+  // Spread checks over the connections, opening them as needed
+  AuthBackend *backend = &backends[0];
+  for (int i = 1; i < settings.connections; i++) {
+    if (backends[i].inFlight < backend->inFlight) backend = &backends[i];
+  }
+  if (backend->fd < 0 && openBackend(backend) != 0) return AUTH_UNAVAILABLE;
+
+  if (!backend->output) {
+    backend->output = bufferAcquire();
+    if (!backend->output) return AUTH_UNAVAILABLE;
+    backend->outputLength = 0;
+    backend->outputSent = 0;
+  }
+  if (backend->outputLength + lineLength > POOL_BUFFER_SIZE) return AUTH_UNAVAILABLE;
+
+  AuthRequest *request = slabAlloc(&requestSlab);
+  if (!request) return AUTH_UNAVAILABLE;
+
+  // Queued now, written when the loop next polls, so checks from one wakeup share a send
+  memcpy(backend->output + backend->outputLength, line, lineLength);
+  backend->outputLength += lineLength;
+  if (!backend->connecting) eventLoopModify(clientLoop, &backend->handler, EPOLLIN | EPOLLOUT);
+
+  request->waiter = waiter;
+  memcpy(request->digest, digest, sizeof(digest));
+  request->backend = backend;
+  request->next = NULL;
+  if (backend->tail) backend->tail->next = request;
+  else backend->head = request;
+  backend->tail = request;
+  backend->inFlight++;
+  totalInFlight++;
+
+  timerInit(&request->timer, onRequestTimeout, request);
+  timerArm(eventLoopTimers(clientLoop), &request->timer, (uint64_t)settings.timeoutMs);
+  waiter->request = request;
+  return AUTH_PENDING;
+}
+
+void authCancel(AuthWaiter *waiter) {
+  if (waiter->request) {
+    waiter->request->waiter = NULL;
+    waiter->request = NULL;
+  }
+}
@@ -0,0 +1,46 @@
+// authclient.h - Credential checks against the auth server over pooled, pipelined connections
+#ifndef AUTHCLIENT_H
+#define AUTHCLIENT_H
+
+#include <stddef.h>
+
+#include "../../../common/src/header/eventloop.h"
+
+#define AUTH_CACHE_SLOTS 4096   // Remembered positive results (direct-mapped by credential digest)
+
+typedef enum {
+  AUTH_ALLOWED,       // Credentials accepted (possibly from the cache)
+  AUTH_DENIED,        // Missing, malformed or rejected credentials
+  AUTH_PENDING,       // Asked the auth server; the waiter will be called
+  AUTH_UNAVAILABLE    // Too many checks in flight, or the auth server failed or timed out
+} AuthResult;
+
+typedef struct AuthWaiter AuthWaiter;
+typedef struct AuthRequest AuthRequest;
+
+// Embedded by the caller to receive the result of a pending check
+struct AuthWaiter {
+  void (*ready)(AuthWaiter *waiter, AuthResult result);
+  AuthRequest *request;   // Owned by the client while pending
+};
+
+typedef struct {
+  const char *address;    // "host:port" or "unix:/path/to/socket"
+  int connections;        // Persistent connections to keep open
+  int timeoutMs;          // Longest wait for an answer before giving up on a connection
+  int maxInFlight;        // Checks outstanding at once before callers get AUTH_UNAVAILABLE
+  int cacheTtlMs;         // How long an accepted credential is trusted without asking again
+} AuthClientConfig;
+
+// Resolve the auth server address and set up the connection pool on the loop.
+// Connections are opened on first use. Returns 0 on success.
+int authClientInit(EventLoop *loop, const AuthClientConfig *config);
+
+// Check an Authorization header value ("Bearer <token>" or "Basic <base64 user:hash>").
+// Returns AUTH_PENDING if waiter->ready will be called later with the result.
+AuthResult authCheck(const char *authorization, AuthWaiter *waiter);
+
+// Stop waiting for a pending check; the waiter won't be called
+void authCancel(AuthWaiter *waiter);
+
+#endif // AUTHCLIENT_H
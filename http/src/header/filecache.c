@@ -0,0 +1,345 @@
+// filecache.c - Implementation of the served-file cache
+#define _GNU_SOURCE
+#include "filecache.h"
+
+#include <stdio.h>        // For fprintf
+#include <stdlib.h>       // For malloc, calloc, free
+#include <string.h>       // For strlen, strcmp, strdup
+#include <fcntl.h>        // For open
+#include <unistd.h>       // For pread, close
+#include <sys/stat.h>     // For fstat
+
+#include "sharedcache.h"  // For sharedCacheFind, sharedCacheStore
+
+// Work handed to an I/O thread: open, fstat and (for small files) read one path
+typedef enum {
+  LOAD_MISSING,      // No regular file at the path
+  LOAD_UNCHANGED,    // Same file as the cached copy; nothing was read
+  LOAD_LOADED        // New contents (or descriptor) in the results
+} FileLoadStatus;
+
+typedef struct {
+  ThreadTask task;
+  CachedFile *entry;           // Referenced until the load completes
+
+  // Identity of the cached copy, when revalidating
+  int checkIdentity;
+  dev_t device;
+  ino_t inode;
+  off_t size;
+  struct timespec modified;
+
+  // Results
+  FileLoadStatus status;
+  struct stat info;
+  char *data;
+  int sharedData;              // data lives in the shared region
+  int fd;
+} FileLoad;
+
+static ThreadPool *ioThreads;
+static CachedFile *buckets[FILE_CACHE_BUCKETS];
+static CachedFile *lruHead;
+static CachedFile *lruTail;
+static size_t cachedEntries;
+static size_t cachedBytes;
+
+static uint64_t hashPath(const char *path) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+    hash ^= *p;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// ==== Entries ====
+
+static void freeEntry(CachedFile *entry) {
+  if (!entry->sharedData) free((char *)entry->data);
+  if (entry->fd >= 0) close(entry->fd);
+  free(entry->path);
+  free(entry);
+}
+
+static CachedFile *newEntry(const char *path, uint64_t hash) {
+  CachedFile *entry = calloc(1, sizeof(CachedFile));
+  if (!entry) return NULL;
+
+  entry->path = strdup(path);
+  if (!entry->path) {
+    free(entry);
+    return NULL;
+  }
+  entry->hash = hash;
+  entry->fd = -1;
+  entry->state = FILE_LOADING;
+  entry->refs = 1;  // The table's reference
+  return entry;
+}
+
+static void lruUnlink(CachedFile *entry) {
+  if (entry->lruPrev) entry->lruPrev->lruNext = entry->lruNext;
+  else if (lruHead == entry) lruHead = entry->lruNext;
+  else return;  // Not on the list (still loading)
+
+  if (entry->lruNext) entry->lruNext->lruPrev = entry->lruPrev;
+  else lruTail = entry->lruPrev;
+  entry->lruPrev = NULL;
+  entry->lruNext = NULL;
+}
+
+static void lruPushFront(CachedFile *entry) {
+  entry->lruPrev = NULL;
+  entry->lruNext = lruHead;
+  if (lruHead) lruHead->lruPrev = entry;
+  else lruTail = entry;
+  lruHead = entry;
+}
+
+// Take an entry out of the table. Readers keep it alive until they release it.
+static void removeEntry(CachedFile *entry) {
+  CachedFile **link = &buckets[entry->hash & (FILE_CACHE_BUCKETS - 1)];
+  while (*link != entry) link = &(*link)->bucketNext;
+  *link = entry->bucketNext;
+
+  lruUnlink(entry);
+  cachedEntries--;
+  if (entry->data && !entry->sharedData) cachedBytes -= entry->size;
+  entry->inTable = 0;
+  fileCacheRelease(entry);
+}
+
+static void insertEntry(CachedFile *entry) {
+  CachedFile **bucket = &buckets[entry->hash & (FILE_CACHE_BUCKETS - 1)];
+  entry->bucketNext = *bucket;
+  *bucket = entry;
+  entry->inTable = 1;
+  cachedEntries++;
+}
+
+// Evict least recently used entries until the cache is within its limits
+static void evictEntries(void) {
+  CachedFile *entry = lruTail;
+  while (entry && (cachedBytes > FILE_CACHE_MAX_BYTES || cachedEntries > FILE_CACHE_MAX_ENTRIES)) {
+    CachedFile *previous = entry->lruPrev;
+    if (!entry->revalidating) removeEntry(entry);
+    entry = previous;
+  }
+}
+
+// Move the results of a load into a ready entry and put it on the LRU list
+static void fillEntry(CachedFile *entry, FileLoad *load, uint64_t nowMs) {
+  if (load->status == LOAD_MISSING) {
+    entry->state = FILE_MISSING;
+  } else {
+    entry->state = FILE_READY;
+    entry->data = load->data;
+    entry->sharedData = load->sharedData;
+    entry->fd = load->fd;
+    entry->size = (size_t)load->info.st_size;
+    entry->device = load->info.st_dev;
+    entry->inode = load->info.st_ino;
+    entry->modified = load->info.st_mtim;
+    if (entry->data && !entry->sharedData) cachedBytes += entry->size;
+    load->data = NULL;
+    load->fd = -1;
+  }
+
+  entry->validatedMs = nowMs;
+  lruPushFront(entry);
+}
+
+// ==== Background loads ====
+
+// Runs on an I/O thread: the only place the cache touches the disk
+static void runFileLoad(ThreadTask *task) {
+  FileLoad *load = (FileLoad *)task;
+  load->status = LOAD_MISSING;
+
+  int fd = open(load->entry->path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return;
+
+  if (fstat(fd, &load->info) != 0 || !S_ISREG(load->info.st_mode)) {
+    close(fd);
+    return;
+  }
+
+  if (load->checkIdentity &&
+      load->info.st_dev == load->device && load->info.st_ino == load->inode &&
+      load->info.st_size == load->size &&
+      load->info.st_mtim.tv_sec == load->modified.tv_sec &&
+      load->info.st_mtim.tv_nsec == load->modified.tv_nsec) {
+    close(fd);
+    load->status = LOAD_UNCHANGED;
+    return;
+  }
+
+  // Large files keep the descriptor; readers pread from it concurrently
+  size_t size = (size_t)load->info.st_size;
+  if (size > FILE_CACHE_MAX_FILE_SIZE) {
+    load->fd = fd;
+    load->status = LOAD_LOADED;
+    return;
+  }
+
+  // Small files are read once for all workers: take another worker's copy, or
+  // store ours for them. Private memory is the fallback when neither works.
+  const char *shared = sharedCacheFind(load->entry->path, load->entry->hash, &load->info);
+  if (!shared) shared = sharedCacheStore(load->entry->path, load->entry->hash, &load->info, fd);
+  if (shared) {
+    close(fd);
+    load->data = (char *)shared;
+    load->sharedData = 1;
+    load->status = LOAD_LOADED;
+    return;
+  }
+
+  char *data = malloc(size ? size : 1);
+  size_t loaded = 0;
+  while (data && loaded < size) {
+    ssize_t bytesRead = pread(fd, data + loaded, size - loaded, (off_t)loaded);
+    if (bytesRead <= 0) break;
+    loaded += (size_t)bytesRead;
+  }
+  close(fd);
+
+  // A file that shrank while being read is treated as missing until the next check
+  if (!data || loaded != size) {
+    free(data);
+    return;
+  }
+
+  load->data = data;
+  load->status = LOAD_LOADED;
+}
+
+// Runs on the event loop once the I/O thread is done
+static void completeFileLoad(ThreadTask *task) {
+  FileLoad *load = (FileLoad *)task;
+  CachedFile *entry = load->entry;
+  uint64_t nowMs = monotonicMs();
+
+  if (entry->state == FILE_LOADING) {
+    // First load: fill the entry and hand it to everyone who asked for it meanwhile
+    fillEntry(entry, load, nowMs);
+    while (entry->waiters) {
+      FileWaiter *waiter = entry->waiters;
+      fileCacheCancel(waiter);
+      entry->refs++;
+      waiter->ready(waiter, entry);
+    }
+  } else {
+    entry->revalidating = 0;
+    int unchanged = load->status == LOAD_UNCHANGED ||
+                    (load->status == LOAD_MISSING && entry->state == FILE_MISSING);
+
+    if (unchanged) {
+      entry->validatedMs = nowMs;
+    } else if (entry->inTable) {
+      // Replace the entry; requests already using the old contents finish with them
+      CachedFile *fresh = newEntry(entry->path, entry->hash);
+      removeEntry(entry);
+      if (fresh) {
+        insertEntry(fresh);
+        fillEntry(fresh, load, nowMs);
+      }
+    }
+  }
+
+  evictEntries();
+
+  if (load->data && !load->sharedData) free(load->data);
+  if (load->fd >= 0) close(load->fd);
+  fileCacheRelease(entry);
+  free(load);
+}
+
+// Queue a load (or revalidation) of an entry. Returns 0 on success.
+static int startLoad(CachedFile *entry) {
+  FileLoad *load = calloc(1, sizeof(FileLoad));
+  if (!load) return -1;
+
+  load->task.run = runFileLoad;
+  load->task.complete = completeFileLoad;
+  load->entry = entry;
+  load->fd = -1;
+
+  if (entry->state == FILE_READY) {
+    load->checkIdentity = 1;
+    load->device = entry->device;
+    load->inode = entry->inode;
+    load->size = (off_t)entry->size;
+    load->modified = entry->modified;
+  }
+
+  if (threadPoolSubmit(ioThreads, &load->task) != 0) {
+    free(load);
+    return -1;
+  }
+
+  entry->refs++;
+  return 0;
+}
+
+// ==== Public interface ====
+
+void fileCacheInit(ThreadPool *ioPool) {
+  ioThreads = ioPool;
+}
+
+FileCacheResult fileCacheLookup(const char *path, FileWaiter *waiter, CachedFile **file) {
+  uint64_t hash = hashPath(path);
+  CachedFile *entry = buckets[hash & (FILE_CACHE_BUCKETS - 1)];
+  while (entry && (entry->hash != hash || strcmp(entry->path, path) != 0)) {
+    entry = entry->bucketNext;
+  }
+
+  if (!entry) {
+    // Miss: start the one load every concurrent request for this path will share
+    entry = newEntry(path, hash);
+    if (!entry) return FILE_CACHE_BUSY;
+    if (startLoad(entry) != 0) {
+      freeEntry(entry);
+      return FILE_CACHE_BUSY;
+    }
+    insertEntry(entry);
+  }
+
+  if (entry->state == FILE_LOADING) {
+    waiter->file = entry;
+    waiter->prev = NULL;
+    waiter->next = entry->waiters;
+    if (entry->waiters) entry->waiters->prev = waiter;
+    entry->waiters = waiter;
+    return FILE_CACHE_PENDING;
+  }
+
+  // Serve what is cached; an old entry is checked against the disk in the background
+  if (!entry->revalidating && monotonicMs() - entry->validatedMs >= FILE_CACHE_REVALIDATE_MS) {
+    entry->revalidating = startLoad(entry) == 0;
+  }
+
+  lruUnlink(entry);
+  lruPushFront(entry);
+  entry->refs++;
+  *file = entry;
+  return FILE_CACHE_HIT;
+}
+
+void fileCacheCancel(FileWaiter *waiter) {
+  CachedFile *entry = waiter->file;
+  if (!entry) return;
+
+  if (waiter->prev) waiter->prev->next = waiter->next;
+  else entry->waiters = waiter->next;
+  if (waiter->next) waiter->next->prev = waiter->prev;
+  waiter->file = NULL;
+}
+
+void fileCacheRelease(void *file) {
+  CachedFile *entry = file;
+  if (!entry) return;
+  if (--entry->refs == 0) freeEntry(entry);
+}
@@ -0,0 +1,79 @@
+// filecache.h - In-memory cache of served files, filled by background I/O threads
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "../../../common/src/header/threadpool.h"
+
+#define FILE_CACHE_BUCKETS 1024                    // Hash buckets (power of two)
+#define FILE_CACHE_MAX_ENTRIES 4096                // Entries kept, including negative ones
+#define FILE_CACHE_MAX_BYTES (64 * 1024 * 1024)    // File contents held in memory
+#define FILE_CACHE_MAX_FILE_SIZE (1024 * 1024)     // Larger files are served from a shared descriptor
+#define FILE_CACHE_REVALIDATE_MS 2000              // Age after which an entry is checked against disk
+
+// Outcome of a lookup
+typedef enum {
+  FILE_CACHE_HIT,       // Entry returned; release it when done
+  FILE_CACHE_PENDING,   // Being loaded; the waiter is called once it is ready
+  FILE_CACHE_BUSY       // The I/O queue is full; try again later
+} FileCacheResult;
+
+typedef enum {
+  FILE_LOADING,         // First load in progress
+  FILE_READY,           // Regular file, contents in data or readable through fd
+  FILE_MISSING          // Does not exist or is not a regular file
+} CachedFileState;
+
+typedef struct FileWaiter FileWaiter;
+
+// A cached file. Entries are reference counted and never change once ready:
+// a file that changed on disk gets a new entry, and the old one lives on
+// until its last reader releases it.
+typedef struct CachedFile {
+  char *path;
+  CachedFileState state;
+  const char *data;     // Whole contents for small files (possibly in the shared region), or NULL
+  int fd;               // Descriptor for files above FILE_CACHE_MAX_FILE_SIZE, or -1 (read with pread)
+  size_t size;
+
+  // Bookkeeping owned by filecache.c
+  uint64_t hash;
+  int sharedData;                 // data belongs to the shared region and is never freed
+  size_t refs;                    // Readers, plus one while in the table
+  int inTable;
+  int revalidating;               // Background check against disk in progress
+  uint64_t validatedMs;           // When the entry was last known to match the disk
+  dev_t device;                   // Identity of the file the entry was loaded from
+  ino_t inode;
+  struct timespec modified;
+  struct CachedFile *bucketNext;
+  struct CachedFile *lruPrev;     // Most recently used first
+  struct CachedFile *lruNext;
+  FileWaiter *waiters;            // Requests waiting for the first load
+} CachedFile;
+
+// A request waiting for a file to load, embedded in the caller's own state
+struct FileWaiter {
+  void (*ready)(FileWaiter *waiter, CachedFile *file);  // Receives a referenced entry
+  CachedFile *file;
+  FileWaiter *next;
+  FileWaiter *prev;
+};
+
+// Use the given pool for disk reads. Must be called from the event loop thread.
+void fileCacheInit(ThreadPool *ioPool);
+
+// Find a file by path. On FILE_CACHE_HIT *file is set to a referenced entry.
+// On FILE_CACHE_PENDING the waiter is called from the event loop once the file is loaded.
+FileCacheResult fileCacheLookup(const char *path, FileWaiter *waiter, CachedFile **file);
+
+// Stop waiting for a pending load (the client went away)
+void fileCacheCancel(FileWaiter *waiter);
+
+// Release a reference to a CachedFile. Takes void * so it can be used as a release callback.
+void fileCacheRelease(void *file);
+
+#endif // FILECACHE_H
@@ -0,0 +1,827 @@
+// h2.c - Implementation of HTTP/2 connections over TLS
+#include "h2.h"
+#include "hpack.h"
+
+#include <stdio.h>        // For printf
+#include <stdlib.h>       // For malloc, calloc, realloc, free
+#include <string.h>       // For memcpy, memset, memmove
+#include <unistd.h>       // For pread
+
+#include "../../../common/src/header/trace.h"  // For TRACE_PROBE3
+#include "../../../common/src/header/pool.h"   // For Slab
+
+// Frame types (RFC 7540 section 6)
+#define FRAME_DATA 0x0
+#define FRAME_HEADERS 0x1
+#define FRAME_PRIORITY 0x2
+#define FRAME_RST_STREAM 0x3
+#define FRAME_SETTINGS 0x4
+#define FRAME_PUSH_PROMISE 0x5
+#define FRAME_PING 0x6
+#define FRAME_GOAWAY 0x7
+#define FRAME_WINDOW_UPDATE 0x8
+#define FRAME_CONTINUATION 0x9
+
+// Frame flags
+#define FLAG_END_STREAM 0x1
+#define FLAG_ACK 0x1
+#define FLAG_END_HEADERS 0x4
+#define FLAG_PADDED 0x8
+#define FLAG_PRIORITY 0x20
+
+// Settings identifiers
+#define SETTINGS_HEADER_TABLE_SIZE 0x1
+#define SETTINGS_ENABLE_PUSH 0x2
+#define SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define SETTINGS_INITIAL_WINDOW_SIZE 0x4
+#define SETTINGS_MAX_FRAME_SIZE 0x5
+
+// Error codes
+#define ERROR_NONE 0x0
+#define ERROR_PROTOCOL 0x1
+#define ERROR_INTERNAL 0x2
+#define ERROR_FLOW_CONTROL 0x3
+#define ERROR_STREAM_CLOSED 0x5
+#define ERROR_FRAME_SIZE 0x6
+#define ERROR_REFUSED_STREAM 0x7
+#define ERROR_COMPRESSION 0x9
+
+#define FRAME_HEADER_SIZE 9
+#define MAX_WINDOW_SIZE 0x7fffffff
+#define MAX_HEADER_BLOCK (64 * 1024)
+
+static const char clientPreface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+#define CLIENT_PREFACE_LEN 24
+
+// Lifecycle of an open stream
+typedef enum {
+  STREAM_OPEN,           // Receiving the request
+  STREAM_WAITING,        // Request complete, handler still preparing the response
+  STREAM_RESPONDING      // Sending the response body
+} H2StreamState;
+
+typedef struct {
+  uint32_t id;
+  H2StreamState state;
+  size_t slot;           // Index in the session's streams
+  int64_t sendWindow;    // May go negative after a SETTINGS window change
+  HTTPRequest request;
+  int hasMethod;
+  int hasPath;
+  int malformed;
+  HTTPResponse response;
+  size_t bodySent;
+} H2Stream;
+
+struct H2Session {
+  H2RequestHandler handler;
+  void *handlerContext;
+  uint64_t traceId;      // Connection id reported by the stream probes
+  HPACKTable decoder;
+
+  // Bytes received but not yet parsed into complete frames
+  uint8_t *input;
+  size_t inputLength;
+  size_t inputCapacity;
+
+  // Serialized frames waiting to be written
+  uint8_t *output;
+  size_t outputStart;
+  size_t outputLength;
+  size_t outputCapacity;
+
+  int prefaceReceived;
+  int settingsReceived;
+  int goingAway;         // GOAWAY sent or received; no new streams
+  int failed;            // Connection error, stop reading input
+
+  int64_t connectionSendWindow;
+  int64_t initialWindowSize;  // Peer's SETTINGS_INITIAL_WINDOW_SIZE
+  uint32_t peerMaxFrameSize;
+  uint32_t lastStreamId;
+
+  // Header block being reassembled from HEADERS + CONTINUATION frames
+  uint8_t *headerBlock;
+  size_t headerBlockLength;
+  uint32_t headerStreamId;
+  int headerEndStream;
+
+  // Open streams, or NULL; streams come from a pool, so an idle session holds none
+  H2Stream *streams[H2_MAX_CONCURRENT_STREAMS];
+  size_t activeStreams;
+  size_t roundRobin;     // Stream slot to consider first for the next DATA frame
+};
+
+// ==== Output helpers ====
+
+// Make room for length more bytes of output and return where they go
+static uint8_t *reserveOutput(H2Session *session, size_t length) {
+  if (session->outputLength + length > session->outputCapacity) {
+    size_t capacity = session->outputCapacity ? session->outputCapacity : 16384;
+    while (capacity < session->outputLength + length) capacity *= 2;
+
+    uint8_t *grown = realloc(session->output, capacity);
+    if (!grown) return NULL;
+    session->output = grown;
+    session->outputCapacity = capacity;
+  }
+
+  return session->output + session->outputLength;
+}
+
+static int appendOutput(H2Session *session, const void *data, size_t length) {
+  uint8_t *destination = reserveOutput(session, length);
+  if (!destination) return -1;
+
+  memcpy(destination, data, length);
+  session->outputLength += length;
+  return 0;
+}
+
+static int writeFrameHeader(H2Session *session, size_t length, uint8_t type,
+                            uint8_t flags, uint32_t streamId) {
+  uint8_t header[FRAME_HEADER_SIZE] = {
+    (uint8_t)(length >> 16), (uint8_t)(length >> 8), (uint8_t)length,
+    type, flags,
+    (uint8_t)((streamId >> 24) & 0x7f), (uint8_t)(streamId >> 16),
+    (uint8_t)(streamId >> 8), (uint8_t)streamId
+  };
+  return appendOutput(session, header, sizeof(header));
+}
+
+static uint32_t readUint32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void writeUint32(uint8_t *p, uint32_t value) {
+  p[0] = (uint8_t)(value >> 24);
+  p[1] = (uint8_t)(value >> 16);
+  p[2] = (uint8_t)(value >> 8);
+  p[3] = (uint8_t)value;
+}
+
+static void sendRstStream(H2Session *session, uint32_t streamId, uint32_t errorCode) {
+  uint8_t payload[4];
+  writeUint32(payload, errorCode);
+  writeFrameHeader(session, sizeof(payload), FRAME_RST_STREAM, 0, streamId);
+  appendOutput(session, payload, sizeof(payload));
+}
+
+static void sendWindowUpdate(H2Session *session, uint32_t streamId, uint32_t increment) {
+  uint8_t payload[4];
+  writeUint32(payload, increment & MAX_WINDOW_SIZE);
+  writeFrameHeader(session, sizeof(payload), FRAME_WINDOW_UPDATE, 0, streamId);
+  appendOutput(session, payload, sizeof(payload));
+}
+
+// Queue a GOAWAY and stop processing input
+static int connectionError(H2Session *session, uint32_t errorCode) {
+  uint8_t payload[8];
+  writeUint32(payload, session->lastStreamId);
+  writeUint32(payload + 4, errorCode);
+  writeFrameHeader(session, sizeof(payload), FRAME_GOAWAY, 0, 0);
+  appendOutput(session, payload, sizeof(payload));
+
+  session->goingAway = 1;
+  session->failed = 1;
+  return -1;
+}
+
+// ==== Streams ====
+
+static __thread Slab streamSlab = SLAB_INITIALIZER(H2Stream);
+
+static H2Stream *findStream(H2Session *session, uint32_t streamId) {
+  for (size_t i = 0; i < H2_MAX_CONCURRENT_STREAMS; i++) {
+    if (session->streams[i] && session->streams[i]->id == streamId) {
+      return session->streams[i];
+    }
+  }
+  return NULL;
+}
+
+// Take a free slot and a pooled stream for it. Returns NULL if the session is full or out of memory.
+static H2Stream *openStream(H2Session *session, uint32_t streamId) {
+  for (size_t i = 0; i < H2_MAX_CONCURRENT_STREAMS; i++) {
+    if (session->streams[i]) continue;
+
+    H2Stream *stream = slabAlloc(&streamSlab);
+    if (!stream) return NULL;
+    memset(stream, 0, sizeof(*stream));
+    stream->id = streamId;
+    stream->state = STREAM_OPEN;
+    stream->slot = i;
+    stream->sendWindow = session->initialWindowSize;
+    stream->response.fd = -1;
+    session->streams[i] = stream;
+    session->activeStreams++;
+    return stream;
+  }
+  return NULL;
+}
+
+// Let the owner of a response body know it is no longer needed
+static void releaseResponse(HTTPResponse *response) {
+  if (response->releaseBody) response->releaseBody(response->bodyOwner);
+  response->releaseBody = NULL;
+  response->bodyOwner = NULL;
+}
+
+// Release a stream and its slot. The stream must not be used afterwards.
+static void closeStream(H2Session *session, H2Stream *stream) {
+  releaseResponse(&stream->response);
+  session->streams[stream->slot] = NULL;
+  session->activeStreams--;
+  slabFree(&streamSlab, stream);
+}
+
+// Queue the HEADERS frame for a stream's response and start sending its body
+static void startResponse(H2Session *session, H2Stream *stream) {
+  // Encode the response header block
+  uint8_t block[512];
+  size_t length = hpackEncodeStatus(block, sizeof(block), stream->response.status);
+
+  char contentLength[32];
+  snprintf(contentLength, sizeof(contentLength), "%zu", stream->response.bodyLength);
+  length += hpackEncodeHeader(block + length, sizeof(block) - length,
+                              "content-type", stream->response.contentType);
+  length += hpackEncodeHeader(block + length, sizeof(block) - length,
+                              "content-length", contentLength);
+  if (stream->response.headerName) {
+    length += hpackEncodeHeader(block + length, sizeof(block) - length,
+                                stream->response.headerName, stream->response.headerValue);
+  }
+
+  TRACE_PROBE3(send_start, session->traceId, stream->id, stream->response.status);
+  int endStream = stream->response.bodyLength == 0;
+  writeFrameHeader(session, length, FRAME_HEADERS,
+                   FLAG_END_HEADERS | (endStream ? FLAG_END_STREAM : 0), stream->id);
+  appendOutput(session, block, length);
+
+  if (endStream) {
+    TRACE_PROBE3(send_end, session->traceId, stream->id, 0);
+    closeStream(session, stream);
+  } else {
+    stream->state = STREAM_RESPONDING;
+  }
+}
+
+// Run the request handler and queue the response, unless the handler defers it
+static void dispatchRequest(H2Session *session, H2Stream *stream) {
+  if (stream->malformed || !stream->hasMethod || !stream->hasPath) {
+    sendRstStream(session, stream->id, ERROR_PROTOCOL);
+    closeStream(session, stream);
+    return;
+  }
+
+  printf("[*] HTTP/2 stream %u: %s %s\n", stream->id, stream->request.method, stream->request.path);
+  stream->state = STREAM_WAITING;
+  if (session->handler(session->handlerContext, stream->id, &stream->request,
+                       &stream->response) == H2_RESPONSE_PENDING) {
+    return;
+  }
+
+  startResponse(session, stream);
+}
+
+// ==== Header blocks ====
+
+static void collectHeader(void *userData, const char *name, size_t nameLen,
+                          const char *value, size_t valueLen) {
+  H2Stream *stream = userData;
+  if (!stream) return;  // Decoding only to keep the HPACK table in sync
+
+  if (nameLen == 7 && memcmp(name, ":method", 7) == 0) {
+    if (valueLen >= MAX_METHOD_LEN) {
+      stream->malformed = 1;
+      return;
+    }
+    memcpy(stream->request.method, value, valueLen);
+    stream->request.method[valueLen] = '\0';
+    stream->hasMethod = 1;
+  } else if (nameLen == 5 && memcmp(name, ":path", 5) == 0) {
+    if (valueLen >= MAX_PATH_LEN) {
+      stream->malformed = 1;
+      return;
+    }
+    memcpy(stream->request.path, value, valueLen);
+    stream->request.path[valueLen] = '\0';
+    stream->hasPath = 1;
+  } else if (nameLen == 13 && memcmp(name, "authorization", 13) == 0) {
+    // Too long to be ours: treated as no credentials
+    if (valueLen < MAX_AUTHORIZATION_LEN) {
+      memcpy(stream->request.authorization, value, valueLen);
+      stream->request.authorization[valueLen] = '\0';
+    }
+  }
+}
+
+// Handle a complete header block once END_HEADERS has been seen
+static int finishHeaderBlock(H2Session *session) {
+  uint32_t streamId = session->headerStreamId;
+  int endStream = session->headerEndStream;
+  H2Stream *stream = findStream(session, streamId);
+  int isTrailer = stream != NULL;
+
+  if (!stream) {
+    // A new stream must use a higher identifier than any before it
+    if (streamId <= session->lastStreamId) {
+      return connectionError(session, ERROR_STREAM_CLOSED);
+    }
+    session->lastStreamId = streamId;
+
+    if (!session->goingAway) {
+      stream = openStream(session, streamId);
+    }
+  } else if (stream->state != STREAM_OPEN || !endStream) {
+    // Trailers must end the stream, and only while it is still receiving
+    return connectionError(session, ERROR_PROTOCOL);
+  }
+
+  // The block is always decoded, even for refused streams, to keep the table in sync
+  int rc = hpackDecode(&session->decoder, session->headerBlock, session->headerBlockLength,
+                       collectHeader, isTrailer ? NULL : stream);
+  session->headerBlockLength = 0;
+  session->headerStreamId = 0;
+  if (rc != 0) {
+    return connectionError(session, ERROR_COMPRESSION);
+  }
+
+  if (!stream) {
+    if (!session->goingAway) {
+      sendRstStream(session, streamId, ERROR_REFUSED_STREAM);
+    }
+    return 0;
+  }
+
+  if (endStream) {
+    dispatchRequest(session, stream);
+  }
+  return 0;
+}
+
+static int appendHeaderFragment(H2Session *session, const uint8_t *fragment, size_t length) {
+  if (session->headerBlockLength + length > MAX_HEADER_BLOCK) {
+    return connectionError(session, ERROR_PROTOCOL);
+  }
+
+  uint8_t *grown = realloc(session->headerBlock, session->headerBlockLength + length + 1);
+  if (!grown) return connectionError(session, ERROR_INTERNAL);
+
+  session->headerBlock = grown;
+  memcpy(session->headerBlock + session->headerBlockLength, fragment, length);
+  session->headerBlockLength += length;
+  return 0;
+}
+
+// Remove padding from a PADDED frame payload. Returns -1 if the padding is invalid.
+static int stripPadding(uint8_t flags, const uint8_t **payload, size_t *length) {
+  if (!(flags & FLAG_PADDED)) return 0;
+  if (*length < 1) return -1;
+
+  size_t padLength = (*payload)[0];
+  if (padLength >= *length) return -1;
+
+  *payload += 1;
+  *length -= 1 + padLength;
+  return 0;
+}
+
+// ==== Frame handlers ====
+
+static int handleData(H2Session *session, uint8_t flags, uint32_t streamId,
+                      const uint8_t *payload, size_t length) {
+  if (streamId == 0) return connectionError(session, ERROR_PROTOCOL);
+  if (streamId > session->lastStreamId) return connectionError(session, ERROR_PROTOCOL);
+
+  // Return the whole frame (including padding) to the connection window right away
+  size_t frameLength = length;
+  if (stripPadding(flags, &payload, &length) != 0) {
+    return connectionError(session, ERROR_PROTOCOL);
+  }
+  if (frameLength > 0) {
+    sendWindowUpdate(session, 0, (uint32_t)frameLength);
+  }
+
+  H2Stream *stream = findStream(session, streamId);
+  if (!stream || stream->state != STREAM_OPEN) {
+    sendRstStream(session, streamId, ERROR_STREAM_CLOSED);
+    return 0;
+  }
+
+  // Request bodies are not used, but the stream window is still replenished
+  if (frameLength > 0 && !(flags & FLAG_END_STREAM)) {
+    sendWindowUpdate(session, streamId, (uint32_t)frameLength);
+  }
+
+  if (flags & FLAG_END_STREAM) {
+    dispatchRequest(session, stream);
+  }
+  return 0;
+}
+
+static int handleHeaders(H2Session *session, uint8_t flags, uint32_t streamId,
+                         const uint8_t *payload, size_t length) {
+  if (streamId == 0 || (streamId % 2) == 0) {
+    return connectionError(session, ERROR_PROTOCOL);
+  }
+
+  if (stripPadding(flags, &payload, &length) != 0) {
+    return connectionError(session, ERROR_PROTOCOL);
+  }
+
+  // Priority information is accepted but not used for scheduling
+  if (flags & FLAG_PRIORITY) {
+    if (length < 5) return connectionError(session, ERROR_FRAME_SIZE);
+    payload += 5;
+    length -= 5;
+  }
+
+  session->headerStreamId = streamId;
+  session->headerEndStream = (flags & FLAG_END_STREAM) != 0;
+  session->headerBlockLength = 0;
+  if (appendHeaderFragment(session, payload, length) != 0) return -1;
+
+  if (flags & FLAG_END_HEADERS) {
+    return finishHeaderBlock(session);
+  }
+  return 0;
+}
+
+static int handleContinuation(H2Session *session, uint8_t flags, uint32_t streamId,
+                              const uint8_t *payload, size_t length) {
+  if (session->headerStreamId == 0 || streamId != session->headerStreamId) {
+    return connectionError(session, ERROR_PROTOCOL);
+  }
+
+  if (appendHeaderFragment(session, payload, length) != 0) return -1;
+
+  if (flags & FLAG_END_HEADERS) {
+    return finishHeaderBlock(session);
+  }
+  return 0;
+}
+
+static int handleSettings(H2Session *session, uint8_t flags, uint32_t streamId,
+                          const uint8_t *payload, size_t length) {
+  if (streamId != 0) return connectionError(session, ERROR_PROTOCOL);
+
+  if (flags & FLAG_ACK) {
+    if (length != 0) return connectionError(session, ERROR_FRAME_SIZE);
+    return 0;
+  }
+
+  if (length % 6 != 0) return connectionError(session, ERROR_FRAME_SIZE);
+
+  for (size_t offset = 0; offset < length; offset += 6) {
+    uint16_t identifier = (uint16_t)((payload[offset] << 8) | payload[offset + 1]);
+    uint32_t value = readUint32(payload + offset + 2);
+
+    switch (identifier) {
+      case SETTINGS_ENABLE_PUSH:
+        if (value > 1) return connectionError(session, ERROR_PROTOCOL);
+        break;
+
+      case SETTINGS_INITIAL_WINDOW_SIZE: {
+        if (value > MAX_WINDOW_SIZE) return connectionError(session, ERROR_FLOW_CONTROL);
+
+        // Apply the change to every open stream (RFC 7540 section 6.9.2)
+        int64_t delta = (int64_t)value - session->initialWindowSize;
+        for (size_t i = 0; i < H2_MAX_CONCURRENT_STREAMS; i++) {
+          H2Stream *stream = session->streams[i];
+          if (!stream) continue;
+          stream->sendWindow += delta;
+          if (stream->sendWindow > MAX_WINDOW_SIZE) {
+            return connectionError(session, ERROR_FLOW_CONTROL);
+          }
+        }
+        session->initialWindowSize = value;
+        break;
+      }
+
+      case SETTINGS_MAX_FRAME_SIZE:
+        if (value < 16384 || value > 16777215) return connectionError(session, ERROR_PROTOCOL);
+        session->peerMaxFrameSize = value;
+        break;
+
+      default:
+        // Header table size only affects an encoder dynamic table, which we do not use.
+        // Unknown settings must be ignored.
+        break;
+    }
+  }
+
+  session->settingsReceived = 1;
+  return writeFrameHeader(session, 0, FRAME_SETTINGS, FLAG_ACK, 0);
+}
+
+static int handleWindowUpdate(H2Session *session, uint32_t streamId,
+                              const uint8_t *payload, size_t length) {
+  if (length != 4) return connectionError(session, ERROR_FRAME_SIZE);
+
+  uint32_t increment = readUint32(payload) & MAX_WINDOW_SIZE;
+
+  if (streamId == 0) {
+    if (increment == 0) return connectionError(session, ERROR_PROTOCOL);
+    session->connectionSendWindow += increment;
+    if (session->connectionSendWindow > MAX_WINDOW_SIZE) {
+      return connectionError(session, ERROR_FLOW_CONTROL);
+    }
+    return 0;
+  }
+
+  H2Stream *stream = findStream(session, streamId);
+  if (!stream) return 0;  // Updates may race with a stream we already closed
+
+  if (increment == 0) {
+    sendRstStream(session, streamId, ERROR_PROTOCOL);
+    closeStream(session, stream);
+    return 0;
+  }
+
+  stream->sendWindow += increment;
+  if (stream->sendWindow > MAX_WINDOW_SIZE) {
+    sendRstStream(session, streamId, ERROR_FLOW_CONTROL);
+    closeStream(session, stream);
+  }
+  return 0;
+}
+
+static int processFrame(H2Session *session, uint8_t type, uint8_t flags, uint32_t streamId,
+                        const uint8_t *payload, size_t length) {
+  // A header block must be continued without any interleaved frames
+  if (session->headerStreamId != 0 && type != FRAME_CONTINUATION) {
+    return connectionError(session, ERROR_PROTOCOL);
+  }
+
+  // The client preface must be followed by a SETTINGS frame
+  if (!session->settingsReceived && type != FRAME_SETTINGS) {
+    return connectionError(session, ERROR_PROTOCOL);
+  }
+
+  switch (type) {
+    case FRAME_DATA:
+      return handleData(session, flags, streamId, payload, length);
+
+    case FRAME_HEADERS:
+      return handleHeaders(session, flags, streamId, payload, length);
+
+    case FRAME_PRIORITY:
+      if (streamId == 0) return connectionError(session, ERROR_PROTOCOL);
+      if (length != 5) sendRstStream(session, streamId, ERROR_FRAME_SIZE);
+      return 0;
+
+    case FRAME_RST_STREAM: {
+      if (streamId == 0 || streamId > session->lastStreamId) {
+        return connectionError(session, ERROR_PROTOCOL);
+      }
+      if (length != 4) return connectionError(session, ERROR_FRAME_SIZE);
+      H2Stream *stream = findStream(session, streamId);
+      if (stream) closeStream(session, stream);
+      return 0;
+    }
+
+    case FRAME_SETTINGS:
+      return handleSettings(session, flags, streamId, payload, length);
+
+    case FRAME_PUSH_PROMISE:
+      // Clients never push
+      return connectionError(session, ERROR_PROTOCOL);
+
+    case FRAME_PING:
+      if (streamId != 0) return connectionError(session, ERROR_PROTOCOL);
+      if (length != 8) return connectionError(session, ERROR_FRAME_SIZE);
+      if (!(flags & FLAG_ACK)) {
+        writeFrameHeader(session, 8, FRAME_PING, FLAG_ACK, 0);
+        appendOutput(session, payload, 8);
+      }
+      return 0;
+
+    case FRAME_GOAWAY:
+      if (streamId != 0) return connectionError(session, ERROR_PROTOCOL);
+      // Finish the streams already in progress, then close
+      session->goingAway = 1;
+      return 0;
+
+    case FRAME_WINDOW_UPDATE:
+      return handleWindowUpdate(session, streamId, payload, length);
+
+    case FRAME_CONTINUATION:
+      return handleContinuation(session, flags, streamId, payload, length);
+
+    default:
+      // Unknown frame types must be ignored
+      return 0;
+  }
+}
+
+// ==== Public interface ====
+
+H2Session *h2NewSession(H2RequestHandler handler, void *context, uint64_t traceId) {
+  H2Session *session = calloc(1, sizeof(H2Session));
+  if (!session) return NULL;
+
+  if (hpackInitTable(&session->decoder, HPACK_DEFAULT_TABLE_SIZE) != 0) {
+    free(session);
+    return NULL;
+  }
+
+  session->handler = handler;
+  session->handlerContext = context;
+  session->traceId = traceId;
+  session->connectionSendWindow = H2_DEFAULT_WINDOW_SIZE;
+  session->initialWindowSize = H2_DEFAULT_WINDOW_SIZE;
+  session->peerMaxFrameSize = H2_DEFAULT_FRAME_SIZE;
+
+  // Server preface: our SETTINGS, limiting concurrent streams
+  uint8_t settings[6] = { 0, SETTINGS_MAX_CONCURRENT_STREAMS, 0, 0, 0, 0 };
+  writeUint32(settings + 2, H2_MAX_CONCURRENT_STREAMS);
+  writeFrameHeader(session, sizeof(settings), FRAME_SETTINGS, 0, 0);
+  appendOutput(session, settings, sizeof(settings));
+
+  return session;
+}
+
+void h2FreeSession(H2Session *session) {
+  if (!session) return;
+
+  for (size_t i = 0; i < H2_MAX_CONCURRENT_STREAMS; i++) {
+    if (session->streams[i]) closeStream(session, session->streams[i]);
+  }
+
+  hpackFreeTable(&session->decoder);
+  free(session->headerBlock);
+  free(session->input);
+  free(session->output);
+  free(session);
+}
+
+int h2Feed(H2Session *session, const uint8_t *data, size_t length) {
+  if (session->failed) return -1;
+
+  // Buffer the new bytes behind any partial frame left from the last call
+  if (session->inputLength + length > session->inputCapacity) {
+    size_t capacity = session->inputLength + length;
+    uint8_t *grown = realloc(session->input, capacity);
+    if (!grown) return connectionError(session, ERROR_INTERNAL);
+    session->input = grown;
+    session->inputCapacity = capacity;
+  }
+  memcpy(session->input + session->inputLength, data, length);
+  session->inputLength += length;
+
+  size_t offset = 0;
+
+  // Validate the client connection preface
+  if (!session->prefaceReceived) {
+    if (session->inputLength < CLIENT_PREFACE_LEN) return 0;
+    if (memcmp(session->input, clientPreface, CLIENT_PREFACE_LEN) != 0) {
+      return connectionError(session, ERROR_PROTOCOL);
+    }
+    session->prefaceReceived = 1;
+    offset = CLIENT_PREFACE_LEN;
+  }
+
+  // Process every complete frame in the buffer
+  while (session->inputLength - offset >= FRAME_HEADER_SIZE) {
+    const uint8_t *frame = session->input + offset;
+    size_t frameLength = ((size_t)frame[0] << 16) | ((size_t)frame[1] << 8) | frame[2];
+
+    if (frameLength > H2_DEFAULT_FRAME_SIZE) {
+      return connectionError(session, ERROR_FRAME_SIZE);
+    }
+    if (session->inputLength - offset < FRAME_HEADER_SIZE + frameLength) break;
+
+    uint32_t streamId = readUint32(frame + 5) & MAX_WINDOW_SIZE;
+    if (processFrame(session, frame[3], frame[4], streamId,
+                     frame + FRAME_HEADER_SIZE, frameLength) != 0) {
+      return -1;
+    }
+    offset += FRAME_HEADER_SIZE + frameLength;
+  }
+
+  // Keep only the trailing partial frame, releasing the buffer when nothing is left
+  memmove(session->input, session->input + offset, session->inputLength - offset);
+  session->inputLength -= offset;
+  if (session->inputLength == 0) {
+    free(session->input);
+    session->input = NULL;
+    session->inputCapacity = 0;
+  }
+  return 0;
+}
+
+int h2ProduceOutput(H2Session *session) {
+  int progress = 1;
+
+  // Round-robin one DATA frame per stream per pass so streams are multiplexed fairly
+  while (progress && session->connectionSendWindow > 0) {
+    progress = 0;
+    size_t firstSlot = session->roundRobin;
+
+    for (size_t n = 0; n < H2_MAX_CONCURRENT_STREAMS; n++) {
+      if (session->outputLength - session->outputStart >= H2_OUTPUT_HIGH_WATER) return 1;
+
+      size_t slot = (firstSlot + n) % H2_MAX_CONCURRENT_STREAMS;
+      H2Stream *stream = session->streams[slot];
+      if (!stream || stream->state != STREAM_RESPONDING || stream->sendWindow <= 0) continue;
+
+      // Size the frame by the remaining body and both windows. Frames are kept at the
+      // default size even if the peer allows more, so output stays in small steps.
+      size_t chunk = stream->response.bodyLength - stream->bodySent;
+      if (chunk > H2_DEFAULT_FRAME_SIZE) chunk = H2_DEFAULT_FRAME_SIZE;
+      if ((int64_t)chunk > stream->sendWindow) chunk = (size_t)stream->sendWindow;
+      if ((int64_t)chunk > session->connectionSendWindow) chunk = (size_t)session->connectionSendWindow;
+      if (chunk == 0) continue;
+
+      // Copy the payload straight into the output buffer, after room for the frame header
+      uint8_t *frame = reserveOutput(session, FRAME_HEADER_SIZE + chunk);
+      if (!frame) return 0;
+      uint8_t *payload = frame + FRAME_HEADER_SIZE;
+
+      if (stream->response.fd >= 0) {
+        ssize_t bytesRead = pread(stream->response.fd, payload, chunk, (off_t)stream->bodySent);
+        if (bytesRead <= 0) {
+          sendRstStream(session, stream->id, ERROR_INTERNAL);
+          closeStream(session, stream);
+          continue;
+        }
+        chunk = (size_t)bytesRead;
+      } else {
+        memcpy(payload, stream->response.body + stream->bodySent, chunk);
+      }
+
+      int endStream = stream->bodySent + chunk == stream->response.bodyLength;
+      writeFrameHeader(session, chunk, FRAME_DATA, endStream ? FLAG_END_STREAM : 0, stream->id);
+      session->outputLength += chunk;
+
+      stream->bodySent += chunk;
+      stream->sendWindow -= chunk;
+      session->connectionSendWindow -= chunk;
+      session->roundRobin = slot + 1;
+      progress = 1;
+
+      if (endStream) {
+        TRACE_PROBE3(send_end, session->traceId, stream->id, stream->bodySent);
+        closeStream(session, stream);
+      }
+      if (session->connectionSendWindow <= 0) break;
+    }
+  }
+
+  return 0;
+}
+
+const uint8_t *h2PendingOutput(H2Session *session, size_t *length) {
+  *length = session->outputLength - session->outputStart;
+  return session->output + session->outputStart;
+}
+
+void h2ConsumeOutput(H2Session *session, size_t length) {
+  session->outputStart += length;
+  if (session->outputStart >= session->outputLength) {
+    session->outputStart = 0;
+    session->outputLength = 0;
+
+    // Release the output buffer while the connection is idle
+    if (session->activeStreams == 0) {
+      free(session->output);
+      session->output = NULL;
+      session->outputCapacity = 0;
+    }
+  }
+}
+
+int h2IsFinished(H2Session *session) {
+  int done = session->failed || (session->goingAway && session->activeStreams == 0);
+  return done && session->outputLength == session->outputStart;
+}
+
+void h2SubmitResponse(H2Session *session, uint32_t streamId, const HTTPResponse *response) {
+  H2Stream *stream = findStream(session, streamId);
+  if (!stream || stream->state != STREAM_WAITING) {
+    // Reset by the peer while the response was being prepared
+    HTTPResponse dropped = *response;
+    releaseResponse(&dropped);
+    return;
+  }
+
+  stream->response = *response;
+  startResponse(session, stream);
+}
+
+int h2HasActiveStreams(H2Session *session) {
+  return session->activeStreams > 0;
+}
+
+void h2GoAway(H2Session *session) {
+  if (session->goingAway) return;
+
+  // Streams already started run to completion; the peer retries anything newer elsewhere
+  uint8_t payload[8];
+  writeUint32(payload, session->lastStreamId);
+  writeUint32(payload + 4, ERROR_NONE);
+  writeFrameHeader(session, sizeof(payload), FRAME_GOAWAY, 0, 0);
+  appendOutput(session, payload, sizeof(payload));
+  session->goingAway = 1;
+}
@@ -0,0 +1,61 @@
+// h2.h - HTTP/2 framing, stream multiplexing and flow control (RFC 7540)
+#ifndef H2_H
+#define H2_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parser.h"
+
+#define H2_MAX_CONCURRENT_STREAMS 100  // Streams a client may have open at once
+#define H2_DEFAULT_WINDOW_SIZE 65535   // Initial flow-control window (RFC 7540 section 6.9.2)
+#define H2_DEFAULT_FRAME_SIZE 16384    // Largest frame payload we accept
+#define H2_OUTPUT_HIGH_WATER 65536     // Stop scheduling DATA once this much output is queued
+
+#define H2_RESPONSE_PENDING 1           // Handler result: response follows via h2SubmitResponse
+
+// Build the response for one request. Returns 0 with the response filled in, or
+// H2_RESPONSE_PENDING if it will be supplied later with h2SubmitResponse.
+typedef int (*H2RequestHandler)(void *context, uint32_t streamId,
+                                const HTTPRequest *request, HTTPResponse *response);
+
+// State of one HTTP/2 connection. Transport-agnostic: bytes go in through
+// h2Feed and frames come out through h2PendingOutput.
+typedef struct H2Session H2Session;
+
+// Create a session and queue the server connection preface (SETTINGS).
+// context is passed to the handler with every request; traceId identifies the
+// connection in the stream probes.
+H2Session *h2NewSession(H2RequestHandler handler, void *context, uint64_t traceId);
+
+// Release a session and any responses still in flight
+void h2FreeSession(H2Session *session);
+
+// Process received bytes. Returns 0 on success or -1 after a connection error
+// (a GOAWAY is queued and the session will finish once it is flushed).
+int h2Feed(H2Session *session, const uint8_t *data, size_t length);
+
+// Schedule DATA frames across streams as flow-control windows allow.
+// Returns 1 if it stopped early because the output buffer is full.
+int h2ProduceOutput(H2Session *session);
+
+// Get the queued output bytes that still need to be written to the peer
+const uint8_t *h2PendingOutput(H2Session *session, size_t *length);
+
+// Mark length bytes of queued output as written
+void h2ConsumeOutput(H2Session *session, size_t length);
+
+// Whether the connection is done and all output has been flushed
+int h2IsFinished(H2Session *session);
+
+// Supply the response for a request the handler left pending. If the stream
+// was reset in the meantime the response is released and dropped.
+void h2SubmitResponse(H2Session *session, uint32_t streamId, const HTTPResponse *response);
+
+// Whether any stream still has a request or response in progress
+int h2HasActiveStreams(H2Session *session);
+
+// Queue a graceful GOAWAY: streams in progress finish, new ones are refused
+void h2GoAway(H2Session *session);
+
+#endif // H2_H
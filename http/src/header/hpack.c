@@ -0,0 +1,539 @@
+// hpack.c - Implementation of HPACK header compression (RFC 7541)
+#include "hpack.h"
+
+#include <stdlib.h>   // For malloc, calloc, free
+#include <string.h>   // For memcpy, strlen, strcmp
+#include <stdio.h>    // For snprintf
+#include <pthread.h>  // For pthread_once
+
+// Predefined header table shared by every connection (RFC 7541 Appendix A)
+typedef struct {
+  const char *name;
+  const char *value;
+} HPACKHeader;
+
+static const HPACKHeader staticTable[HPACK_STATIC_ENTRIES] = {
+  { ":authority", "" },
+  { ":method", "GET" },
+  { ":method", "POST" },
+  { ":path", "/" },
+  { ":path", "/index.html" },
+  { ":scheme", "http" },
+  { ":scheme", "https" },
+  { ":status", "200" },
+  { ":status", "204" },
+  { ":status", "206" },
+  { ":status", "304" },
+  { ":status", "400" },
+  { ":status", "404" },
+  { ":status", "500" },
+  { "accept-charset", "" },
+  { "accept-encoding", "gzip, deflate" },
+  { "accept-language", "" },
+  { "accept-ranges", "" },
+  { "accept", "" },
+  { "access-control-allow-origin", "" },
+  { "age", "" },
+  { "allow", "" },
+  { "authorization", "" },
+  { "cache-control", "" },
+  { "content-disposition", "" },
+  { "content-encoding", "" },
+  { "content-language", "" },
+  { "content-length", "" },
+  { "content-location", "" },
+  { "content-range", "" },
+  { "content-type", "" },
+  { "cookie", "" },
+  { "date", "" },
+  { "etag", "" },
+  { "expect", "" },
+  { "expires", "" },
+  { "from", "" },
+  { "host", "" },
+  { "if-match", "" },
+  { "if-modified-since", "" },
+  { "if-none-match", "" },
+  { "if-range", "" },
+  { "if-unmodified-since", "" },
+  { "last-modified", "" },
+  { "link", "" },
+  { "location", "" },
+  { "max-forwards", "" },
+  { "proxy-authenticate", "" },
+  { "proxy-authorization", "" },
+  { "range", "" },
+  { "referer", "" },
+  { "refresh", "" },
+  { "retry-after", "" },
+  { "server", "" },
+  { "set-cookie", "" },
+  { "strict-transport-security", "" },
+  { "transfer-encoding", "" },
+  { "user-agent", "" },
+  { "vary", "" },
+  { "via", "" },
+  { "www-authenticate", "" },
+};
+
+// Canonical Huffman code used for string literals (RFC 7541 Appendix B).
+// Symbol 256 is EOS, which must never appear in decoded output.
+static const uint32_t huffmanCodes[257] = {
+  0x00001ff8, 0x007fffd8, 0x0fffffe2, 0x0fffffe3, 0x0fffffe4, 0x0fffffe5, 0x0fffffe6, 0x0fffffe7,
+  0x0fffffe8, 0x00ffffea, 0x3ffffffc, 0x0fffffe9, 0x0fffffea, 0x3ffffffd, 0x0fffffeb, 0x0fffffec,
+  0x0fffffed, 0x0fffffee, 0x0fffffef, 0x0ffffff0, 0x0ffffff1, 0x0ffffff2, 0x3ffffffe, 0x0ffffff3,
+  0x0ffffff4, 0x0ffffff5, 0x0ffffff6, 0x0ffffff7, 0x0ffffff8, 0x0ffffff9, 0x0ffffffa, 0x0ffffffb,
+  0x00000014, 0x000003f8, 0x000003f9, 0x00000ffa, 0x00001ff9, 0x00000015, 0x000000f8, 0x000007fa,
+  0x000003fa, 0x000003fb, 0x000000f9, 0x000007fb, 0x000000fa, 0x00000016, 0x00000017, 0x00000018,
+  0x00000000, 0x00000001, 0x00000002, 0x00000019, 0x0000001a, 0x0000001b, 0x0000001c, 0x0000001d,
+  0x0000001e, 0x0000001f, 0x0000005c, 0x000000fb, 0x00007ffc, 0x00000020, 0x00000ffb, 0x000003fc,
+  0x00001ffa, 0x00000021, 0x0000005d, 0x0000005e, 0x0000005f, 0x00000060, 0x00000061, 0x00000062,
+  0x00000063, 0x00000064, 0x00000065, 0x00000066, 0x00000067, 0x00000068, 0x00000069, 0x0000006a,
+  0x0000006b, 0x0000006c, 0x0000006d, 0x0000006e, 0x0000006f, 0x00000070, 0x00000071, 0x00000072,
+  0x000000fc, 0x00000073, 0x000000fd, 0x00001ffb, 0x0007fff0, 0x00001ffc, 0x00003ffc, 0x00000022,
+  0x00007ffd, 0x00000003, 0x00000023, 0x00000004, 0x00000024, 0x00000005, 0x00000025, 0x00000026,
+  0x00000027, 0x00000006, 0x00000074, 0x00000075, 0x00000028, 0x00000029, 0x0000002a, 0x00000007,
+  0x0000002b, 0x00000076, 0x0000002c, 0x00000008, 0x00000009, 0x0000002d, 0x00000077, 0x00000078,
+  0x00000079, 0x0000007a, 0x0000007b, 0x00007ffe, 0x000007fc, 0x00003ffd, 0x00001ffd, 0x0ffffffc,
+  0x000fffe6, 0x003fffd2, 0x000fffe7, 0x000fffe8, 0x003fffd3, 0x003fffd4, 0x003fffd5, 0x007fffd9,
+  0x003fffd6, 0x007fffda, 0x007fffdb, 0x007fffdc, 0x007fffdd, 0x007fffde, 0x00ffffeb, 0x007fffdf,
+  0x00ffffec, 0x00ffffed, 0x003fffd7, 0x007fffe0, 0x00ffffee, 0x007fffe1, 0x007fffe2, 0x007fffe3,
+  0x007fffe4, 0x001fffdc, 0x003fffd8, 0x007fffe5, 0x003fffd9, 0x007fffe6, 0x007fffe7, 0x00ffffef,
+  0x003fffda, 0x001fffdd, 0x000fffe9, 0x003fffdb, 0x003fffdc, 0x007fffe8, 0x007fffe9, 0x001fffde,
+  0x007fffea, 0x003fffdd, 0x003fffde, 0x00fffff0, 0x001fffdf, 0x003fffdf, 0x007fffeb, 0x007fffec,
+  0x001fffe0, 0x001fffe1, 0x003fffe0, 0x001fffe2, 0x007fffed, 0x003fffe1, 0x007fffee, 0x007fffef,
+  0x000fffea, 0x003fffe2, 0x003fffe3, 0x003fffe4, 0x007ffff0, 0x003fffe5, 0x003fffe6, 0x007ffff1,
+  0x03ffffe0, 0x03ffffe1, 0x000fffeb, 0x0007fff1, 0x003fffe7, 0x007ffff2, 0x003fffe8, 0x01ffffec,
+  0x03ffffe2, 0x03ffffe3, 0x03ffffe4, 0x07ffffde, 0x07ffffdf, 0x03ffffe5, 0x00fffff1, 0x01ffffed,
+  0x0007fff2, 0x001fffe3, 0x03ffffe6, 0x07ffffe0, 0x07ffffe1, 0x03ffffe7, 0x07ffffe2, 0x00fffff2,
+  0x001fffe4, 0x001fffe5, 0x03ffffe8, 0x03ffffe9, 0x0ffffffd, 0x07ffffe3, 0x07ffffe4, 0x07ffffe5,
+  0x000fffec, 0x00fffff3, 0x000fffed, 0x001fffe6, 0x003fffe9, 0x001fffe7, 0x001fffe8, 0x007ffff3,
+  0x003fffea, 0x003fffeb, 0x01ffffee, 0x01ffffef, 0x00fffff4, 0x00fffff5, 0x03ffffea, 0x007ffff4,
+  0x03ffffeb, 0x07ffffe6, 0x03ffffec, 0x03ffffed, 0x07ffffe7, 0x07ffffe8, 0x07ffffe9, 0x07ffffea,
+  0x07ffffeb, 0x0ffffffe, 0x07ffffec, 0x07ffffed, 0x07ffffee, 0x07ffffef, 0x07fffff0, 0x03ffffee,
+  0x3fffffff,
+};
+
+static const uint8_t huffmanLengths[257] = {
+  13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+  28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+   6, 10, 10, 12, 13,  6,  8, 11, 10, 10,  8, 11,  8,  6,  6,  6,
+   5,  5,  5,  6,  6,  6,  6,  6,  6,  6,  7,  8, 15,  6, 12, 10,
+  13,  6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,
+   7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  8, 13, 19, 13, 14,  6,
+  15,  5,  6,  5,  6,  5,  6,  6,  6,  5,  7,  7,  6,  6,  6,  5,
+   6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7, 15, 11, 14, 13, 28,
+  20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+  24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+  22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+  21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+  26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+  19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+  20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+  26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+  30,
+};
+
+// Binary decoding tree built from the code table on first use.
+// A child value > 0 is an internal node, < 0 is a leaf holding -(symbol + 1).
+static int16_t huffmanTree[256][2];
+static pthread_once_t huffmanTreeOnce = PTHREAD_ONCE_INIT;
+
+static void buildHuffmanTree(void) {
+  int nextNode = 1;  // Node 0 is the root
+
+  for (int symbol = 0; symbol < 257; symbol++) {
+    uint32_t code = huffmanCodes[symbol];
+    int length = huffmanLengths[symbol];
+    int node = 0;
+
+    // Walk (and create) internal nodes for every bit but the last
+    for (int bit = length - 1; bit > 0; bit--) {
+      int branch = (code >> bit) & 1;
+      if (huffmanTree[node][branch] == 0) {
+        huffmanTree[node][branch] = nextNode++;
+      }
+      node = huffmanTree[node][branch];
+    }
+
+    // The final bit selects the leaf
+    huffmanTree[node][code & 1] = -(symbol + 1);
+  }
+}
+
+// Decode a Huffman-coded string into out, which holds outSize bytes.
+// Returns the decoded length, or -1 on error or if out is too small.
+static long huffmanDecode(const uint8_t *in, size_t length, char *out, size_t outSize) {
+  pthread_once(&huffmanTreeOnce, buildHuffmanTree);
+
+  long written = 0;
+  int node = 0;
+  int pendingBits = 0;  // Bits consumed since the last complete symbol
+  int allOnes = 1;      // Whether those bits were all 1 (a valid EOS prefix)
+
+  for (size_t i = 0; i < length; i++) {
+    for (int bit = 7; bit >= 0; bit--) {
+      int branch = (in[i] >> bit) & 1;
+      int next = huffmanTree[node][branch];
+
+      if (next < 0) {
+        int symbol = -next - 1;
+        if (symbol == 256) return -1;  // EOS inside a string is an error
+        if ((size_t)written >= outSize) return -1;
+        out[written++] = (char)symbol;
+        node = 0;
+        pendingBits = 0;
+        allOnes = 1;
+      } else {
+        node = next;
+        pendingBits++;
+        if (!branch) allOnes = 0;
+      }
+    }
+  }
+
+  // Padding must be shorter than a byte and consist of the most significant EOS bits
+  if (pendingBits > 7 || !allOnes) return -1;
+
+  return written;
+}
+
+// Number of bytes a string occupies once Huffman-coded
+static size_t huffmanEncodedLength(const char *in, size_t length) {
+  uint64_t bits = 0;
+  for (size_t i = 0; i < length; i++) {
+    bits += huffmanLengths[(uint8_t)in[i]];
+  }
+  return (bits + 7) / 8;
+}
+
+// Huffman-code a string into out, which must hold huffmanEncodedLength bytes
+static void huffmanEncode(const char *in, size_t length, uint8_t *out) {
+  uint64_t accumulator = 0;
+  int bits = 0;
+
+  for (size_t i = 0; i < length; i++) {
+    uint8_t symbol = (uint8_t)in[i];
+    accumulator = (accumulator << huffmanLengths[symbol]) | huffmanCodes[symbol];
+    bits += huffmanLengths[symbol];
+
+    while (bits >= 8) {
+      bits -= 8;
+      *out++ = (uint8_t)(accumulator >> bits);
+    }
+  }
+
+  // Pad the final byte with the most significant bits of EOS (all ones)
+  if (bits > 0) {
+    *out = (uint8_t)((accumulator << (8 - bits)) | (0xff >> bits));
+  }
+}
+
+// ==== Integer and string primitives ====
+
+// Decode an integer with an N-bit prefix (RFC 7541 section 5.1)
+static int decodeInteger(const uint8_t **pos, const uint8_t *end, int prefixBits, uint32_t *value) {
+  if (*pos >= end) return -1;
+
+  uint32_t prefixMax = (1u << prefixBits) - 1;
+  uint64_t result = **pos & prefixMax;
+  (*pos)++;
+
+  if (result < prefixMax) {
+    *value = (uint32_t)result;
+    return 0;
+  }
+
+  // Continuation bytes carry 7 bits each, least significant group first
+  for (int shift = 0; *pos < end && shift <= 28; shift += 7) {
+    uint8_t byte = **pos;
+    (*pos)++;
+    result += (uint64_t)(byte & 0x7f) << shift;
+
+    if (!(byte & 0x80)) {
+      if (result > UINT32_MAX) return -1;
+      *value = (uint32_t)result;
+      return 0;
+    }
+  }
+
+  return -1;  // Truncated or oversized integer
+}
+
+// Encode an integer with an N-bit prefix, OR-ing the given flag bits into the first byte
+static size_t encodeInteger(uint8_t *out, size_t outSize, int prefixBits, uint8_t flags, uint32_t value) {
+  uint32_t prefixMax = (1u << prefixBits) - 1;
+  size_t written = 0;
+
+  if (outSize == 0) return 0;
+
+  if (value < prefixMax) {
+    out[written++] = flags | (uint8_t)value;
+    return written;
+  }
+
+  out[written++] = flags | (uint8_t)prefixMax;
+  value -= prefixMax;
+
+  while (value >= 0x80) {
+    if (written >= outSize) return 0;
+    out[written++] = (uint8_t)((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+
+  if (written >= outSize) return 0;
+  out[written++] = (uint8_t)value;
+  return written;
+}
+
+// Decode a string literal, Huffman-decoding into scratch (scratchSize bytes) when needed
+static int decodeString(const uint8_t **pos, const uint8_t *end, char *scratch, size_t scratchSize,
+                        const char **string, size_t *stringLen) {
+  if (*pos >= end) return -1;
+
+  int huffman = (**pos & 0x80) != 0;
+  uint32_t length;
+  if (decodeInteger(pos, end, 7, &length) != 0) return -1;
+  if (length > (size_t)(end - *pos)) return -1;
+
+  if (huffman) {
+    long decoded = huffmanDecode(*pos, length, scratch, scratchSize);
+    if (decoded < 0) return -1;
+    *string = scratch;
+    *stringLen = (size_t)decoded;
+  } else {
+    *string = (const char *)*pos;
+    *stringLen = length;
+  }
+
+  *pos += length;
+  return 0;
+}
+
+// Encode a string literal, using the Huffman code only when it is shorter
+static size_t encodeString(uint8_t *out, size_t outSize, const char *string) {
+  size_t length = strlen(string);
+  size_t huffmanLength = huffmanEncodedLength(string, length);
+  int huffman = huffmanLength < length;
+  size_t payload = huffman ? huffmanLength : length;
+
+  size_t written = encodeInteger(out, outSize, 7, huffman ? 0x80 : 0x00, (uint32_t)payload);
+  if (written == 0 || written + payload > outSize) return 0;
+
+  if (huffman) {
+    huffmanEncode(string, length, out + written);
+  } else {
+    memcpy(out + written, string, length);
+  }
+
+  return written + payload;
+}
+
+// ==== Dynamic table ====
+
+int hpackInitTable(HPACKTable *table, size_t maxSize) {
+  memset(table, 0, sizeof(*table));
+
+  // Every entry costs at least the fixed overhead, which bounds the number of slots
+  table->capacity = maxSize / HPACK_ENTRY_OVERHEAD + 1;
+  table->entries = calloc(table->capacity, sizeof(HPACKEntry));
+  if (!table->entries) return -1;
+
+  table->maxSize = maxSize;
+  table->settingsMaxSize = maxSize;
+  return 0;
+}
+
+void hpackFreeTable(HPACKTable *table) {
+  for (size_t i = 0; i < table->count; i++) {
+    size_t slot = (table->head + table->capacity - 1 - i) % table->capacity;
+    free(table->entries[slot].name);  // Name and value share one allocation
+  }
+  free(table->entries);
+  table->entries = NULL;
+  table->count = 0;
+  table->size = 0;
+}
+
+// Drop the oldest entries until the table fits within limit bytes
+static void evictEntries(HPACKTable *table, size_t limit) {
+  while (table->count > 0 && table->size > limit) {
+    size_t oldest = (table->head + table->capacity - table->count) % table->capacity;
+    HPACKEntry *entry = &table->entries[oldest];
+    table->size -= entry->nameLen + entry->valueLen + HPACK_ENTRY_OVERHEAD;
+    free(entry->name);
+    entry->name = NULL;
+    table->count--;
+  }
+}
+
+// Insert a field at the front of the dynamic table. A field larger than the whole
+// table empties it instead. name may point into an entry that gets evicted, so it
+// must not be used afterwards. Returns 0 on success, -1 if out of memory.
+static int insertEntry(HPACKTable *table, const char *name, size_t nameLen,
+                       const char *value, size_t valueLen) {
+  size_t entrySize = nameLen + valueLen + HPACK_ENTRY_OVERHEAD;
+
+  if (entrySize > table->maxSize) {
+    evictEntries(table, 0);
+    return 0;
+  }
+
+  // Copy before evicting, since name may point into an entry about to be dropped
+  char *storage = malloc(nameLen + valueLen + 2);
+  if (!storage) return -1;
+  memcpy(storage, name, nameLen);
+  storage[nameLen] = '\0';
+  memcpy(storage + nameLen + 1, value, valueLen);
+  storage[nameLen + 1 + valueLen] = '\0';
+
+  evictEntries(table, table->maxSize - entrySize);
+
+  HPACKEntry *entry = &table->entries[table->head];
+  entry->name = storage;
+  entry->nameLen = nameLen;
+  entry->value = storage + nameLen + 1;
+  entry->valueLen = valueLen;
+
+  table->head = (table->head + 1) % table->capacity;
+  table->count++;
+  table->size += entrySize;
+  return 0;
+}
+
+// Resolve a 1-based index across the static and dynamic tables
+static int lookupIndex(HPACKTable *table, uint32_t index,
+                       const char **name, size_t *nameLen,
+                       const char **value, size_t *valueLen) {
+  if (index == 0) return -1;
+
+  if (index <= HPACK_STATIC_ENTRIES) {
+    const HPACKHeader *header = &staticTable[index - 1];
+    *name = header->name;
+    *nameLen = strlen(header->name);
+    *value = header->value;
+    *valueLen = strlen(header->value);
+    return 0;
+  }
+
+  size_t dynamicIndex = index - HPACK_STATIC_ENTRIES - 1;
+  if (dynamicIndex >= table->count) return -1;
+
+  HPACKEntry *entry = &table->entries[(table->head + table->capacity - 1 - dynamicIndex) % table->capacity];
+  *name = entry->name;
+  *nameLen = entry->nameLen;
+  *value = entry->value;
+  *valueLen = entry->valueLen;
+  return 0;
+}
+
+// ==== Decoder ====
+
+int hpackDecode(HPACKTable *table, const uint8_t *block, size_t length,
+                HPACKHeaderCallback callback, void *userData) {
+  const uint8_t *pos = block;
+  const uint8_t *end = block + length;
+  int fieldsSeen = 0;
+
+  // Huffman output is at most 8/5 of its input (the shortest code is 5 bits), so
+  // separate name and value areas of that size hold any string in the block
+  size_t scratchSize = length * 8 / 5 + 1;
+  char *scratch = malloc(scratchSize * 2);
+  if (!scratch) return -1;
+  char *valueScratch = scratch + scratchSize;
+
+  while (pos < end) {
+    uint8_t first = *pos;
+    const char *name, *value;
+    size_t nameLen, valueLen;
+    uint32_t index;
+
+    if (first & 0x80) {
+      // Indexed header field
+      if (decodeInteger(&pos, end, 7, &index) != 0 ||
+          lookupIndex(table, index, &name, &nameLen, &value, &valueLen) != 0) {
+        goto fail;
+      }
+      callback(userData, name, nameLen, value, valueLen);
+      fieldsSeen++;
+      continue;
+    }
+
+    if ((first & 0xe0) == 0x20) {
+      // Dynamic table size update, only allowed before the first field
+      if (fieldsSeen > 0 || decodeInteger(&pos, end, 5, &index) != 0) goto fail;
+      if (index > table->settingsMaxSize) goto fail;
+      table->maxSize = index;
+      evictEntries(table, table->maxSize);
+      continue;
+    }
+
+    // Literal field: with incremental indexing (6-bit prefix) or without / never indexed (4-bit)
+    int indexing = (first & 0xc0) == 0x40;
+    if (decodeInteger(&pos, end, indexing ? 6 : 4, &index) != 0) goto fail;
+
+    if (index > 0) {
+      const char *unusedValue;
+      size_t unusedLen;
+      if (lookupIndex(table, index, &name, &nameLen, &unusedValue, &unusedLen) != 0) goto fail;
+    } else if (decodeString(&pos, end, scratch, scratchSize, &name, &nameLen) != 0) {
+      goto fail;
+    }
+    if (decodeString(&pos, end, valueScratch, scratchSize, &value, &valueLen) != 0) goto fail;
+
+    // Hand the field over before indexing it: inserting can evict the entry name points into
+    callback(userData, name, nameLen, value, valueLen);
+    fieldsSeen++;
+
+    if (indexing && insertEntry(table, name, nameLen, value, valueLen) != 0) goto fail;
+  }
+
+  free(scratch);
+  return 0;
+
+fail:
+  free(scratch);
+  return -1;
+}
+
+// ==== Encoder ====
+
+size_t hpackEncodeStatus(uint8_t *out, size_t outSize, int status) {
+  // Statuses present in the static table encode as a single indexed byte
+  static const int indexedStatuses[] = { 200, 204, 206, 304, 400, 404, 500 };
+  for (size_t i = 0; i < sizeof(indexedStatuses) / sizeof(indexedStatuses[0]); i++) {
+    if (indexedStatuses[i] == status) {
+      return encodeInteger(out, outSize, 7, 0x80, (uint32_t)(8 + i));
+    }
+  }
+
+  char statusText[8];
+  snprintf(statusText, sizeof(statusText), "%03d", status % 1000);
+  return hpackEncodeHeader(out, outSize, ":status", statusText);
+}
+
+size_t hpackEncodeHeader(uint8_t *out, size_t outSize, const char *name, const char *value) {
+  // Reference the name through the static table when possible
+  uint32_t nameIndex = 0;
+  for (uint32_t i = 0; i < HPACK_STATIC_ENTRIES; i++) {
+    if (strcmp(staticTable[i].name, name) == 0) {
+      nameIndex = i + 1;
+      break;
+    }
+  }
+
+  // Literal header field without indexing (0000xxxx)
+  size_t written = encodeInteger(out, outSize, 4, 0x00, nameIndex);
+  if (written == 0) return 0;
+
+  if (nameIndex == 0) {
+    size_t nameBytes = encodeString(out + written, outSize - written, name);
+    if (nameBytes == 0) return 0;
+    written += nameBytes;
+  }
+
+  size_t valueBytes = encodeString(out + written, outSize - written, value);
+  if (valueBytes == 0) return 0;
+
+  return written + valueBytes;
+}
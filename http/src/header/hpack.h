@@ -0,0 +1,54 @@
+// hpack.h - HPACK header compression for HTTP/2 (RFC 7541)
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HPACK_STATIC_ENTRIES 61        // Entries in the predefined static table
+#define HPACK_DEFAULT_TABLE_SIZE 4096  // Default dynamic table size in bytes
+#define HPACK_ENTRY_OVERHEAD 32        // Per-entry overhead counted against the table size
+
+// A single header field in the dynamic table
+typedef struct {
+  char *name;
+  size_t nameLen;
+  char *value;
+  size_t valueLen;
+} HPACKEntry;
+
+// Decoder-side dynamic table, stored as a ring of entries (newest first)
+typedef struct {
+  HPACKEntry *entries;   // Ring buffer of entries
+  size_t capacity;       // Number of slots in the ring
+  size_t head;           // Slot the next insertion will use
+  size_t count;          // Number of live entries
+  size_t size;           // Current size in bytes (RFC 7541 section 4.1)
+  size_t maxSize;        // Current size limit set by the encoder
+  size_t settingsMaxSize; // Upper bound we advertised in SETTINGS
+} HPACKTable;
+
+// Called once for every decoded header field, in order
+typedef void (*HPACKHeaderCallback)(void *userData,
+                                    const char *name, size_t nameLen,
+                                    const char *value, size_t valueLen);
+
+// Initialize a dynamic table with the given maximum size
+int hpackInitTable(HPACKTable *table, size_t maxSize);
+
+// Free all memory held by a dynamic table
+void hpackFreeTable(HPACKTable *table);
+
+// Decode a complete header block, invoking the callback for each field.
+// Returns 0 on success or -1 on a compression error.
+int hpackDecode(HPACKTable *table, const uint8_t *block, size_t length,
+                HPACKHeaderCallback callback, void *userData);
+
+// Encode ":status" into the output buffer. Returns bytes written, or 0 if it did not fit.
+size_t hpackEncodeStatus(uint8_t *out, size_t outSize, int status);
+
+// Encode a regular header as a literal without indexing.
+// Returns bytes written, or 0 if it did not fit.
+size_t hpackEncodeHeader(uint8_t *out, size_t outSize, const char *name, const char *value);
+
+#endif // HPACK_H
@@ -1,8 +1,34 @@
 // parser.c - Implementation of HTTP request parser
 #include "parser.h"
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 
+// Copy the value of the Authorization header, if present and short enough
+static void parseAuthorization(const char *rawRequest, HTTPRequest *request) {
+  request->authorization[0] = '\0';
+
+  // Header lines start after the request line and end at the first empty line
+  const char *line = strchr(rawRequest, '\n');
+  while (line && line[1] != '\r' && line[1] != '\n' && line[1] != '\0') {
+    line++;
+    const char *end = strpbrk(line, "\r\n");
+    if (!end) end = line + strlen(line);
+
+    if (strncasecmp(line, "Authorization:", 14) == 0) {
+      const char *value = line + 14;
+      while (*value == ' ' || *value == '\t') value++;
+      size_t length = (size_t)(end - value);
+      if (length < MAX_AUTHORIZATION_LEN) {
+        memcpy(request->authorization, value, length);
+        request->authorization[length] = '\0';
+      }
+      return;
+    }
+    line = strchr(line, '\n');
+  }
+}
+
 int parseHTTPRequest(const char *rawRequest, HTTPRequest *request) {
   // Example of rawRequest:
   // "GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n"
@@ -27,6 +53,8 @@ int parseHTTPRequest(const char *rawRequest, HTTPRequest *request) {
   strncpy(request->path, path, MAX_PATH_LEN);
   request->path[MAX_PATH_LEN - 1] = '\0';
 
+  parseAuthorization(rawRequest, request);
+
   return 0; // Success
 }
 
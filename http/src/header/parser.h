@@ -2,14 +2,30 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stddef.h>
+
 #define MAX_METHOD_LEN 8
 #define MAX_PATH_LEN 256
+#define MAX_AUTHORIZATION_LEN 512
 
 typedef struct {
   char method[MAX_METHOD_LEN];
   char path[MAX_PATH_LEN];
+  char authorization[MAX_AUTHORIZATION_LEN];  // Authorization header value, or "" if absent or too long
 } HTTPRequest;
 
+typedef struct {
+  int status;               // HTTP status code
+  const char *contentType;  // Value of the Content-Type header
+  const char *body;         // In-memory body, or NULL when read from fd
+  int fd;                   // File supplying the body (read with pread), or -1
+  size_t bodyLength;        // Length of the body in bytes
+  void *bodyOwner;          // Keeps body or fd valid until released, or NULL for static bodies
+  void (*releaseBody)(void *bodyOwner);  // Called by the sender once the response is done
+  const char *headerName;   // One extra response header (e.g. WWW-Authenticate), or NULL
+  const char *headerValue;
+} HTTPResponse;
+
 int parseHTTPRequest(const char *rawRequest, HTTPRequest *request);
 
 #endif // PARSER_H
@@ -0,0 +1,247 @@
+// sharedcache.c - Implementation of the cross-process file contents cache
+//
+// The region is a table of slots followed by an append-only data area. Readers
+// never lock: each slot is a seqlock, so a reader copies the slot and retries
+// if a writer changed it meanwhile. Writers claim a slot by swapping their pid
+// into it, so each path has a single writer at a time. Contents are never
+// overwritten once published, which keeps them valid for as long as any worker
+// is still sending them.
+#define _GNU_SOURCE
+#include "sharedcache.h"
+
+#include <stdio.h>        // For printf, perror
+#include <string.h>       // For strcmp, strlen, memcpy
+#include <errno.h>        // For errno, ESRCH
+#include <signal.h>       // For kill
+#include <stdatomic.h>    // For atomic loads, stores and compare-exchange
+#include <unistd.h>       // For ftruncate, pread, getpid, close
+#include <sys/mman.h>     // For memfd_create, mmap
+
+#include "../../../common/src/header/metrics.h"  // For metricsRegister
+
+#define SHARED_CACHE_ALIGN 64     // Contents start on a cache line
+#define SHARED_CACHE_RETRIES 4    // Consistent reads attempted before treating a slot as busy
+
+// What a slot says about one file; copied out whole by readers
+typedef struct {
+  uint64_t hash;                  // Path hash, or 0 while the slot is unused
+  dev_t device;                   // Identity of the stored version
+  ino_t inode;
+  off_t size;
+  struct timespec modified;
+  uint64_t offset;                // Start of the contents in the data area
+  char path[SHARED_CACHE_PATH_MAX];
+} SharedEntry;
+
+typedef struct {
+  _Atomic uint32_t sequence;      // Odd while the entry is being rewritten
+  _Atomic int32_t writer;         // Pid of the process rewriting the entry, or 0
+  SharedEntry entry;
+} SharedSlot;
+
+typedef struct {
+  _Atomic uint64_t used;          // Bytes of the data area handed out (never reclaimed)
+  uint64_t capacity;              // Size of the data area
+  SharedSlot slots[SHARED_CACHE_SLOTS];
+} SharedRegion;
+
+static SharedRegion *region;      // NULL when sharing is disabled
+static char *dataArea;
+
+// Per-process counters, updated from the I/O threads
+static _Atomic uint64_t hits;
+static _Atomic uint64_t stores;
+
+static double readUsed(const void *data) {
+  (void)data;
+  return region ? (double)atomic_load_explicit(&region->used, memory_order_relaxed) : 0;
+}
+
+static double readCapacity(const void *data) {
+  (void)data;
+  return region ? (double)region->capacity : 0;
+}
+
+static double readCounter(const void *data) {
+  return (double)atomic_load_explicit((_Atomic uint64_t *)data, memory_order_relaxed);
+}
+
+int sharedCacheInit(size_t dataBytes) {
+  size_t tableBytes = (sizeof(SharedRegion) + SHARED_CACHE_ALIGN - 1) & ~(size_t)(SHARED_CACHE_ALIGN - 1);
+  size_t totalBytes = tableBytes + dataBytes;
+
+  // Pages are only allocated as they are written, so an idle region costs nothing
+  int fd = memfd_create("noble-file-cache", MFD_CLOEXEC);
+  if (fd < 0) {
+    perror("Error creating shared cache");
+    return -1;
+  }
+  if (ftruncate(fd, (off_t)totalBytes) < 0) {
+    perror("Error sizing shared cache");
+    close(fd);
+    return -1;
+  }
+
+  void *memory = mmap(NULL, totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    perror("Error mapping shared cache");
+    return -1;
+  }
+
+  region = memory;
+  region->capacity = dataBytes;
+  dataArea = (char *)memory + tableBytes;
+
+  metricsRegister("http_shared_cache_used_bytes", "File contents stored in the shared region, including replaced versions",
+                  METRIC_GAUGE, readUsed, NULL);
+  metricsRegister("http_shared_cache_capacity_bytes", "Size of the shared region's data area",
+                  METRIC_GAUGE, readCapacity, NULL);
+  metricsRegister("http_shared_cache_hits_total", "Files this worker found already stored by a worker",
+                  METRIC_COUNTER, readCounter, &hits);
+  metricsRegister("http_shared_cache_stores_total", "Files this worker read into the shared region",
+                  METRIC_COUNTER, readCounter, &stores);
+
+  printf("[*] Shared file cache: %zu MB\n", dataBytes / (1024 * 1024));
+  return 0;
+}
+
+// Copy a slot's entry without locking. Returns 0 if the copy is consistent, or
+// -1 if a writer kept changing it (the caller treats the slot as busy).
+static int readSlot(SharedSlot *slot, SharedEntry *copy) {
+  for (int attempt = 0; attempt < SHARED_CACHE_RETRIES; attempt++) {
+    uint32_t before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (before & 1) continue;
+
+    memcpy(copy, &slot->entry, sizeof(SharedEntry));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == before) {
+      copy->path[SHARED_CACHE_PATH_MAX - 1] = '\0';
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Replace a slot's entry; only called by the slot's claimed writer
+static void writeSlot(SharedSlot *slot, const SharedEntry *entry) {
+  // Starting from an odd value (a writer that died mid-update) keeps the slot marked busy
+  uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed) | 1;
+  atomic_store_explicit(&slot->sequence, sequence, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  memcpy(&slot->entry, entry, sizeof(SharedEntry));
+  atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_release);
+}
+
+// Become the slot's only writer. Returns 1 on success, 0 if someone else is writing.
+static int claimSlot(SharedSlot *slot) {
+  int32_t self = (int32_t)getpid();
+  int32_t expected = 0;
+  if (atomic_compare_exchange_strong(&slot->writer, &expected, self)) return 1;
+
+  // A worker that died mid-store would hold the slot forever; take it over
+  if (expected != self && kill(expected, 0) < 0 && errno == ESRCH) {
+    return atomic_compare_exchange_strong(&slot->writer, &expected, self);
+  }
+  return 0;
+}
+
+static void releaseSlot(SharedSlot *slot) {
+  atomic_store_explicit(&slot->writer, 0, memory_order_release);
+}
+
+// Whether an entry holds the version of the file described by info
+static int sameFile(const SharedEntry *entry, const struct stat *info) {
+  return entry->device == info->st_dev && entry->inode == info->st_ino &&
+         entry->size == info->st_size &&
+         entry->modified.tv_sec == info->st_mtim.tv_sec &&
+         entry->modified.tv_nsec == info->st_mtim.tv_nsec;
+}
+
+// Reserve space in the data area. Returns 0 with the offset, or -1 if the region is full.
+static int allocate(size_t size, uint64_t *offset) {
+  uint64_t rounded = ((uint64_t)size + SHARED_CACHE_ALIGN - 1) & ~(uint64_t)(SHARED_CACHE_ALIGN - 1);
+  uint64_t used = atomic_load_explicit(&region->used, memory_order_relaxed);
+  do {
+    if (used + rounded > region->capacity) return -1;
+  } while (!atomic_compare_exchange_weak(&region->used, &used, used + rounded));
+
+  *offset = used;
+  return 0;
+}
+
+const char *sharedCacheFind(const char *path, uint64_t hash, const struct stat *info) {
+  if (!region) return NULL;
+  if (hash == 0) hash = 1;  // 0 marks an unused slot
+
+  for (int probe = 0; probe < SHARED_CACHE_PROBES; probe++) {
+    SharedSlot *slot = &region->slots[(hash + (uint64_t)probe) & (SHARED_CACHE_SLOTS - 1)];
+    SharedEntry entry;
+    if (readSlot(slot, &entry) != 0) continue;
+    if (entry.hash == 0) return NULL;  // Slots are never emptied, so the path isn't further on
+    if (entry.hash != hash || strcmp(entry.path, path) != 0) continue;
+
+    if (!sameFile(&entry, info)) return NULL;  // Stored version is out of date
+    atomic_fetch_add_explicit(&hits, 1, memory_order_relaxed);
+    return dataArea + entry.offset;
+  }
+  return NULL;
+}
+
+const char *sharedCacheStore(const char *path, uint64_t hash, const struct stat *info, int fd) {
+  if (!region || strlen(path) >= SHARED_CACHE_PATH_MAX) return NULL;
+  if (hash == 0) hash = 1;
+
+  // The path's own slot if it has one, else the first unused slot, else its home slot
+  SharedSlot *target = NULL;
+  SharedSlot *unused = NULL;
+  for (int probe = 0; probe < SHARED_CACHE_PROBES && !target; probe++) {
+    SharedSlot *slot = &region->slots[(hash + (uint64_t)probe) & (SHARED_CACHE_SLOTS - 1)];
+    SharedEntry entry;
+    if (readSlot(slot, &entry) != 0) continue;
+    if (entry.hash == hash && strcmp(entry.path, path) == 0) target = slot;
+    else if (entry.hash == 0 && !unused) unused = slot;
+  }
+  int replacing = !target && !unused;
+  if (!target) target = unused ? unused : &region->slots[hash & (SHARED_CACHE_SLOTS - 1)];
+  if (!claimSlot(target)) return NULL;
+
+  // As the writer the slot can be read directly. Another worker may have stored
+  // this version, or taken the unused slot for another path, while we looked.
+  const char *data = NULL;
+  SharedEntry *current = &target->entry;
+  int ours = current->hash == hash && strcmp(current->path, path) == 0;
+  if (ours && sameFile(current, info)) {
+    data = dataArea + current->offset;
+  } else if (ours || current->hash == 0 || replacing) {
+    size_t size = (size_t)info->st_size;
+    uint64_t offset;
+    if (allocate(size, &offset) == 0) {
+      size_t loaded = 0;
+      while (loaded < size) {
+        ssize_t bytesRead = pread(fd, dataArea + offset + loaded, size - loaded, (off_t)loaded);
+        if (bytesRead <= 0) break;
+        loaded += (size_t)bytesRead;
+      }
+
+      // The space of a failed read is lost until restart, like any replaced version
+      if (loaded == size) {
+        SharedEntry entry = {
+          .hash = hash,
+          .device = info->st_dev,
+          .inode = info->st_ino,
+          .size = info->st_size,
+          .modified = info->st_mtim,
+          .offset = offset,
+        };
+        memcpy(entry.path, path, strlen(path) + 1);
+        writeSlot(target, &entry);
+        atomic_fetch_add_explicit(&stores, 1, memory_order_relaxed);
+        data = dataArea + offset;
+      }
+    }
+  }
+
+  releaseSlot(target);
+  return data;
+}
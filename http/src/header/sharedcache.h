@@ -0,0 +1,29 @@
+// sharedcache.h - File contents shared by every worker process through one memory region
+#ifndef SHAREDCACHE_H
+#define SHAREDCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define SHARED_CACHE_SLOTS 4096      // Files tracked across workers (power of two)
+#define SHARED_CACHE_PROBES 8        // Slots tried for one path before giving up
+#define SHARED_CACHE_PATH_MAX 512    // Longest path stored
+
+// Map the shared region with room for dataBytes of file contents. Must be called
+// before the workers are forked so they all see the same memory. Contents are
+// only ever appended: a changed file gets new space, and space is reclaimed when
+// the server restarts or upgrades. Returns 0 on success.
+int sharedCacheInit(size_t dataBytes);
+
+// Contents of path if another worker (or this one) already stored the version
+// described by info, or NULL. Never blocks; safe from any thread.
+const char *sharedCacheFind(const char *path, uint64_t hash, const struct stat *info);
+
+// Read the file open on fd into the shared region and publish it under path, so
+// other workers find it. Returns the contents, or NULL if another worker is storing
+// the same path right now, the region is full, or the read failed; the caller then
+// reads into private memory. Safe from any thread.
+const char *sharedCacheStore(const char *path, uint64_t hash, const struct stat *info, int fd);
+
+#endif // SHAREDCACHE_H
@@ -1,217 +1,878 @@
 // main.c - Noble HTTP/HTTPS Server Entry Point
 
+#define _GNU_SOURCE
 #include <stdio.h>         // For printf, perror
 #include <stdlib.h>        // For exit, atoi, malloc, free
-#include <string.h>        // For memset, strlen
-#include <unistd.h>        // For close
-#include <fcntl.h>         // For file I/O
+#include <string.h>        // For memset, strlen, strncmp, memmem
+#include <stddef.h>        // For offsetof
+#include <unistd.h>        // For pread, fork, getpid
+#include <signal.h>        // For signal, kill, SIGPIPE
+#include <sys/prctl.h>     // For prctl, PR_SET_PDEATHSIG
+#include <sys/wait.h>      // For waitpid
+#include <netinet/in.h>    // For IPPROTO_TCP
+#include <netinet/tcp.h>   // For TCP_NODELAY
 
 // Include custom headers
-#include "../header/sslsocket.h"   // TLS socket functions for HTTPS
-#include "../header/socket.h"      // Regular raw socket functions for HTTP
 #include "../header/parser.h"      // HTTP request parsing
+#include "../header/h2.h"          // HTTP/2 connections negotiated via ALPN
+#include "../header/filecache.h"   // Cached www/ files loaded on I/O threads
+#include "../header/authclient.h"  // Credential checks against the auth server
+#include "../header/sharedcache.h" // File contents shared by worker processes
+#include "../../../common/src/header/engine.h"    // Listeners, TLS, admission, deadlines and draining
+#include "../../../common/src/header/sslsocket.h" // ALPN result for HTTP/2
+#include "../../../common/src/header/config.h"   // Settings from http.conf
+#include "../../../common/src/header/sockopts.h" // Corking responses
+#include "../../../common/src/header/metrics.h"   // Counters served at /_metrics
+#include "../../../common/src/header/handoff.h"  // Forked workers keep the upgrade signals
+#include "../../../common/src/header/connection.h"  // Pooled connection state
+#include "../../../common/src/header/pool.h"        // Pooled I/O buffers
+#include "../../../common/src/header/eventloop.h"   // epoll loop and connection deadlines
+#include "../../../common/src/header/trace.h"       // Tracepoints and slow request reports
+#include "../../../common/src/header/capture.h"     // Recording requests for replay
+
+// ==== FUNCTION: SetResponse ====
+// Fill a response with a status, content type and a static in-memory body.
+void SetResponse(HTTPResponse *response, int status, const char *contentType, const char *body) {
+  response->status = status;
+  response->contentType = contentType;
+  response->body = body;
+  response->fd = -1;
+  response->bodyLength = strlen(body);
+  response->bodyOwner = NULL;
+  response->releaseBody = NULL;
+  response->headerName = NULL;
+  response->headerValue = NULL;
+}
+
+// ==== FUNCTION: ReleaseMetricsBody ====
+// Give the buffer a metrics response was formatted into back to the pool.
+void ReleaseMetricsBody(void *bodyOwner) {
+  bufferRelease(bodyOwner);
+}
+
+// ==== FUNCTION: MetricsResponse ====
+// Fill a response with the current metrics in Prometheus text format.
+void MetricsResponse(HTTPResponse *response) {
+  char *text = bufferAcquire();
+  if (!text) {
+    SetResponse(response, 503, "text/plain", "Server busy.");
+    return;
+  }
+
+  metricsFormat(text, POOL_BUFFER_SIZE);
+  SetResponse(response, 200, "text/plain; version=0.0.4", text);
+  response->bodyOwner = text;
+  response->releaseBody = ReleaseMetricsBody;
+}
+
+#define WEB_ROOT "www"  // Directory files are served from
+
+// ==== FUNCTION: ResolveRequest ====
+// Check a parsed request and map it to a file under www/.
+// Shared by the HTTP/1.x and HTTP/2 paths. Returns 0 with the file path
+// filled in, or -1 with an error or built-in response already set.
+int ResolveRequest(const HTTPRequest *request, HTTPResponse *response, char *fullPath, size_t pathSize) {
+  // Step 1: Verify that the HTTP method is supported (only GET)
+  if (strcmp(request->method, "GET") != 0) {
+    // Unsupported method — send 405 Method Not Allowed
+    SetResponse(response, 405, "text/plain", "Only GET is allowed.");
+    return -1;
+  }
+
+  // Built-in page with the server's counters
+  if (strcmp(request->path, "/_metrics") == 0) {
+    MetricsResponse(response);
+    return -1;
+  }
+
+  // Step 2: Determine the requested file path
+  const char *requestedPath = request->path[0] == '/'
+    ? request->path + 1  // Skip leading slash
+    : request->path;
+
+  // If no path is provided, default to "index.html"
+  if (strlen(requestedPath) == 0) {
+    requestedPath = "index.html";
+  }
+
+  // Step 3: Security check — block access to subdirectories
+  if (strchr(requestedPath, '/')) {
+    SetResponse(response, 403, "text/plain", "Access to subdirectories is not allowed.");
+    return -1;
+  }
+
+  // Step 4: Build full file path from request
+  snprintf(fullPath, pathSize, WEB_ROOT "/%s", requestedPath);
+  return 0;
+}
+
+// ==== FUNCTION: FileResponse ====
+// Build the response for a file from the cache. The response takes over the
+// reference to the cache entry and releases it once sent.
+void FileResponse(HTTPResponse *response, CachedFile *file) {
+  if (file->state != FILE_READY) {
+    // File not found — send 404 response
+    printf("[!] Failed to open file: %s\n", file->path);
+    fileCacheRelease(file);
+    SetResponse(response, 404, "text/plain", "File not found.");
+    return;
+  }
+
+  response->status = 200;
+  response->contentType = "text/html";
+  response->body = file->data;
+  response->fd = file->fd;
+  response->bodyLength = file->size;
+  response->bodyOwner = file;
+  response->releaseBody = fileCacheRelease;
+  response->headerName = NULL;
+  response->headerValue = NULL;
+}
+
+// ==== FUNCTION: StatusReason ====
+// Return the reason phrase for the status codes this server produces.
+const char *StatusReason(int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 503: return "Service Unavailable";
+    default: return "Internal Server Error";
+  }
+}
+
+#define IO_THREADS 4            // Threads doing file-system work off the event loop
+#define IO_QUEUE_LIMIT 1024     // File loads that may wait for an I/O thread
+#define MAX_PROTECTED_PATHS 32  // "protect" lines read from http.conf
+#define MAX_WORKERS 64          // Processes serving the same listeners ("workers" in http.conf)
+
+// ==== Server state ====
+static EventLoop *serverLoop;          // Drives every connection on this thread
+static pid_t workerPids[MAX_WORKERS];  // Workers forked by the first process
+static int workerCount;
+static const char *protectedPaths[MAX_PROTECTED_PATHS];  // Path prefixes that need credentials
+static size_t protectedPathCount;
+
+// A request waiting for a file to come back from the I/O threads, or for the
+// auth server to accept its credentials before the file is looked up
+typedef struct PendingRequest {
+  FileWaiter waiter;                   // First, so the waiter can be converted back
+  AuthWaiter auth;                     // Used instead of waiter while checking credentials
+  int checkingAuth;                    // Which of the two is in use
+  Connection *connection;
+  uint32_t streamId;                   // HTTP/2 stream, or 0 for an HTTP/1.x request
+  char fullPath[512];                  // File to look up once credentials are accepted
+  struct PendingRequest *next;         // Other pending requests on the same connection
+  struct PendingRequest *prev;
+} PendingRequest;
+
+static __thread Slab pendingSlab = SLAB_INITIALIZER(PendingRequest);
+
+void ServeHTTP2(Connection *connection);
+void SendResponse(Connection *connection, HTTPResponse *response);
+
+// ==== FUNCTION: WaitFor ====
+// Choose which readiness events wake the connection next.
+void WaitFor(Connection *connection, uint32_t events) {
+  eventLoopModify(serverLoop, &connection->handler, events);
+}
+
+// ==== FUNCTION: ReleaseConnection ====
+// Release the HTTP state of a connection the engine is about to close.
+void ReleaseConnection(Connection *connection) {
+  // A request cut short while waiting is charged to its lookup
+  if (connection->pendingWork) traceEnd(&connection->span, TRACE_LOOKUP, connection->id);
+
+  // Stop waiting for file loads and credential checks, and release the body being sent
+  while (connection->pendingWork) {
+    PendingRequest *pending = connection->pendingWork;
+    connection->pendingWork = pending->next;
+    if (pending->checkingAuth) authCancel(&pending->auth);
+    else fileCacheCancel(&pending->waiter);
+    slabFree(&pendingSlab, pending);
+  }
+  if (connection->session) {
+    h2FreeSession(connection->session);
+  }
+  if (connection->releaseBody) {
+    connection->releaseBody(connection->bodyOwner);
+  }
+
+  printf("[*] Closing client connection\n");
+}
+
+// ==== FUNCTION: WriteResponse ====
+// Send the queued response header and then the body, as far as the socket allows.
+// File bodies are streamed through the connection's pooled buffer.
+void WriteResponse(Connection *connection) {
+  TimerWheel *timers = eventLoopTimers(serverLoop);
+  char *buffer = connection->buffer;
 
-// ==== FUNCTION: readFile ====
-// Read contents of a file and return it as a dynamically allocated string.
-// Caller is responsible for freeing the memory.
-// If the file does not exist or cannot be opened, return NULL.
-char *readFile(const char *filePath) {
-  FILE *file = fopen(filePath, "r");
-  if (!file) {
-    printf("[!] Failed to open file: %s\n", filePath);  // Output error
-    return NULL;
+  while (1) {
+    const char *data;
+    size_t length;
+
+    if (connection->sent < connection->length) {
+      // Header or file data still in the buffer
+      data = buffer + connection->sent;
+      length = connection->length - connection->sent;
+    } else if (connection->bodyRemaining == 0) {
+      // Response complete: one request per connection
+      TRACE_PROBE3(send_end, connection->id, 0, connection->bodyOffset);
+      engineClose(connection);
+      return;
+    } else if (connection->body) {
+      // In-memory bodies are sent straight from where they live
+      data = connection->body;
+      length = connection->bodyRemaining;
+    } else {
+      // Refill the buffer with the next part of the file
+      size_t chunk = connection->bodyRemaining < POOL_BUFFER_SIZE ? connection->bodyRemaining : POOL_BUFFER_SIZE;
+      ssize_t bytesRead = pread(connection->bodyFD, buffer, chunk, connection->bodyOffset);
+      if (bytesRead <= 0) {
+        engineClose(connection);
+        return;
+      }
+      connection->bodyOffset += bytesRead;
+      connection->bodyRemaining -= (size_t)bytesRead;
+      connection->length = (size_t)bytesRead;
+      connection->sent = 0;
+      continue;
+    }
+
+    int bytesSent = connection->transport->send(connection, data, length);
+    if (bytesSent == SOCKET_WOULD_BLOCK) {
+      WaitFor(connection, EPOLLOUT);
+      return;
+    }
+    if (bytesSent < 0) {
+      engineClose(connection);
+      return;
+    }
+
+    if (data == connection->body) {
+      connection->body += bytesSent;
+      connection->bodyOffset += bytesSent;
+      connection->bodyRemaining -= (size_t)bytesSent;
+    } else {
+      connection->sent += (size_t)bytesSent;
+    }
+
+    // Any progress pushes the write deadline back; only a stalled client times out
+    connectionSetPhase(connection, timers, PHASE_WRITE, CONNECTION_WRITE_TIMEOUT_MS);
   }
+}
 
-  // Seek to the end to determine file size
-  fseek(file, 0, SEEK_END);
-  long fileSize = ftell(file);
-  rewind(file);  // Reset to beginning
+// ==== FUNCTION: SendResponse ====
+// Queue an HTTP/1.x response and start sending it. The header is built in
+// the buffer the request was read into.
+void SendResponse(Connection *connection, HTTPResponse *response) {
+  TRACE_PROBE3(send_start, connection->id, 0, response->status);
+  traceMark(&connection->span, TRACE_LOOKUP);
 
-  // Allocate buffer to hold the entire file (+1 for null terminator)
-  char *buffer = malloc(fileSize + 1);
+  char *buffer = connectionBuffer(connection);
   if (!buffer) {
-    fclose(file);
-    return NULL;  // Memory allocation failed
+    if (response->releaseBody) response->releaseBody(response->bodyOwner);
+    engineClose(connection);
+    return;
+  }
+
+  // Step 1: Construct HTTP response header
+  int headerLength;
+  if (response->status == 200) {
+    headerLength = snprintf(buffer, POOL_BUFFER_SIZE,
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: %s\r\n"
+      "Content-Length: %zu\r\n"
+      "\r\n", response->contentType, response->bodyLength);
+  } else if (response->headerName) {
+    headerLength = snprintf(buffer, POOL_BUFFER_SIZE,
+      "HTTP/1.1 %d %s\r\n%s: %s\r\n\r\n", response->status, StatusReason(response->status),
+      response->headerName, response->headerValue);
+  } else {
+    headerLength = snprintf(buffer, POOL_BUFFER_SIZE,
+      "HTTP/1.1 %d %s\r\n\r\n", response->status, StatusReason(response->status));
   }
 
-  // Read file into buffer
-  fread(buffer, 1, fileSize, file);
-  buffer[fileSize] = '\0';  // Null-terminate
+  // Step 2: Queue the header followed by the body and start writing
+  connection->length = (size_t)headerLength;
+  connection->sent = 0;
+  connection->body = response->body;
+  connection->bodyFD = response->fd;
+  connection->bodyOffset = 0;
+  connection->bodyRemaining = response->bodyLength;
+  connection->bodyOwner = response->bodyOwner;
+  connection->releaseBody = response->releaseBody;
+
+  // Header and body go out in full segments instead of a small header segment first;
+  // closing the connection once the response is sent flushes the corked tail
+  if (connection->peerUid == (uid_t)-1) socketCork(connection->fd, engineSocketOptions(), 1);
+
+  connectionSetPhase(connection, eventLoopTimers(serverLoop), PHASE_WRITE, CONNECTION_WRITE_TIMEOUT_MS);
+  WriteResponse(connection);
+}
+
+// ==== FUNCTION: AddPending ====
+// Put a request on its connection's list of requests waiting for background work.
+void AddPending(PendingRequest *pending, Connection *connection, uint32_t streamId) {
+  pending->connection = connection;
+  pending->streamId = streamId;
+  pending->prev = NULL;
+  pending->next = connection->pendingWork;
+  if (pending->next) pending->next->prev = pending;
+  connection->pendingWork = pending;
+}
+
+// ==== FUNCTION: RemovePending ====
+// Take a request off its connection's pending list and free it.
+void RemovePending(PendingRequest *pending) {
+  Connection *connection = pending->connection;
+  if (pending->prev) pending->prev->next = pending->next;
+  else connection->pendingWork = pending->next;
+  if (pending->next) pending->next->prev = pending->prev;
+  slabFree(&pendingSlab, pending);
+}
+
+// ==== FUNCTION: FinishPending ====
+// Answer a request whose background work completed.
+void FinishPending(Connection *connection, uint32_t streamId, HTTPResponse *response) {
+  if (streamId == 0) {
+    SendResponse(connection, response);
+  } else {
+    h2SubmitResponse(connection->session, streamId, response);
+    ServeHTTP2(connection);
+  }
+}
 
-  fclose(file);
-  return buffer;
+// ==== FUNCTION: OnFileReady ====
+// A file load finished: answer the request that was waiting for it.
+void OnFileReady(FileWaiter *waiter, CachedFile *file) {
+  PendingRequest *pending = (PendingRequest *)waiter;
+  Connection *connection = pending->connection;
+  uint32_t streamId = pending->streamId;
+  RemovePending(pending);
+  TRACE_PROBE3(lookup_end, connection->id, streamId, file->state == FILE_READY);
+
+  HTTPResponse response;
+  FileResponse(&response, file);
+  FinishPending(connection, streamId, &response);
 }
 
-// ==== FUNCTION: HandleClient ====
-// Handle a single client session.
-// Reads request, parses it, and sends appropriate HTTP response.
-void HandleClient(void *connection, int isSSL) {
-  // Step 1: Create buffer for raw HTTP request
-  char requestBuffer[2048];
-  memset(requestBuffer, 0, sizeof(requestBuffer));  // Zero out buffer
+// ==== FUNCTION: LookupFile ====
+// Find a file in the cache. Returns 0 with the response filled in, or
+// H2_RESPONSE_PENDING if the file is being loaded and OnFileReady will answer.
+int LookupFile(Connection *connection, uint32_t streamId, const char *fullPath, HTTPResponse *response) {
+  PendingRequest *pending = slabAlloc(&pendingSlab);
+  if (!pending) {
+    SetResponse(response, 503, "text/plain", "Server busy.");
+    return 0;
+  }
+  pending->waiter.ready = OnFileReady;
+  pending->checkingAuth = 0;
+
+  TRACE_PROBE3(lookup_start, connection->id, streamId, fullPath);
+  CachedFile *file;
+  switch (fileCacheLookup(fullPath, &pending->waiter, &file)) {
+    case FILE_CACHE_HIT:
+      slabFree(&pendingSlab, pending);
+      TRACE_PROBE3(lookup_end, connection->id, streamId, file->state == FILE_READY);
+      FileResponse(response, file);
+      return 0;
+
+    case FILE_CACHE_PENDING:
+      // Identical misses share one load; this request joins the waiters
+      AddPending(pending, connection, streamId);
+      return H2_RESPONSE_PENDING;
+
+    default:
+      slabFree(&pendingSlab, pending);
+      TRACE_PROBE3(lookup_end, connection->id, streamId, 0);
+      SetResponse(response, 503, "text/plain", "Server busy.");
+      return 0;
+  }
+}
 
-  // Step 2: Receive the HTTP request from the client
-  if (isSSL) {
-    SSLReceiveData((SSL *)connection, requestBuffer, sizeof(requestBuffer));  // SSL version
+// ==== FUNCTION: SetAuthResponse ====
+// Fill the response for a request whose credentials were not accepted.
+void SetAuthResponse(HTTPResponse *response, AuthResult result) {
+  if (result == AUTH_DENIED) {
+    SetResponse(response, 401, "text/plain", "Credentials required.");
+    response->headerName = "www-authenticate";
+    response->headerValue = "Basic realm=\"NoblePorts\"";
   } else {
-    rawReceiveData(*(int *)connection, requestBuffer, sizeof(requestBuffer));  // Raw HTTP version
+    SetResponse(response, 503, "text/plain", "Authentication unavailable.");
+  }
+}
+
+// ==== FUNCTION: OnAuthReady ====
+// The auth server answered: look the file up, or refuse the request.
+void OnAuthReady(AuthWaiter *waiter, AuthResult result) {
+  PendingRequest *pending = (PendingRequest *)((char *)waiter - offsetof(PendingRequest, auth));
+  Connection *connection = pending->connection;
+  uint32_t streamId = pending->streamId;
+  char fullPath[sizeof(pending->fullPath)];
+  memcpy(fullPath, pending->fullPath, sizeof(fullPath));
+  RemovePending(pending);
+
+  HTTPResponse response;
+  if (result != AUTH_ALLOWED) {
+    SetAuthResponse(&response, result);
+  } else if (LookupFile(connection, streamId, fullPath, &response) == H2_RESPONSE_PENDING) {
+    return;  // OnFileReady answers
+  }
+  FinishPending(connection, streamId, &response);
+}
+
+// ==== FUNCTION: IsProtected ====
+// Whether a file under www/ falls under one of the configured "protect" prefixes,
+// which are written with or without the leading "/".
+int IsProtected(const char *name) {
+  for (size_t i = 0; i < protectedPathCount; i++) {
+    const char *prefix = protectedPaths[i][0] == '/' ? protectedPaths[i] + 1 : protectedPaths[i];
+    if (strncmp(name, prefix, strlen(prefix)) == 0) return 1;
   }
-  printf("[*] Received request\n%s\n", requestBuffer);
+  return 0;
+}
+
+// ==== FUNCTION: ServeFile ====
+// Look up the file for a resolved request, first checking credentials on protected
+// paths. Returns like LookupFile.
+int ServeFile(Connection *connection, uint32_t streamId, const HTTPRequest *request,
+              const char *fullPath, HTTPResponse *response) {
+  // Checked on the file actually served, so "name" and "/" can't get around "/name" or "/index.html"
+  if (!IsProtected(fullPath + strlen(WEB_ROOT "/"))) {
+    return LookupFile(connection, streamId, fullPath, response);
+  }
+
+  PendingRequest *pending = slabAlloc(&pendingSlab);
+  if (!pending) {
+    SetResponse(response, 503, "text/plain", "Server busy.");
+    return 0;
+  }
+  pending->auth.ready = OnAuthReady;
+  pending->auth.request = NULL;
+  pending->checkingAuth = 1;
+
+  AuthResult result = authCheck(request->authorization, &pending->auth);
+  if (result == AUTH_PENDING) {
+    snprintf(pending->fullPath, sizeof(pending->fullPath), "%s", fullPath);
+    AddPending(pending, connection, streamId);
+    return H2_RESPONSE_PENDING;
+  }
+
+  slabFree(&pendingSlab, pending);
+  if (result == AUTH_ALLOWED) {
+    return LookupFile(connection, streamId, fullPath, response);
+  }
+  SetAuthResponse(response, result);
+  return 0;
+}
 
-  // Step 3: Parse raw request into structured format
+// ==== FUNCTION: CaptureFlags ====
+// How a connection's requests arrived, for the capture file.
+unsigned CaptureFlags(Connection *connection) {
+  unsigned flags = 0;
+  if (connection->ssl) flags |= CAPTURE_TLS;
+  if (connection->peerUid != (uid_t)-1) flags |= CAPTURE_LOCAL;
+  return flags;
+}
+
+// ==== FUNCTION: StartResponse ====
+// Parse the buffered request, resolve it and respond once the file is available.
+void StartResponse(Connection *connection) {
   HTTPRequest requestStructure;
-  if (parseHTTPRequest(requestBuffer, &requestStructure) != 0) {
-    // Parsing failed, send 400 Bad Request response
-    const char *badRequestResponse =
-      "HTTP/1.1 400 Bad Request\r\n\r\nMalformed HTTP request.";
-    if (isSSL) {
-      SSLSendData((SSL *)connection, badRequestResponse);
-    } else {
-      rawSendData(*(int *)connection, badRequestResponse);
-    }
+  HTTPResponse response;
+  char fullPath[512];
+  traceMark(&connection->span, TRACE_READ);
+  captureRequest(connection->id, CaptureFlags(connection), connection->buffer, connection->length);
+
+  // Shed by the engine's admission control: refuse without parsing or logging the request
+  if (connection->shed) {
+    SetResponse(&response, 503, "text/plain", "Server busy.");
+    response.headerName = "retry-after";
+    response.headerValue = "1";
+    SendResponse(connection, &response);
     return;
   }
 
-  // Step 4: Verify that the HTTP method is supported (only GET)
-  if (strcmp(requestStructure.method, "GET") != 0) {
-    // Unsupported method — send 405 Method Not Allowed
-    const char *methodNotAllowed =
-      "HTTP/1.1 405 Method Not Allowed\r\n\r\nOnly GET is allowed.";
-    if (isSSL) {
-      SSLSendData((SSL *)connection, methodNotAllowed);
-    } else {
-      rawSendData(*(int *)connection, methodNotAllowed);
-    }
+  char *buffer = connection->buffer;
+  buffer[connection->length] = '\0';
+  printf("[*] Received request\n%s\n", buffer);
+
+  // Step 1: Parse raw request into structured format
+  int parsed = parseHTTPRequest(buffer, &requestStructure) == 0;
+  if (parsed) {
+    TRACE_PROBE3(request, connection->id, 0, requestStructure.path);
+    traceDetail(&connection->span, "%s %s", requestStructure.method, requestStructure.path);
+  }
+
+  if (!parsed) {
+    // Parsing failed, send 400 Bad Request response
+    SetResponse(&response, 400, "text/plain", "Malformed HTTP request.");
+  } else if (ResolveRequest(&requestStructure, &response, fullPath, sizeof(fullPath)) == 0 &&
+             ServeFile(connection, 0, &requestStructure, fullPath, &response) == H2_RESPONSE_PENDING) {
+    // Step 2: Wait for credentials and the file without holding the buffer; only errors and hangups wake us
+    connectionReleaseBuffer(connection);
+    WaitFor(connection, 0);
+    connectionSetPhase(connection, eventLoopTimers(serverLoop), PHASE_WRITE, CONNECTION_WRITE_TIMEOUT_MS);
     return;
   }
 
-  // Step 5: Determine the requested file path
-  char *requestedPath = requestStructure.path[0] == '/'
-    ? requestStructure.path + 1  // Skip leading slash
-    : requestStructure.path;
+  // Step 3: Send the response
+  SendResponse(connection, &response);
+}
 
-  // If no path is provided, default to "index.html"
-  if (strlen(requestedPath) == 0) {
-    requestedPath = "index.html";
+// ==== FUNCTION: ReadRequest ====
+// Accumulate the HTTP/1.x request header in the connection's pooled buffer.
+// The read deadline runs from the start of the phase, so trickling bytes does not extend it.
+void ReadRequest(Connection *connection) {
+  char *buffer = connectionBuffer(connection);
+  if (!buffer) {
+    engineClose(connection);
+    return;
   }
 
-  // Step 6: Security check — block access to subdirectories
-  if (strchr(requestedPath, '/')) {
-    const char *forbiddenResponse =
-      "HTTP/1.1 403 Forbidden\r\n\r\nAccess to subdirectories is not allowed.";
-    if (isSSL) {
-      SSLSendData((SSL *)connection, forbiddenResponse);
-    } else {
-      rawSendData(*(int *)connection, forbiddenResponse);
+  // Leave room for a terminator; a full buffer is parsed as-is and rejected
+  while (connection->length < POOL_BUFFER_SIZE - 1) {
+    size_t previousLength = connection->length;
+    int wantWrite;
+    int bytesReceived = connection->transport->receive(connection, buffer + previousLength,
+                                    POOL_BUFFER_SIZE - 1 - previousLength, &wantWrite);
+    if (bytesReceived == SOCKET_WOULD_BLOCK) {
+      WaitFor(connection, wantWrite ? EPOLLOUT : EPOLLIN);  // Wait for more
+      return;
+    }
+    if (bytesReceived < 0 || (bytesReceived == 0 && previousLength == 0)) {
+      engineClose(connection);
+      return;
+    }
+    if (bytesReceived == 0) break;  // Client finished sending early; answer what arrived
+
+    // Stop at the blank line ending the header, searching only the new bytes
+    connection->length += (size_t)bytesReceived;
+    size_t searchFrom = previousLength >= 3 ? previousLength - 3 : 0;
+    const char *received = buffer + searchFrom;
+    size_t receivedLength = connection->length - searchFrom;
+    if (memmem(received, receivedLength, "\r\n\r\n", 4) || memmem(received, receivedLength, "\n\n", 2)) {
+      break;
     }
-    return;
   }
 
-  // Step 7: Build full file path from request
+  StartResponse(connection);
+}
+
+// ==== FUNCTION: HandleHTTP2Request ====
+// Request handler for HTTP/2 streams; files not yet cached or behind a credential
+// check are answered later.
+int HandleHTTP2Request(void *context, uint32_t streamId, const HTTPRequest *request, HTTPResponse *response) {
   char fullPath[512];
-  snprintf(fullPath, sizeof(fullPath), "www/%s", requestedPath);
+  Connection *connection = context;
+  TRACE_PROBE3(request, connection->id, streamId, request->path);
+
+  // Captured as the HTTP/1.1 request a replay can send
+  if (captureEnabled()) {
+    char text[MAX_METHOD_LEN + MAX_PATH_LEN + MAX_AUTHORIZATION_LEN + 64];
+    int length = request->authorization[0]
+      ? snprintf(text, sizeof(text), "%s %s HTTP/1.1\r\nAuthorization: %s\r\n\r\n",
+                 request->method, request->path, request->authorization)
+      : snprintf(text, sizeof(text), "%s %s HTTP/1.1\r\n\r\n", request->method, request->path);
+    captureRequest(connection->id, CaptureFlags(connection) | CAPTURE_HTTP2, text, (size_t)length);
+  }
 
-  // Step 8: Attempt to read the requested file from disk
-  char *fileContent = readFile(fullPath);
-  if (!fileContent) {
-    // File not found — send 404 response
-    const char *notFound =
-      "HTTP/1.1 404 Not Found\r\n\r\nFile not found.";
-    if (isSSL) {
-      SSLSendData((SSL *)connection, notFound);
-    } else {
-      rawSendData(*(int *)connection, notFound);
-    }
+  if (ResolveRequest(request, response, fullPath, sizeof(fullPath)) != 0) return 0;
+  return ServeFile(connection, streamId, request, fullPath, response);
+}
+
+// ==== FUNCTION: StartHTTP2 ====
+// Switch a connection that negotiated "h2" over to an HTTP/2 session.
+void StartHTTP2(Connection *connection) {
+  connection->session = h2NewSession(HandleHTTP2Request, connection, connection->id);
+  if (!connection->session) {
+    engineClose(connection);
     return;
   }
 
-  // Step 9: Construct HTTP response header
-  char responseHeader[256];
-  snprintf(responseHeader, sizeof(responseHeader),
-    "HTTP/1.1 200 OK\r\n"
-    "Content-Type: text/html\r\n"
-    "Content-Length: %lu\r\n"
-    "\r\n", strlen(fileContent));
+  // Frames are written as soon as they are ready; waiting on Nagle would stall
+  // WINDOW_UPDATE round trips behind delayed ACKs
+  int noDelay = 1;
+  setsockopt(connection->fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+  ServeHTTP2(connection);
+}
+
+// ==== FUNCTION: ServeHTTP2 ====
+// Move an HTTP/2 connection forward: feed it everything readable, write as
+// much output as the socket accepts, then choose the next wakeup and deadline.
+void ServeHTTP2(Connection *connection) {
+  H2Session *session = connection->session;
+  int blocked = 0;
+  int readWantsWrite = 0;
+  size_t pendingLength;
+
+  while (1) {
+    // Read only while the output backlog is small, so a peer that sends
+    // without reading cannot make the session buffer without bound
+    h2PendingOutput(session, &pendingLength);
+    int readAll = 0;
+    if (pendingLength < H2_OUTPUT_HIGH_WATER) {
+      // Frames are read through a pooled buffer, which goes back to the
+      // pool as soon as the session has consumed it
+      char *buffer = connectionBuffer(connection);
+      if (!buffer) {
+        engineClose(connection);
+        return;
+      }
+
+      // Replies to PINGs and WINDOW_UPDATEs queue up as frames arrive, so stop
+      // reading as soon as they reach the high-water mark
+      int bytesReceived;
+      int wantWrite = 0;
+      while ((bytesReceived = connection->transport->receive(connection, buffer, POOL_BUFFER_SIZE, &wantWrite)) > 0) {
+        if (h2Feed(session, (const uint8_t *)buffer, (size_t)bytesReceived) != 0) break;
+        h2PendingOutput(session, &pendingLength);
+        if (pendingLength >= H2_OUTPUT_HIGH_WATER) break;
+      }
+      connectionReleaseBuffer(connection);
+
+      if (bytesReceived == 0 || bytesReceived == -1) {
+        engineClose(connection);
+        return;
+      }
+      readAll = bytesReceived == SOCKET_WOULD_BLOCK;
+      readWantsWrite = readAll && wantWrite;
+    }
 
-  // Step 10: Send response header followed by file content
-  if (isSSL) {
-    SSLSendData((SSL *)connection, responseHeader);
-    SSLSendData((SSL *)connection, fileContent);
+    // Write everything that can be sent before waiting on the peer
+    int more;
+    blocked = 0;
+    do {
+      more = h2ProduceOutput(session);
+
+      const uint8_t *pending = h2PendingOutput(session, &pendingLength);
+      while (pendingLength > 0) {
+        int bytesSent = connection->transport->send(connection, (const char *)pending, pendingLength);
+        if (bytesSent == SOCKET_WOULD_BLOCK) {
+          blocked = 1;
+          break;
+        }
+        if (bytesSent < 0) {
+          engineClose(connection);
+          return;
+        }
+        h2ConsumeOutput(session, (size_t)bytesSent);
+        pending = h2PendingOutput(session, &pendingLength);
+      }
+    } while (more && !blocked);
+
+    if (h2IsFinished(session)) {
+      engineClose(connection);
+      return;
+    }
+
+    // Loop again if reading stopped early for a backlog that has since drained
+    if (blocked || readAll) break;
+  }
+
+  // Wait for the peer to read when output is stuck or TLS has to write before reading on,
+  // and for new frames unless the backlog is full
+  h2PendingOutput(session, &pendingLength);
+  uint32_t events = pendingLength < H2_OUTPUT_HIGH_WATER ? EPOLLIN : 0;
+  if (blocked || readWantsWrite) events |= EPOLLOUT;
+  WaitFor(connection, events);
+
+  // Streams in flight are held to the write deadline; an empty connection to the idle one
+  TimerWheel *timers = eventLoopTimers(serverLoop);
+  if (blocked || h2HasActiveStreams(session)) {
+    connectionSetPhase(connection, timers, PHASE_WRITE, CONNECTION_WRITE_TIMEOUT_MS);
   } else {
-    rawSendData(*(int *)connection, responseHeader);
-    rawSendData(*(int *)connection, fileContent);
+    connectionSetPhase(connection, timers, PHASE_IDLE, CONNECTION_IDLE_TIMEOUT_MS);
+  }
+}
+
+// ==== FUNCTION: StartConnection ====
+// Begin serving a connection the engine has admitted (after its TLS handshake),
+// dispatching on the protocol selected via ALPN.
+void StartConnection(Connection *connection) {
+  if (connection->ssl && SSLNegotiated(connection->ssl, "h2")) {
+    printf("[+] Client connected via TLS (HTTP/2)\n");
+
+    // Streams share the connection, so only its setup is timed; they have probes
+    traceDetail(&connection->span, "HTTP/2 setup");
+    traceEnd(&connection->span, TRACE_HANDSHAKE, connection->id);
+    StartHTTP2(connection);
+    return;
   }
 
-  // Step 11: Clean up allocated memory
-  free(fileContent);
-  return;
+  if (connection->ssl) {
+    printf("[+] Client connected via TLS\n");
+  } else if (connection->peerUid != (uid_t)-1) {
+    printf("[+] Client connected via Unix socket (uid %u)\n", (unsigned)connection->peerUid);
+  } else {
+    printf("[+] Client connected\n");
+  }
+  ReadRequest(connection);
 }
 
-void SSLServerLoop(int port) {
-  // Initialize TLS context and load certificates
-  printf("[*] Initializing SSL context\n");
-  SSL_CTX *sslContext = initTLSContext();
-  loadCertificates(sslContext, "cert.pem", "key.pem");  // Load cert and key
+// ==== FUNCTION: OnClientReady ====
+// Dispatch a readiness event to the handler for the connection's current phase.
+void OnClientReady(Connection *connection, uint32_t events) {
+  if (connection->session) {
+    ServeHTTP2(connection);
+    return;
+  }
 
-  // Create the main server socket
-  printf("[*] Creating new server socket on port %d\n", port);
-  int serverSocketFD = newServerSocket(port);
-  if (serverSocketFD < 0) {
-    fprintf(stderr, "[!] Failed to create server socket\n");
+  // Waiting on a file load: nothing to read or write, but a hangup ends the request
+  if (connection->pendingWork) {
+    if (events & (EPOLLHUP | EPOLLERR)) engineClose(connection);
     return;
   }
 
-  // Main server loop for handling a client socket
-  while (1) {
-    printf("[*] Waiting for HTTPS connection on port %d\n", port);
+  switch (connection->phase) {
+    case PHASE_READ: ReadRequest(connection); break;
+    case PHASE_WRITE: WriteResponse(connection); break;
+    default: engineClose(connection); break;
+  }
+}
 
-    // Accept a new client connection and establish a TLS session
-    SSL *ssl = acceptClientConnection(serverSocketFD, sslContext);
-    if (!ssl) {
-      fprintf(stderr, "[!] TLS handshake failed or client connection error\n");
-      continue;  // Skip to next connection
+// ==== FUNCTION: SignalWorkers ====
+// Pass a control signal on to every forked worker.
+void SignalWorkers(int signum) {
+  for (int i = 0; i < workerCount; i++) {
+    kill(workerPids[i], signum);
+  }
+}
+
+// ==== FUNCTION: DrainConnections ====
+// Once the engine stops accepting, drain the workers too and tell HTTP/2 clients
+// to go elsewhere.
+void DrainConnections(void) {
+  SignalWorkers(SIGQUIT);
+
+  Connection *next;
+  for (Connection *connection = connectionFirst(); connection; connection = next) {
+    next = connection->next;
+    if (connection->session) {
+      h2GoAway(connection->session);
+      ServeHTTP2(connection);  // Flush the GOAWAY; closes the connection if it was idle
     }
+  }
+}
 
-    printf("[+] Client connected via TLS\n");
+// ==== FUNCTION: ReloadWorkers ====
+// Pass a reload on to the workers; files are revalidated against the disk, so
+// only the certificates (reloaded by the engine) need refreshing.
+void ReloadWorkers(void) {
+  SignalWorkers(SIGHUP);
+}
+
+// ==== FUNCTION: StartWorkers ====
+// Fork workers that accept from the same listeners and share the file cache region.
+// Must run before any threads are started. Returns 0 in every process on success.
+int StartWorkers(int count) {
+  if (count > MAX_WORKERS) count = MAX_WORKERS;
+  if (count <= 1) return 0;
+
+  pid_t firstProcess = getpid();
+  fflush(stdout);  // Buffered output would otherwise be printed once per worker
+  for (int i = 1; i < count; i++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("Error starting worker");
+      break;
+    }
 
-    // Handle the request and send a response
-    HandleClient(ssl, 1);  // '1' indicates SSL connection
+    if (pid == 0) {
+      engineFollow();
+      workerCount = 0;
 
-    // Shutdown SSL connection
-    printf("[*] Closing client connection\n");
-    SSL_shutdown(ssl);
-    int clientFD = SSL_get_fd(ssl);  // Get underlying socket FD
-    SSL_free(ssl);                   // Free SSL structure
-    close(clientFD);                 // Close socket
+      // Drain and exit with the first process, even if it dies without saying so
+      prctl(PR_SET_PDEATHSIG, SIGQUIT);
+      if (getppid() != firstProcess) raise(SIGQUIT);
+      return handoffForked();
+    }
+    workerPids[workerCount++] = pid;
   }
+
+  printf("[*] Started %d worker processes\n", workerCount);
+  return 0;
 }
 
-void HTTPServerLoop(int port) {
-  // Create main server socket
-  printf("[*] Creating server socket\n");
-  int serverSocketFD = rawNewServerSocket(port);
+// HTTP on the shared connection engine. HTTP/2 is preferred during ALPN, with
+// HTTP/1.1 as the fallback for the whole connection.
+static const ProtocolHandler httpProtocol = {
+  .name = "http",
+  .alpn = "\x02h2\x08http/1.1",
+  .start = StartConnection,
+  .ready = OnClientReady,
+  .release = ReleaseConnection,
+  .drain = DrainConnections,
+  .reload = ReloadWorkers,
+};
+
+// ==== FUNCTION: ServerLoop ====
+// Serve HTTP or HTTPS clients on one event loop until an upgrade has drained.
+void ServerLoop(int port, int SSLMode) {
+  // Create the main server socket, plus a local one for clients on this host
+  if (engineListen(&httpProtocol, port, SSLMode, configGet("unix_socket")) != 0) {
+    return;
+  }
 
-  // Main loop for accepting clients
-  while (1) {
-    printf("[*] Waiting for connection on port %d\n", port);
+  // Small files are kept once in memory shared by all workers, which are forked next
+  long sharedCacheMB = configGetInt("shared_cache_mb", 64);
+  if (sharedCacheMB > 0 && sharedCacheInit((size_t)sharedCacheMB * 1024 * 1024) != 0) {
+    fprintf(stderr, "[!] Continuing without the shared file cache\n");
+  }
+  if (StartWorkers((int)configGetInt("workers", 1)) != 0) {
+    return;
+  }
 
-    // Accept a new client
-    int clientSocketFD = rawAcceptClientConnection(serverSocketFD);
-    printf("[+] Client connected\n");
+  // Cold files are opened and read on I/O threads so the loop never waits on the disk
+  ThreadPool *ioPool = threadPoolNew("io", IO_THREADS, IO_QUEUE_LIMIT);
+  if (!ioPool) {
+    fprintf(stderr, "[!] Failed to start I/O threads\n");
+    return;
+  }
+  fileCacheInit(ioPool);
+
+  // Accepting, admission control, tracing and capture are set up by the engine
+  serverLoop = engineStart();
+  if (!serverLoop || threadPoolAttach(ioPool, serverLoop) != 0) {
+    fprintf(stderr, "[!] Failed to set up event loop\n");
+    return;
+  }
 
-    // Handle the client request
-    HandleClient(&clientSocketFD, 0);  // '0' indicates raw HTTP connection
+  // Paths under a "protect" prefix need credentials the auth server accepts
+  protectedPathCount = configGetAll("protect", protectedPaths, MAX_PROTECTED_PATHS);
+  if (protectedPathCount > MAX_PROTECTED_PATHS) protectedPathCount = MAX_PROTECTED_PATHS;
+  if (protectedPathCount > 0) {
+    AuthClientConfig authConfig = {
+      .address = configGet("auth_server") ? configGet("auth_server") : "127.0.0.1:8090",
+      .connections = (int)configGetInt("auth_connections", 4),
+      .timeoutMs = (int)configGetInt("auth_timeout_ms", 500),
+      .maxInFlight = (int)configGetInt("auth_max_inflight", 256),
+      .cacheTtlMs = (int)configGetInt("auth_cache_ttl_ms", 5000),
+    };
+    if (authClientInit(serverLoop, &authConfig) != 0) {
+      fprintf(stderr, "[!] Failed to set up the auth client\n");
+      return;
+    }
+    printf("[*] Protecting %zu path prefixes with auth server %s\n", protectedPathCount, authConfig.address);
+  }
+  engineRun();
 
-    // Finish
-    printf("[*] Closing client connection");
-    rawCloseSocket(clientSocketFD);
+  // The first process exits last, so whoever started it sees the whole group finish
+  for (int i = 0; i < workerCount; i++) {
+    waitpid(workerPids[i], NULL, 0);
   }
 }
 
 // ==== FUNCTION: main ====
 // Entry point for the Noble HTTP/HTTPS server.
 int main(int argc, char **argv) {
-  printf("NOBLE PORTS HTTP SERVER 0.2.0\n");
+  printf("NOBLE PORTS HTTP SERVER 0.3.0\n");
 
   // Argument failure
   if (argc < 3) {
@@ -219,6 +880,19 @@ int main(int argc, char **argv) {
     return 1;  // Incorrect usage
   }
 
+  // Handle SIGHUP (reload), SIGUSR2 (binary upgrade with socket handoff) and SIGQUIT (drain)
+  if (handoffInit(argv) != 0) {
+    return 1;
+  }
+
+  // A client that disconnects mid-write must not kill the server (TLS writes can't use MSG_NOSIGNAL)
+  signal(SIGPIPE, SIG_IGN);
+
+  // Optional settings; everything has a default
+  if (configLoad("http.conf") != 0) {
+    return 1;
+  }
+
   // Extract port number from arguments
   int port = atoi(argv[1]);
   int SSLMode = 0;
@@ -227,11 +901,7 @@ int main(int argc, char **argv) {
     SSLMode = 1;
   }
 
-  if (SSLMode == 1) {
-    SSLServerLoop(port);
-  } else {
-    HTTPServerLoop(port);
-  }
+  ServerLoop(port, SSLMode);
 
   return 0;
 }
@@ -0,0 +1,9 @@
+#!/bin/bash
+set -e
+
+../common/build.sh
+mkdir -p build
+gcc src/replay.c ../common/build/libnoble.a -o build/replay -O2
+gcc src/idlehold.c ../common/build/libnoble.a -o build/idlehold -O2 -lssl -lcrypto
+gcc src/hashbench.c ../auth/src/header/sha256mb.c -o build/hashbench -O2 -lssl -lcrypto
+gcc src/latency.c -o build/latency -O2 -lssl -lcrypto
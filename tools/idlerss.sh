@@ -0,0 +1,85 @@
+#!/bin/bash
+# Measure the http server's memory per idle HTTP/2 connection
+#
+# Usage: ./idlerss.sh <connections> [http binary]
+# Run after ./build.sh. The server (../http/build/http unless given) is started
+# in HTTPS mode from a scratch directory with a throwaway certificate, one
+# worker per 10000 connections and shedding off. idlehold then opens the
+# connections, up to 14000 per process and source address, and the resident
+# memory of all server processes is summed before and after. PORT overrides
+# the port (8443).
+set -e
+cd "$(dirname "$0")"
+
+if [[ $# -lt 1 ]]; then
+  echo "Usage: $0 <connections> [http binary]" >&2
+  exit 1
+fi
+connections=$1
+server=$(realpath "${2:-../http/build/http}")
+port=${PORT:-8443}
+perHolder=14000
+perWorker=10000
+workers=$(( (connections + perWorker - 1) / perWorker ))
+
+# Every connection is a descriptor on both ends
+ulimit -n "$(ulimit -Hn)"
+
+dir=$(mktemp -d)
+holders=()
+serverPids=()
+cleanup() {
+  kill "${holders[@]}" "${serverPids[@]}" 2>/dev/null || true
+  wait 2>/dev/null || true
+  rm -rf "$dir"
+}
+trap cleanup EXIT
+
+mkdir "$dir/www"
+echo "<html><body>idle</body></html>" > "$dir/www/index.html"
+openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:P-256 -nodes -subj /CN=localhost -days 1 \
+  -keyout "$dir/key.pem" -out "$dir/cert.pem" 2>/dev/null
+printf "workers %d\nshed_target_ms 0\n" "$workers" > "$dir/http.conf"
+
+(cd "$dir" && exec "$server" "$port" HTTPS > server.log 2>&1) &
+serverPids=($!)
+for i in $(seq 1 50); do
+  ss -Hltn "sport = :$port" | grep -q . && break
+  sleep 0.2
+done
+sleep 1
+serverPids+=($(pgrep -P "${serverPids[0]}" || true))
+
+rss() {
+  local total=0
+  for pid in "${serverPids[@]}"; do
+    total=$(( total + $(awk '/^VmRSS/ { print $2 }' "/proc/$pid/status") ))
+  done
+  echo "$total"
+}
+idle=$(rss)
+
+left=$connections
+count=0
+while [[ $left -gt 0 ]]; do
+  take=$(( left < perHolder ? left : perHolder ))
+  count=$(( count + 1 ))
+  ./build/idlehold "127.0.0.1:$port" "$take" "127.0.0.$(( 10 + count ))" > "$dir/hold.$count" 2>> "$dir/hold.errors" &
+  holders+=($!)
+  left=$(( left - take ))
+done
+
+# Handshakes run at a few hundred per second on one core
+for i in $(seq 1 $(( connections / 20 + 120 ))); do
+  [[ $(cat "$dir"/hold.* | grep -c held) -ge $count ]] && break
+  sleep 1
+done
+sleep 2
+
+loaded=$(rss)
+established=$(ss -Htn state established "( sport = :$port )" | wc -l)
+summary=$(awk '/held/ { held += $3; failed += $5 } END { print held " held, " failed " failed" }' "$dir"/hold.*)
+
+echo "[+] $connections connections to $workers workers: $summary, $established open on the server"
+echo "[+] Server RSS: $idle KB idle, $loaded KB loaded"
+echo "[+] Per idle connection: $(( (loaded - idle) * 1024 / connections )) bytes"
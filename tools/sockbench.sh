@@ -0,0 +1,67 @@
+#!/bin/bash
+# Benchmark each socket tuning setting on the http server
+#
+# Usage: ./sockbench.sh [requests] [http binary]
+# Run after ./build.sh. For the defaults and then for one changed setting at a
+# time, the http server (../http/build/http unless given) is started in HTTP mode
+# from a scratch directory with shedding off, and [requests] (20000 by default)
+# GETs of a small page are timed, each on a new connection. The table shows
+# latency, throughput and TCP segments per request. Requests are sent one at a
+# time, so listen_backlog only shows a difference under a burst of connects,
+# and tcp_fastopen only once net.ipv4.tcp_fastopen has bit 2 set. PORT overrides
+# the port (8493).
+set -e
+cd "$(dirname "$0")"
+
+requests=${1:-20000}
+server=$(realpath "${2:-../http/build/http}")
+port=${PORT:-8493}
+
+settings=(
+  ""
+  "tcp_cork 0"
+  "tcp_nodelay 0"
+  "tcp_defer_accept_s 0"
+  "tcp_fastopen 256"
+  "busy_poll_us 50"
+  "send_buffer 4096"
+  "receive_buffer 4096"
+  "listen_backlog 16"
+)
+
+dir=$(mktemp -d)
+serverPid=
+cleanup() {
+  [[ -n $serverPid ]] && kill "$serverPid" 2>/dev/null || true
+  wait 2>/dev/null || true
+  rm -rf "$dir"
+}
+trap cleanup EXIT
+
+mkdir "$dir/www"
+head -c 120 /dev/zero | tr '\0' 'x' | sed 's/.*/<html><body>&<\/body><\/html>/' > "$dir/www/index.html"
+
+printf "%-24s %10s %10s %12s %16s\n" setting "p50 us" "p99 us" requests/s segments/request
+for setting in "${settings[@]}"; do
+  printf "shed_target_ms 0\n%s\n" "$setting" > "$dir/http.conf"
+  (cd "$dir" && exec "$server" "$port" HTTP > server.log 2>&1) &
+  serverPid=$!
+  for i in $(seq 1 50); do
+    ss -Hltn "sport = :$port" | grep -q . && break
+    sleep 0.2
+  done
+
+  # A short warm-up fills the file cache and, with fast open, fetches the cookie
+  ./build/latency "127.0.0.1:$port" new 50 "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n" > /dev/null || true
+  ./build/latency "127.0.0.1:$port" new "$requests" "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n" |
+    awk -v name="${setting:-defaults}" '
+      / done,/ { rate = $(NF - 1) }
+      /p50/ { gsub(",", ""); p50 = $5; p99 = $9 }
+      /segments/ { segments = $NF }
+      END { printf "%-24s %10s %10s %12s %16s\n", name, p50, p99, rate, segments }'
+
+  kill "$serverPid"
+  wait "$serverPid" 2>/dev/null || true
+  serverPid=
+  while ss -Hltn "sport = :$port" | grep -q .; do sleep 0.1; done
+done
@@ -0,0 +1,180 @@
+// hashbench.c - Checks and times the auth server's multi-buffer PBKDF2 against OpenSSL
+//
+// Usage: hashbench [iterations], e.g. `hashbench 100000`. Every implementation the
+// CPU supports is first checked against the RFC 7914 PBKDF2-HMAC-SHA256 vectors and
+// against PKCS5_PBKDF2_HMAC on a batch of mixed password lengths, salt lengths and
+// iteration counts. Then each is timed on one batch of SHA256MB_MAX_LANES derivations
+// at the given iteration count (USER_KDF_ITERATIONS by default), next to the same
+// derivations one at a time with PKCS5_PBKDF2_HMAC and to plain SHA256() calls.
+// Exits non-zero if any result differs.
+
+#include <stdio.h>          // printf, fprintf
+#include <stdlib.h>         // atoi
+#include <string.h>         // memcmp, memset
+#include <time.h>           // clock_gettime
+
+#include <openssl/evp.h>    // PKCS5_PBKDF2_HMAC, EVP_sha256
+#include <openssl/sha.h>    // SHA256
+
+#include "../../auth/src/header/sha256mb.h"   // pbkdf2Sha256Batch, sha256mbUse
+#include "../../auth/src/header/userstore.h"  // USER_KDF_ITERATIONS
+
+#define CHECK_JOBS 37            // Not a multiple of any lane count, so a group is always partial
+#define SHA256_CALLS 2000000     // Plain SHA256() calls timed
+
+static const char *implementationNames[] = { "scalar", "sse2", "avx2", "avx512" };
+
+// RFC 7914 section 11, first 32 bytes of each derived key
+static const struct {
+  const char *password;
+  const char *salt;
+  uint32_t iterations;
+  const char *key;
+} knownAnswers[] = {
+  { "passwd", "salt", 1, "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc" },
+  { "Password", "NaCl", 80000, "4ddcd8f60b98be21830cee5ef22701f9641a4418d04c0414aeff08876b34ab56" },
+};
+
+// Seconds on the monotonic clock
+double nowSeconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+void toHex(const unsigned char *bytes, size_t length, char *out) {
+  for (size_t i = 0; i < length; i++) sprintf(out + 2 * i, "%02x", bytes[i]);
+}
+
+// Check the selected implementation. Returns the number of wrong keys.
+int checkImplementation(void) {
+  int wrong = 0;
+
+  size_t answers = sizeof(knownAnswers) / sizeof(knownAnswers[0]);
+  PBKDF2Job known[sizeof(knownAnswers) / sizeof(knownAnswers[0])];
+  for (size_t i = 0; i < answers; i++) {
+    known[i] = (PBKDF2Job){
+      .password = knownAnswers[i].password,
+      .passwordLength = strlen(knownAnswers[i].password),
+      .salt = (const unsigned char *)knownAnswers[i].salt,
+      .saltLength = strlen(knownAnswers[i].salt),
+      .iterations = knownAnswers[i].iterations,
+    };
+  }
+  pbkdf2Sha256Batch(known, answers);
+  for (size_t i = 0; i < answers; i++) {
+    char hex[2 * SHA256MB_KEY_LENGTH + 1];
+    toHex(known[i].key, SHA256MB_KEY_LENGTH, hex);
+    if (strcmp(hex, knownAnswers[i].key) != 0) {
+      fprintf(stderr, "[!] %s: RFC 7914 vector %zu gave %s\n", sha256mbName(), i + 1, hex);
+      wrong++;
+    }
+  }
+
+  // Passwords up to 100 bytes, so some are longer than the HMAC block and get hashed first.
+  // Iteration counts differ within every group, so lanes finish at different times.
+  static char passwords[CHECK_JOBS][100];
+  static unsigned char salts[CHECK_JOBS][40];
+  PBKDF2Job jobs[CHECK_JOBS];
+  for (size_t i = 0; i < CHECK_JOBS; i++) {
+    size_t passwordLength = (i * 29) % 101 % sizeof(passwords[i]);
+    size_t saltLength = (i * 7) % sizeof(salts[i]);
+    for (size_t j = 0; j < passwordLength; j++) passwords[i][j] = (char)('!' + (i * 13 + j * 7) % 90);
+    for (size_t j = 0; j < saltLength; j++) salts[i][j] = (unsigned char)(i * 31 + j * 17);
+    jobs[i] = (PBKDF2Job){
+      .password = passwords[i],
+      .passwordLength = passwordLength,
+      .salt = salts[i],
+      .saltLength = saltLength,
+      .iterations = (uint32_t)(1 + (i * 97) % 2000),
+    };
+  }
+  pbkdf2Sha256Batch(jobs, CHECK_JOBS);
+  for (size_t i = 0; i < CHECK_JOBS; i++) {
+    unsigned char expected[SHA256MB_KEY_LENGTH];
+    PKCS5_PBKDF2_HMAC(jobs[i].password, (int)jobs[i].passwordLength, jobs[i].salt, (int)jobs[i].saltLength,
+                      (int)jobs[i].iterations, EVP_sha256(), sizeof(expected), expected);
+    if (memcmp(expected, jobs[i].key, sizeof(expected)) != 0) {
+      fprintf(stderr, "[!] %s: job %zu (password %zu bytes, salt %zu, %u iterations) differs from OpenSSL\n",
+              sha256mbName(), i, jobs[i].passwordLength, jobs[i].saltLength, jobs[i].iterations);
+      wrong++;
+    }
+  }
+  return wrong;
+}
+
+// Time one batch of SHA256MB_MAX_LANES derivations. Returns seconds.
+double timeBatch(uint32_t iterations) {
+  PBKDF2Job jobs[SHA256MB_MAX_LANES];
+  for (int i = 0; i < SHA256MB_MAX_LANES; i++) {
+    jobs[i] = (PBKDF2Job){
+      .password = "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef",
+      .passwordLength = 64,
+      .salt = (const unsigned char *)"sixteen byte slt",
+      .saltLength = 16,
+      .iterations = iterations,
+    };
+  }
+  double start = nowSeconds();
+  pbkdf2Sha256Batch(jobs, SHA256MB_MAX_LANES);
+  return nowSeconds() - start;
+}
+
+// Print a timing line: derivations per second and SHA-256 compressions per second
+void report(const char *name, double seconds, uint32_t iterations) {
+  double compressions = (double)SHA256MB_MAX_LANES * iterations * 2;
+  printf("  %-22s %9.1f ms  %8.1f derivations/s  %7.2f M compressions/s\n", name, seconds * 1000,
+         SHA256MB_MAX_LANES / seconds, compressions / seconds / 1e6);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+  uint32_t iterations = argc > 1 ? (uint32_t)atoi(argv[1]) : USER_KDF_ITERATIONS;
+  if (iterations == 0) {
+    fprintf(stderr, "[!] Iterations must be at least 1\n");
+    return 1;
+  }
+
+  int wrong = 0;
+  printf("[*] Known answers and %d mixed jobs against PKCS5_PBKDF2_HMAC\n", CHECK_JOBS);
+  for (size_t i = 0; i < sizeof(implementationNames) / sizeof(implementationNames[0]); i++) {
+    if (sha256mbUse(implementationNames[i]) != 0) {
+      printf("  %-8s not supported by this CPU\n", implementationNames[i]);
+      continue;
+    }
+    int failures = checkImplementation();
+    printf("  %-8s %d lanes: %s\n", sha256mbName(), sha256mbLanes(), failures ? "MISMATCH" : "ok");
+    wrong += failures;
+  }
+
+  printf("[*] %d derivations at %u iterations, one core\n", SHA256MB_MAX_LANES, iterations);
+  for (size_t i = 0; i < sizeof(implementationNames) / sizeof(implementationNames[0]); i++) {
+    if (sha256mbUse(implementationNames[i]) != 0) continue;
+    char name[32];
+    snprintf(name, sizeof(name), "%s (%d lanes)", sha256mbName(), sha256mbLanes());
+    report(name, timeBatch(iterations), iterations);
+  }
+
+  unsigned char key[SHA256MB_KEY_LENGTH];
+  double start = nowSeconds();
+  for (int i = 0; i < SHA256MB_MAX_LANES; i++) {
+    PKCS5_PBKDF2_HMAC("0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef", 64,
+                      (const unsigned char *)"sixteen byte slt", 16, (int)iterations, EVP_sha256(),
+                      sizeof(key), key);
+  }
+  report("PKCS5_PBKDF2_HMAC", nowSeconds() - start, iterations);
+
+  // A 32-byte message pads into one block: the same single compression as a PBKDF2 step
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  memset(digest, 0x5a, sizeof(digest));
+  start = nowSeconds();
+  for (int i = 0; i < SHA256_CALLS; i++) SHA256(digest, sizeof(digest), digest);
+  double seconds = nowSeconds() - start;
+  printf("  %-22s %9.1f ms  %7.2f M compressions/s (%d calls on 32 bytes)\n", "OpenSSL SHA256", seconds * 1000,
+         SHA256_CALLS / seconds / 1e6, SHA256_CALLS);
+
+  return wrong > 0;
+}
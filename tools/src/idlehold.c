@@ -0,0 +1,278 @@
+// idlehold.c - Opens many HTTP/2 connections to the http server and leaves them idle
+//
+// Usage: idlehold <host:port> <connections> [source address], e.g.
+// `idlehold 127.0.0.1:8443 10000 127.0.0.11` to hold 10000 connections from
+// 127.0.0.11. Each connection completes a TLS handshake with ALPN h2, fetches /
+// once and then stays open with nothing in flight, which is the state a server
+// keeps for an idle client. A PING every HOLD_PING_MS keeps the server's idle
+// deadline from closing it. Once every connection is either held or has failed,
+// a summary line is printed; tools/idlerss.sh waits for it before measuring.
+// Loopback has about 28k ephemeral ports per source address, so larger counts
+// are spread over several runs with different source addresses.
+
+#define _GNU_SOURCE
+#include <stdio.h>        // printf, fprintf, perror
+#include <stdlib.h>       // calloc, free, atoi
+#include <string.h>       // memcpy, strrchr
+#include <errno.h>        // errno, EINPROGRESS
+#include <signal.h>       // signal, SIGPIPE
+#include <unistd.h>       // close
+#include <netdb.h>        // getaddrinfo
+#include <sys/socket.h>   // socket, bind, connect
+
+#include <openssl/ssl.h>  // TLS client
+
+#include "../../common/src/header/eventloop.h"  // epoll loop and timeouts
+
+#define HOLD_PING_MS 30000       // Half the server's idle deadline
+#define HOLD_CONNECTING_MAX 64   // Handshakes in flight at once
+#define HOLD_TIMEOUT_MS 10000    // A connection not held by now has failed
+#define FRAME_HEADER 9
+
+// Client preface, an empty SETTINGS frame and GET / on stream 1 (END_STREAM | END_HEADERS).
+// The header block is :method GET, :scheme https, :path / and :authority localhost.
+static const unsigned char request[] =
+  "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+  "\x00\x00\x00\x04\x00\x00\x00\x00\x00"
+  "\x00\x00\x0e\x01\x05\x00\x00\x00\x01"
+  "\x82\x87\x84\x01\x09localhost";
+static const unsigned char settingsAck[] = "\x00\x00\x00\x04\x01\x00\x00\x00\x00";
+static const unsigned char ping[] = "\x00\x00\x08\x06\x00\x00\x00\x00\x00" "idlehold";
+
+typedef enum {
+  HOLD_CONNECTING,     // TCP connect and TLS handshake
+  HOLD_WAITING,        // Request sent, waiting for the end of the response
+  HOLD_IDLE            // Response complete; only PINGs from here on
+} HoldState;
+
+// One connection. Frames are parsed as they stream past, so nothing but the
+// current frame header is kept between reads.
+typedef struct {
+  EventHandler handler;
+  Timer timer;
+  SSL *ssl;
+  HoldState state;
+  unsigned char header[FRAME_HEADER];
+  size_t headerLength;
+  size_t skip;          // Payload bytes of the current frame still to discard
+} Holder;
+
+static EventLoop *loop;
+static SSL_CTX *context;
+static struct sockaddr_storage serverAddress, sourceAddress;
+static socklen_t serverAddressLength, sourceAddressLength;
+
+static size_t target;
+static size_t opened;
+static size_t connecting;
+static size_t held;
+static size_t failed;
+static size_t lost;             // Held, then closed by the server
+static int reported;
+
+void openMore(void);
+
+// Accept "host:port" or a bare host (port 0), as used for the source address
+int resolve(const char *address, struct sockaddr_storage *out, socklen_t *length) {
+  char host[256];
+  const char *colon = strrchr(address, ':');
+  size_t hostLength = colon ? (size_t)(colon - address) : strlen(address);
+  if (hostLength >= sizeof(host)) return -1;
+  memcpy(host, address, hostLength);
+  host[hostLength] = '\0';
+
+  struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+  struct addrinfo *result;
+  int status = getaddrinfo(host, colon ? colon + 1 : "0", &hints, &result);
+  if (status != 0) {
+    fprintf(stderr, "[!] Cannot resolve %s: %s\n", address, gai_strerror(status));
+    return -1;
+  }
+  memcpy(out, result->ai_addr, result->ai_addrlen);
+  *length = result->ai_addrlen;
+  freeaddrinfo(result);
+  return 0;
+}
+
+// Print the summary once every connection has been held or given up on
+void reportIfSettled(void) {
+  if (reported || opened < target || connecting > 0) return;
+  reported = 1;
+  printf("[+] held %zu failed %zu\n", held, failed);
+  fflush(stdout);
+}
+
+// Close a connection; one that was being held counts as lost
+void dropHolder(Holder *holder) {
+  if (holder->state == HOLD_IDLE) {
+    held--;
+    lost++;
+    fprintf(stderr, "[!] Server closed a held connection (%zu lost)\n", lost);
+  } else {
+    connecting--;
+    failed++;
+  }
+  eventLoopRemove(loop, &holder->handler);
+  timerCancel(eventLoopTimers(loop), &holder->timer);
+  SSL_free(holder->ssl);
+  close(holder->handler.fd);
+  free(holder);
+
+  openMore();
+  reportIfSettled();
+}
+
+// Consume received bytes frame by frame: ACK the server's SETTINGS and note the
+// end of the response on stream 1. Returns 1 once the response is complete.
+int readFrames(Holder *holder, const unsigned char *data, size_t length) {
+  int complete = 0;
+  while (length > 0) {
+    if (holder->skip > 0) {
+      size_t take = length < holder->skip ? length : holder->skip;
+      holder->skip -= take;
+      data += take;
+      length -= take;
+      continue;
+    }
+
+    size_t take = FRAME_HEADER - holder->headerLength;
+    if (take > length) take = length;
+    memcpy(holder->header + holder->headerLength, data, take);
+    holder->headerLength += take;
+    data += take;
+    length -= take;
+    if (holder->headerLength < FRAME_HEADER) break;
+
+    const unsigned char *header = holder->header;
+    unsigned type = header[3], flags = header[4];
+    uint32_t streamId = ((uint32_t)(header[5] & 0x7f) << 24) | ((uint32_t)header[6] << 16) |
+                        ((uint32_t)header[7] << 8) | header[8];
+    holder->skip = ((size_t)header[0] << 16) | ((size_t)header[1] << 8) | header[2];
+    holder->headerLength = 0;
+
+    if (type == 0x4 && !(flags & 0x1)) SSL_write(holder->ssl, settingsAck, sizeof(settingsAck) - 1);
+    if ((type == 0x0 || type == 0x1) && (flags & 0x1) && streamId == 1) complete = 1;
+  }
+  return complete;
+}
+
+// Readiness: drive the handshake, then read frames until the response has arrived
+void onHolderReady(EventLoop *eventLoop, EventHandler *handler, uint32_t events) {
+  (void)eventLoop;
+  (void)events;
+  Holder *holder = handler->data;
+
+  if (holder->state == HOLD_CONNECTING) {
+    int result = SSL_do_handshake(holder->ssl);
+    if (result != 1) {
+      int error = SSL_get_error(holder->ssl, result);
+      if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) {
+        eventLoopModify(loop, handler, error == SSL_ERROR_WANT_WRITE ? EPOLLOUT : EPOLLIN);
+        return;
+      }
+      dropHolder(holder);
+      return;
+    }
+
+    const unsigned char *protocol;
+    unsigned int protocolLength;
+    SSL_get0_alpn_selected(holder->ssl, &protocol, &protocolLength);
+    if (protocolLength != 2 || memcmp(protocol, "h2", 2) != 0 ||
+        SSL_write(holder->ssl, request, sizeof(request) - 1) != (int)sizeof(request) - 1) {
+      dropHolder(holder);
+      return;
+    }
+    holder->state = HOLD_WAITING;
+    eventLoopModify(loop, handler, EPOLLIN);
+  }
+
+  unsigned char buffer[16384];
+  while (1) {
+    int bytesRead = SSL_read(holder->ssl, buffer, sizeof(buffer));
+    if (bytesRead <= 0) {
+      if (SSL_get_error(holder->ssl, bytesRead) == SSL_ERROR_WANT_READ) break;
+      dropHolder(holder);
+      return;
+    }
+    if (readFrames(holder, buffer, (size_t)bytesRead) && holder->state == HOLD_WAITING) {
+      holder->state = HOLD_IDLE;
+      connecting--;
+      held++;
+      timerArm(eventLoopTimers(loop), &holder->timer, HOLD_PING_MS);
+      openMore();
+      reportIfSettled();
+    }
+  }
+}
+
+// Keep a held connection open, or give up on one that never got its response
+void onHolderTimer(Timer *timer) {
+  Holder *holder = timer->data;
+  if (holder->state != HOLD_IDLE) {
+    dropHolder(holder);
+    return;
+  }
+  SSL_write(holder->ssl, ping, sizeof(ping) - 1);
+  timerArm(eventLoopTimers(loop), &holder->timer, HOLD_PING_MS);
+}
+
+// Start connections until HOLD_CONNECTING_MAX are in progress or all have been opened
+void openMore(void) {
+  while (opened < target && connecting < HOLD_CONNECTING_MAX) {
+    opened++;
+    int fd = socket(serverAddress.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      perror("Error creating socket");
+      failed++;
+      continue;
+    }
+    if ((sourceAddressLength && bind(fd, (struct sockaddr *)&sourceAddress, sourceAddressLength) != 0) ||
+        (connect(fd, (struct sockaddr *)&serverAddress, serverAddressLength) != 0 && errno != EINPROGRESS)) {
+      perror("Error connecting");
+      close(fd);
+      failed++;
+      continue;
+    }
+
+    Holder *holder = calloc(1, sizeof(Holder));
+    SSL *ssl = SSL_new(context);
+    if (!holder || !ssl || eventLoopAdd(loop, &holder->handler, fd, EPOLLOUT, onHolderReady, holder) != 0) {
+      SSL_free(ssl);
+      free(holder);
+      close(fd);
+      failed++;
+      continue;
+    }
+    holder->ssl = ssl;
+    SSL_set_fd(ssl, fd);
+    SSL_set_connect_state(ssl);
+    timerInit(&holder->timer, onHolderTimer, holder);
+    timerArm(eventLoopTimers(loop), &holder->timer, HOLD_TIMEOUT_MS);
+    connecting++;
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3 || argc > 4) {
+    fprintf(stderr, "Usage: %s <host:port> <connections> [source address]\n", argv[0]);
+    return 1;
+  }
+  target = (size_t)atoi(argv[2]);
+  if (resolve(argv[1], &serverAddress, &serverAddressLength) != 0) return 1;
+  if (argc > 3 && resolve(argv[3], &sourceAddress, &sourceAddressLength) != 0) return 1;
+
+  // The client's own record buffers are released too, so many holders fit in one process
+  context = SSL_CTX_new(TLS_client_method());
+  if (!context) return 1;
+  SSL_CTX_set_alpn_protos(context, (const unsigned char *)"\x02h2", 3);
+  SSL_CTX_set_mode(context, SSL_MODE_RELEASE_BUFFERS);
+
+  signal(SIGPIPE, SIG_IGN);
+  loop = eventLoopNew();
+  if (!loop) return 1;
+
+  openMore();
+  reportIfSettled();
+  eventLoopRun(loop);
+  return 0;
+}
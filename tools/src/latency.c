@@ -0,0 +1,262 @@
+// latency.c - Measures request round trips to either server, one request at a time
+//
+// Usage: latency <host:port | tls:host:port | unix:/path> <new | persistent> <requests> <request>
+// e.g. `latency unix:/tmp/auth.sock persistent 20000 "VERIFY x"` or
+// `latency 127.0.0.1:8080 new 3000 "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"`.
+// "\r" and "\n" in the request are unescaped. In new mode every request opens a
+// connection (and runs the TLS handshake), and its reply ends when the server
+// closes it; a line request without a newline gets one. In persistent mode one
+// connection starts with PIPELINE and each reply is one line, so this only suits
+// the auth server. Prints latency percentiles, throughput and the TCP segments
+// the host sent per request, which on loopback counts both directions.
+
+#define _GNU_SOURCE
+#include <stdio.h>        // printf, fprintf, perror, fopen
+#include <stdlib.h>       // malloc, qsort, atoi, atoll
+#include <string.h>       // memcpy, memchr, strcmp, strncmp, strlen, strrchr, strtok_r
+#include <signal.h>       // signal, SIGPIPE
+#include <time.h>         // clock_gettime
+#include <unistd.h>       // close
+#include <netdb.h>        // getaddrinfo
+#include <netinet/in.h>   // IPPROTO_TCP
+#include <netinet/tcp.h>  // TCP_NODELAY, TCP_FASTOPEN_CONNECT
+#include <sys/socket.h>   // socket, connect, send, recv
+#include <sys/un.h>       // sockaddr_un
+
+#include <openssl/ssl.h>  // TLS client
+
+typedef struct {
+  int fd;
+  SSL *ssl;
+} Link;
+
+static struct sockaddr_storage serverAddress;
+static socklen_t serverAddressLength;
+static SSL_CTX *context;          // Set for tls: addresses
+
+// Microseconds on the monotonic clock
+uint64_t nowUs(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+// Accept "host:port", "tls:host:port" or "unix:/path"
+int resolveAddress(const char *address) {
+  if (strncmp(address, "unix:", 5) == 0) {
+    struct sockaddr_un *unixAddress = (struct sockaddr_un *)&serverAddress;
+    const char *path = address + 5;
+    if (strlen(path) >= sizeof(unixAddress->sun_path)) {
+      fprintf(stderr, "[!] Socket path too long: %s\n", path);
+      return -1;
+    }
+    unixAddress->sun_family = AF_UNIX;
+    strcpy(unixAddress->sun_path, path);
+    serverAddressLength = sizeof(struct sockaddr_un);
+    return 0;
+  }
+
+  if (strncmp(address, "tls:", 4) == 0) {
+    address += 4;
+    context = SSL_CTX_new(TLS_client_method());
+    if (!context) return -1;
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    // The servers close after a reply without close_notify; count that as the end of it
+    SSL_CTX_set_options(context, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+  }
+
+  char host[256];
+  const char *colon = strrchr(address, ':');
+  if (!colon || (size_t)(colon - address) >= sizeof(host)) {
+    fprintf(stderr, "[!] Address must be host:port, tls:host:port or unix:/path, got %s\n", address);
+    return -1;
+  }
+  memcpy(host, address, (size_t)(colon - address));
+  host[colon - address] = '\0';
+
+  struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+  struct addrinfo *result;
+  int status = getaddrinfo(host, colon + 1, &hints, &result);
+  if (status != 0) {
+    fprintf(stderr, "[!] Cannot resolve %s: %s\n", address, gai_strerror(status));
+    return -1;
+  }
+  memcpy(&serverAddress, result->ai_addr, result->ai_addrlen);
+  serverAddressLength = result->ai_addrlen;
+  freeaddrinfo(result);
+  return 0;
+}
+
+// Connect, with the TLS handshake for tls: addresses. Returns 0 on success.
+int openLink(Link *link) {
+  link->ssl = NULL;
+  link->fd = socket(serverAddress.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (link->fd < 0) return -1;
+  if (serverAddress.ss_family != AF_UNIX) {
+    // Fast open carries the request in the SYN once the server has handed out a cookie
+    int on = 1;
+    setsockopt(link->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    setsockopt(link->fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on, sizeof(on));
+  }
+  if (connect(link->fd, (struct sockaddr *)&serverAddress, serverAddressLength) != 0) {
+    close(link->fd);
+    return -1;
+  }
+  if (!context) return 0;
+
+  link->ssl = SSL_new(context);
+  if (!link->ssl || !SSL_set_fd(link->ssl, link->fd) || SSL_connect(link->ssl) != 1) {
+    SSL_free(link->ssl);
+    close(link->fd);
+    return -1;
+  }
+  return 0;
+}
+
+void closeLink(Link *link) {
+  if (link->ssl) {
+    SSL_shutdown(link->ssl);
+    SSL_free(link->ssl);
+  }
+  close(link->fd);
+}
+
+int sendAll(Link *link, const char *data, size_t length) {
+  while (length > 0) {
+    int bytesSent = link->ssl ? SSL_write(link->ssl, data, (int)length)
+                              : (int)send(link->fd, data, length, MSG_NOSIGNAL);
+    if (bytesSent <= 0) return -1;
+    data += bytesSent;
+    length -= (size_t)bytesSent;
+  }
+  return 0;
+}
+
+// Read until a newline (untilClose == 0) or until the server closes. Returns 0 once
+// the reply is complete, -1 if the connection failed first.
+int readReply(Link *link, int untilClose) {
+  char buffer[16384];
+  while (1) {
+    int bytesRead = link->ssl ? SSL_read(link->ssl, buffer, sizeof(buffer))
+                              : (int)recv(link->fd, buffer, sizeof(buffer), 0);
+    if (bytesRead <= 0) {
+      int closed = link->ssl ? SSL_get_error(link->ssl, bytesRead) == SSL_ERROR_ZERO_RETURN : bytesRead == 0;
+      return untilClose && closed ? 0 : -1;
+    }
+    if (!untilClose && memchr(buffer, '\n', (size_t)bytesRead)) return 0;
+  }
+}
+
+// Segments sent by this host so far, from the Tcp OutSegs counter
+long long outSegments(void) {
+  FILE *file = fopen("/proc/net/snmp", "r");
+  if (!file) return -1;
+
+  char names[1024], values[1024];
+  long long segments = -1;
+  while (fgets(names, sizeof(names), file) && fgets(values, sizeof(values), file)) {
+    if (strncmp(names, "Tcp:", 4) != 0) continue;
+    char *nameSave, *valueSave;
+    char *name = strtok_r(names, " \n", &nameSave);
+    char *value = strtok_r(values, " \n", &valueSave);
+    while (name && value) {
+      if (strcmp(name, "OutSegs") == 0) segments = atoll(value);
+      name = strtok_r(NULL, " \n", &nameSave);
+      value = strtok_r(NULL, " \n", &valueSave);
+    }
+  }
+  fclose(file);
+  return segments;
+}
+
+// Turn "\r" and "\n" escapes into the characters, in place
+void unescape(char *text) {
+  char *out = text;
+  for (char *in = text; *in; in++) {
+    if (in[0] == '\\' && (in[1] == 'r' || in[1] == 'n')) {
+      *out++ = in[1] == 'r' ? '\r' : '\n';
+      in++;
+    } else {
+      *out++ = *in;
+    }
+  }
+  *out = '\0';
+}
+
+int compareLatency(const void *a, const void *b) {
+  double left = *(const double *)a, right = *(const double *)b;
+  return left < right ? -1 : left > right;
+}
+
+// Latency below which the given share of requests finished
+double percentile(const double *latencies, size_t count, double share) {
+  if (count == 0) return 0;
+  return latencies[(size_t)(share * (double)(count - 1) + 0.5)];
+}
+
+int main(int argc, char **argv) {
+  if (argc != 5 || (strcmp(argv[2], "new") != 0 && strcmp(argv[2], "persistent") != 0) || atoi(argv[3]) <= 0) {
+    fprintf(stderr, "Usage: %s <host:port | tls:host:port | unix:/path> <new | persistent> <requests> <request>\n",
+            argv[0]);
+    return 1;
+  }
+  if (resolveAddress(argv[1]) != 0) return 1;
+  int persistent = strcmp(argv[2], "persistent") == 0;
+  size_t count = (size_t)atoi(argv[3]);
+
+  // Line requests need their newline; HTTP requests bring their own blank line
+  size_t requestLength = strlen(argv[4]);
+  char *request = malloc(requestLength + 2);
+  double *latencies = malloc(count * sizeof(double));
+  if (!request || !latencies) return 1;
+  memcpy(request, argv[4], requestLength + 1);
+  unescape(request);
+  requestLength = strlen(request);
+  if (requestLength == 0 || request[requestLength - 1] != '\n') {
+    request[requestLength++] = '\n';
+    request[requestLength] = '\0';
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  Link link;
+  if (persistent && (openLink(&link) != 0 || sendAll(&link, "PIPELINE\n", 9) != 0)) {
+    fprintf(stderr, "[!] Cannot connect to %s\n", argv[1]);
+    return 1;
+  }
+
+  size_t done = 0;
+  long long segmentsBefore = outSegments();
+  uint64_t startUs = nowUs();
+  for (size_t i = 0; i < count; i++) {
+    uint64_t requestStartUs = nowUs();
+    int ok;
+    if (persistent) {
+      ok = sendAll(&link, request, requestLength) == 0 && readReply(&link, 0) == 0;
+      if (!ok) break;
+    } else {
+      ok = openLink(&link) == 0;
+      if (ok) {
+        ok = sendAll(&link, request, requestLength) == 0 && readReply(&link, 1) == 0;
+        closeLink(&link);
+      }
+    }
+    if (!ok) continue;
+    latencies[done++] = (double)(nowUs() - requestStartUs);
+  }
+  double elapsed = (double)(nowUs() - startUs) / 1e6;
+  long long segments = outSegments() - segmentsBefore;
+  if (persistent) closeLink(&link);
+  size_t failed = count - done;
+
+  qsort(latencies, done, sizeof(double), compareLatency);
+  printf("[+] %s %s: %zu done, %zu failed, %.0f requests/s\n", argv[1], argv[2], done, failed,
+         elapsed > 0 ? (double)done / elapsed : 0);
+  printf("[+] Latency us: p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+         percentile(latencies, done, 0.5), percentile(latencies, done, 0.9), percentile(latencies, done, 0.99),
+         percentile(latencies, done, 0.999), percentile(latencies, done, 1));
+  if (segmentsBefore >= 0 && done > 0 && serverAddress.ss_family != AF_UNIX) {
+    printf("[+] TCP segments per request: %.1f\n", (double)segments / (double)done);
+  }
+  return failed > 0;
+}
@@ -0,0 +1,491 @@
+// replay.c - Sends a captured request log to a server and reports how it kept up
+//
+// Usage: replay <capture file> <host:port | unix:/path> [speed] [connections], e.g.
+// `replay requests.cap 127.0.0.1:8080 2` to play a capture from the http server at
+// twice the recorded rate. Speed is 1 by default, or "max" to send as fast as the
+// server answers with up to [connections] (64) open at a time. Each captured
+// connection is replayed as a plaintext connection: an HTTP request or plain auth
+// request gets its own, and a pipelined auth connection sends its lines on one.
+
+#define _GNU_SOURCE
+#include <stdio.h>        // printf, fprintf, perror
+#include <stdlib.h>       // malloc, calloc, free, qsort, strtod, atoi
+#include <string.h>       // memcpy, memchr, strcmp, strncmp, strlen
+#include <errno.h>        // errno, EAGAIN
+#include <fcntl.h>        // fcntl, O_NONBLOCK
+#include <signal.h>       // signal, SIGPIPE
+#include <time.h>         // clock_gettime
+#include <unistd.h>       // close, read
+#include <netdb.h>        // getaddrinfo
+#include <netinet/in.h>   // IPPROTO_TCP
+#include <netinet/tcp.h>  // TCP_NODELAY
+#include <sys/socket.h>   // socket, connect, send, recv
+#include <sys/timerfd.h>  // timerfd_create, timerfd_settime
+#include <sys/un.h>       // sockaddr_un
+
+#include "../../common/src/header/capture.h"    // Capture file format
+#include "../../common/src/header/eventloop.h"  // epoll loop and timeouts
+
+#define REPLY_TIMEOUT_MS 10000   // A connection owed replies that makes no progress for this long has failed
+#define STATUS_MAX 16            // Distinct reply statuses counted
+#define STATUS_LENGTH 16
+
+// One captured connection being replayed
+typedef struct {
+  EventHandler handler;
+  Timer timer;
+  int fd;                        // -1 until opened, and again once finished
+  int pipelined;
+  size_t *requests;              // Record indices, in the order they are sent
+  size_t count;
+  size_t sent;                   // Requests queued for sending
+  size_t answered;
+  uint64_t *sentUs;              // When each request was queued
+
+  char *output;                  // Requests not yet accepted by the socket
+  size_t outputLength;
+  size_t outputSent;
+
+  char head[STATUS_LENGTH];      // Start of the reply being read, for its status
+  size_t headLength;
+} Session;
+
+typedef struct {
+  char text[STATUS_LENGTH];
+  size_t count;
+} StatusCount;
+
+static EventLoop *loop;
+static struct sockaddr_storage serverAddress;
+static socklen_t serverAddressLength;
+
+static CaptureRecord *records;
+static size_t recordCount;
+static size_t *sessionOf;        // Session of each record
+static Session *sessions;
+static size_t sessionCount;
+static size_t sessionsStarted;
+static size_t sessionsOpen;
+static size_t sessionsDone;
+
+static double speed;             // 0 for as fast as possible
+static size_t maxOpen;
+static uint64_t startUs;
+static size_t nextRecord;        // Next record to send on schedule
+static EventHandler scheduleHandler;
+static uint64_t worstLagUs;      // Furthest a request was sent behind its schedule
+
+static double *latencies;        // Milliseconds, one per answered request
+static size_t answered;
+static size_t failed;
+static StatusCount statuses[STATUS_MAX];
+
+// Microseconds on the monotonic clock
+uint64_t nowUs(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+// Accept "host:port" or "unix:/path"
+int resolveAddress(const char *address) {
+  if (strncmp(address, "unix:", 5) == 0) {
+    struct sockaddr_un *unixAddress = (struct sockaddr_un *)&serverAddress;
+    const char *path = address + 5;
+    if (strlen(path) >= sizeof(unixAddress->sun_path)) {
+      fprintf(stderr, "[!] Socket path too long: %s\n", path);
+      return -1;
+    }
+    unixAddress->sun_family = AF_UNIX;
+    strcpy(unixAddress->sun_path, path);
+    serverAddressLength = sizeof(struct sockaddr_un);
+    return 0;
+  }
+
+  char host[256];
+  const char *colon = strrchr(address, ':');
+  if (!colon || (size_t)(colon - address) >= sizeof(host)) {
+    fprintf(stderr, "[!] Address must be host:port or unix:/path, got %s\n", address);
+    return -1;
+  }
+  memcpy(host, address, (size_t)(colon - address));
+  host[colon - address] = '\0';
+
+  struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+  struct addrinfo *result;
+  int status = getaddrinfo(host, colon + 1, &hints, &result);
+  if (status != 0) {
+    fprintf(stderr, "[!] Cannot resolve %s: %s\n", address, gai_strerror(status));
+    return -1;
+  }
+  memcpy(&serverAddress, result->ai_addr, result->ai_addrlen);
+  serverAddressLength = result->ai_addrlen;
+  freeaddrinfo(result);
+  return 0;
+}
+
+// Order pipelined records by the connection they arrived on, keeping arrival order within it
+int compareConnection(const void *a, const void *b) {
+  const CaptureRecord *left = &records[*(const size_t *)a];
+  const CaptureRecord *right = &records[*(const size_t *)b];
+  if (left->process != right->process) return left->process < right->process ? -1 : 1;
+  if (left->connection != right->connection) return left->connection < right->connection ? -1 : 1;
+  return *(const size_t *)a < *(const size_t *)b ? -1 : 1;
+}
+
+// Group the records into the connections that will replay them. Sessions are numbered
+// by their first request, so starting them in order follows the capture.
+int buildSessions(void) {
+  size_t *order = malloc(recordCount * sizeof(size_t));
+  size_t *firstOf = malloc(recordCount * sizeof(size_t));
+  sessionOf = malloc(recordCount * sizeof(size_t));
+  if (!order || !firstOf || !sessionOf) return -1;
+
+  // Every request on a pipelined connection leads back to the first one
+  size_t pipelined = 0;
+  for (size_t i = 0; i < recordCount; i++) {
+    firstOf[i] = i;
+    if (records[i].flags & CAPTURE_PIPELINED) order[pipelined++] = i;
+  }
+  qsort(order, pipelined, sizeof(size_t), compareConnection);
+  for (size_t i = 1; i < pipelined; i++) {
+    const CaptureRecord *previous = &records[order[i - 1]];
+    const CaptureRecord *current = &records[order[i]];
+    if (previous->process == current->process && previous->connection == current->connection) {
+      firstOf[order[i]] = firstOf[order[i - 1]];
+    }
+  }
+
+  for (size_t i = 0; i < recordCount; i++) {
+    sessionOf[i] = firstOf[i] == i ? sessionCount++ : sessionOf[firstOf[i]];
+  }
+  sessions = calloc(sessionCount, sizeof(Session));
+  size_t *requests = malloc(recordCount * sizeof(size_t));
+  uint64_t *sentUs = malloc(recordCount * sizeof(uint64_t));
+  if (!sessions || !requests || !sentUs) return -1;
+
+  for (size_t i = 0; i < recordCount; i++) sessions[sessionOf[i]].count++;
+  size_t offset = 0;
+  for (size_t i = 0; i < sessionCount; i++) {
+    sessions[i].fd = -1;
+    sessions[i].requests = requests + offset;
+    sessions[i].sentUs = sentUs + offset;
+    offset += sessions[i].count;
+    sessions[i].count = 0;
+  }
+  for (size_t i = 0; i < recordCount; i++) {
+    Session *session = &sessions[sessionOf[i]];
+    session->pipelined = (records[i].flags & CAPTURE_PIPELINED) != 0;
+    session->requests[session->count++] = i;
+  }
+
+  free(order);
+  free(firstOf);
+  return 0;
+}
+
+// Count a reply by its status: the code of an HTTP reply, or the first word of an auth one
+void countStatus(const char *head, size_t length) {
+  const char *start = head;
+  const char *end = head + length;
+  if (length > 5 && strncmp(head, "HTTP/", 5) == 0) {
+    const char *space = memchr(head, ' ', length);
+    start = space ? space + 1 : end;
+  }
+  const char *stop = start;
+  while (stop < end && *stop != ' ' && *stop != '\r' && *stop != '\n') stop++;
+
+  char text[STATUS_LENGTH];
+  size_t textLength = (size_t)(stop - start);
+  memcpy(text, start, textLength);
+  text[textLength] = '\0';
+  if (textLength == 0) strcpy(text, "(empty)");
+
+  for (int i = 0; i < STATUS_MAX; i++) {
+    if (statuses[i].count == 0) strcpy(statuses[i].text, text);
+    if (strcmp(statuses[i].text, text) == 0) {
+      statuses[i].count++;
+      return;
+    }
+  }
+}
+
+void startSessions(void);
+
+// Close a connection that is done, counting whatever it never got answered
+void finishSession(Session *session) {
+  failed += session->count - session->answered;
+  eventLoopRemove(loop, &session->handler);
+  timerCancel(eventLoopTimers(loop), &session->timer);
+  close(session->fd);
+  session->fd = -1;
+  free(session->output);
+  session->output = NULL;
+  sessionsOpen--;
+  sessionsDone++;
+
+  if (sessionsDone == sessionCount) {
+    eventLoopStop(loop);
+  } else if (speed == 0) {
+    startSessions();
+  }
+}
+
+// A connection made no progress for REPLY_TIMEOUT_MS
+void onSessionTimeout(Timer *timer) {
+  finishSession(timer->data);
+}
+
+// Time a connection only while it is owed replies: a pipelined connection that has
+// caught up may wait far longer than REPLY_TIMEOUT_MS for its next request's turn
+void armReplyTimer(Session *session) {
+  TimerWheel *timers = eventLoopTimers(loop);
+  if (session->answered < session->sent) {
+    timerArm(timers, &session->timer, REPLY_TIMEOUT_MS);
+  } else {
+    timerCancel(timers, &session->timer);
+  }
+}
+
+// Record the reply to the oldest outstanding request
+void completeReply(Session *session) {
+  latencies[answered++] = (double)(nowUs() - session->sentUs[session->answered]) / 1000.0;
+  session->answered++;
+  countStatus(session->head, session->headLength);
+  session->headLength = 0;
+}
+
+// Write as much queued output as the socket takes
+int flushOutput(Session *session) {
+  while (session->outputSent < session->outputLength) {
+    ssize_t bytesSent = send(session->fd, session->output + session->outputSent,
+                             session->outputLength - session->outputSent, MSG_NOSIGNAL);
+    if (bytesSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    if (bytesSent <= 0) return -1;
+    session->outputSent += (size_t)bytesSent;
+  }
+  if (session->outputSent == session->outputLength) session->outputSent = session->outputLength = 0;
+  eventLoopModify(loop, &session->handler, EPOLLIN | (session->outputLength ? EPOLLOUT : 0));
+  return 0;
+}
+
+// Read replies: a plain connection's reply ends when the server closes it, a
+// pipelined connection's replies are one line each
+void onSessionReady(EventLoop *eventLoop, EventHandler *handler, uint32_t events) {
+  (void)eventLoop;
+  Session *session = handler->data;
+
+  if ((events & EPOLLOUT) && flushOutput(session) != 0) {
+    finishSession(session);
+    return;
+  }
+
+  char buffer[16384];
+  while (1) {
+    ssize_t bytesRead = recv(session->fd, buffer, sizeof(buffer), 0);
+    if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    if (bytesRead <= 0) {
+      // A plain connection's reply is complete once the server closes it; closing without one is a failure
+      if (bytesRead == 0 && !session->pipelined && session->headLength > 0 && session->answered < session->sent) {
+        completeReply(session);
+      }
+      finishSession(session);
+      return;
+    }
+
+    for (ssize_t i = 0; i < bytesRead; i++) {
+      if (session->headLength < STATUS_LENGTH - 1) session->head[session->headLength++] = buffer[i];
+      if (session->pipelined && buffer[i] == '\n' && session->answered < session->sent) {
+        completeReply(session);
+      }
+    }
+    armReplyTimer(session);
+    if (session->pipelined && session->answered == session->count) {
+      finishSession(session);
+      return;
+    }
+  }
+}
+
+// Connect a session to the server
+int openSession(Session *session) {
+  int fd = socket(serverAddress.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, (struct sockaddr *)&serverAddress, serverAddressLength) != 0) {
+    close(fd);
+    return -1;
+  }
+  if (serverAddress.ss_family != AF_UNIX) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  if (eventLoopAdd(loop, &session->handler, fd, EPOLLIN, onSessionReady, session) != 0) {
+    close(fd);
+    return -1;
+  }
+  session->fd = fd;
+  timerInit(&session->timer, onSessionTimeout, session);
+  sessionsStarted++;
+  sessionsOpen++;
+
+  if (session->pipelined) {
+    memcpy(session->output, "PIPELINE\n", 9);
+    session->outputLength = 9;
+  }
+  return 0;
+}
+
+// Queue the session's next request, opening the connection first if need be.
+// Returns -1 if the session had to be given up.
+int sendNext(Session *session) {
+  if (session->fd < 0) {
+    // Room for every request, so queuing never reallocates
+    size_t capacity = 16;
+    for (size_t i = 0; i < session->count; i++) capacity += records[session->requests[i]].length + 1;
+    session->output = malloc(capacity);
+    if (!session->output || openSession(session) != 0) {
+      free(session->output);
+      session->output = NULL;
+      failed += session->count;
+      session->sent = session->count;
+      sessionsStarted++;
+      sessionsDone++;
+      if (sessionsDone == sessionCount) eventLoopStop(loop);
+      return -1;
+    }
+  }
+
+  const CaptureRecord *record = &records[session->requests[session->sent]];
+  memcpy(session->output + session->outputLength, record->data, record->length);
+  session->outputLength += record->length;
+  if (session->pipelined) session->output[session->outputLength++] = '\n';
+  session->sentUs[session->sent++] = nowUs();
+  if (!timerIsArmed(&session->timer)) armReplyTimer(session);  // Earlier replies still owed keep their deadline
+
+  if (flushOutput(session) != 0) {
+    finishSession(session);
+    return -1;
+  }
+  return 0;
+}
+
+// As fast as possible: keep up to maxOpen connections busy, each sending all of its requests
+void startSessions(void) {
+  while (sessionsOpen < maxOpen && sessionsStarted < sessionCount) {
+    Session *session = &sessions[sessionsStarted];
+    while (session->sent < session->count && sendNext(session) == 0) {}
+  }
+}
+
+// Arm the schedule timer for the next record's place in the capture
+void scheduleNext(void) {
+  if (nextRecord == recordCount) return;
+
+  uint64_t offsetUs = (uint64_t)((double)(records[nextRecord].timeUs - records[0].timeUs) / speed);
+  uint64_t dueUs = startUs + offsetUs;
+  struct itimerspec due = {
+    .it_value = { .tv_sec = (time_t)(dueUs / 1000000), .tv_nsec = (long)(dueUs % 1000000) * 1000 + 1 },
+  };
+  timerfd_settime(scheduleHandler.fd, TFD_TIMER_ABSTIME, &due, NULL);
+}
+
+// On schedule: send every record whose time has come
+void onSchedule(EventLoop *eventLoop, EventHandler *handler, uint32_t events) {
+  (void)eventLoop;
+  (void)events;
+  uint64_t expirations;
+  if (read(handler->fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) return;
+
+  uint64_t now = nowUs();
+  while (nextRecord < recordCount) {
+    uint64_t dueUs = startUs + (uint64_t)((double)(records[nextRecord].timeUs - records[0].timeUs) / speed);
+    if (dueUs > now) break;
+    if (now - dueUs > worstLagUs) worstLagUs = now - dueUs;
+
+    Session *session = &sessions[sessionOf[nextRecord++]];
+    if (session->sent < session->count && (session->fd >= 0 || session->sent == 0)) sendNext(session);
+  }
+  scheduleNext();
+}
+
+int compareLatency(const void *a, const void *b) {
+  double left = *(const double *)a, right = *(const double *)b;
+  return left < right ? -1 : left > right;
+}
+
+// Latency below which the given share of replies came
+double percentile(double share) {
+  if (answered == 0) return 0;
+  size_t index = (size_t)(share * (double)(answered - 1) + 0.5);
+  return latencies[index];
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3 || argc > 5) {
+    fprintf(stderr, "Usage: %s <capture file> <host:port | unix:/path> [speed | max] [connections]\n", argv[0]);
+    return 1;
+  }
+
+  speed = argc > 3 && strcmp(argv[3], "max") != 0 ? strtod(argv[3], NULL) : argc > 3 ? 0 : 1;
+  maxOpen = argc > 4 ? (size_t)atoi(argv[4]) : 64;
+  if (speed < 0 || (argc > 3 && speed == 0 && strcmp(argv[3], "max") != 0) || maxOpen == 0) {
+    fprintf(stderr, "[!] Speed must be a positive number or \"max\", and connections at least 1\n");
+    return 1;
+  }
+  if (resolveAddress(argv[2]) != 0) return 1;
+
+  char server[CAPTURE_SERVER_LENGTH + 1];
+  records = captureLoad(argv[1], &recordCount, server);
+  if (!records) return 1;
+  if (recordCount == 0) {
+    fprintf(stderr, "[!] No requests in %s\n", argv[1]);
+    return 1;
+  }
+  latencies = malloc(recordCount * sizeof(double));
+  if (!latencies || buildSessions() != 0) {
+    fprintf(stderr, "[!] Out of memory\n");
+    return 1;
+  }
+
+  double capturedSeconds = (double)(records[recordCount - 1].timeUs - records[0].timeUs) / 1e6;
+  printf("[*] Replaying %zu %s requests on %zu connections, captured over %.1f s, ", recordCount, server,
+         sessionCount, capturedSeconds);
+  if (speed == 0) printf("as fast as possible with up to %zu connections\n", maxOpen);
+  else printf("at %gx\n", speed);
+
+  signal(SIGPIPE, SIG_IGN);
+  loop = eventLoopNew();
+  if (!loop) return 1;
+
+  startUs = nowUs();
+  if (speed == 0) {
+    startSessions();
+  } else {
+    int timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFD < 0 || eventLoopAdd(loop, &scheduleHandler, timerFD, EPOLLIN, onSchedule, NULL) != 0) {
+      perror("Error creating schedule timer");
+      return 1;
+    }
+    scheduleNext();
+  }
+  if (sessionsDone < sessionCount) eventLoopRun(loop);
+  double elapsed = (double)(nowUs() - startUs) / 1e6;
+
+  qsort(latencies, answered, sizeof(double), compareLatency);
+  printf("[+] %zu answered, %zu failed in %.2f s: %.1f requests/s\n", answered, failed, elapsed,
+         elapsed > 0 ? (double)answered / elapsed : 0);
+  printf("[+] Latency ms: p50 %.3f, p90 %.3f, p99 %.3f, p99.9 %.3f, max %.3f\n",
+         percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), percentile(1));
+  printf("[+] Replies:");
+  for (int i = 0; i < STATUS_MAX && statuses[i].count; i++) {
+    printf("%s %s %zu", i ? "," : "", statuses[i].text, statuses[i].count);
+  }
+  printf("\n");
+  if (speed > 0) printf("[*] Requests went out up to %.3f ms behind schedule\n", (double)worstLagUs / 1000.0);
+
+  eventLoopFree(loop);
+  captureFree(records);
+  return failed > 0;
+}
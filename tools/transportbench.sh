@@ -0,0 +1,53 @@
+#!/bin/bash
+# Compare auth server round trips over loopback TCP, TLS and the Unix socket
+#
+# Usage: ./transportbench.sh [requests] [auth binary]
+# Run after ./build.sh. Two auth servers (../auth/build/auth unless given) are
+# started from scratch directories, one in HTTP mode with a Unix socket and one
+# in HTTPS mode with a throwaway certificate, both with shedding off. Each
+# transport is then timed with `VERIFY` of an unknown token, which is answered
+# without touching the database: on one persistent PIPELINE connection
+# ([requests], 20000 by default) and with a new connection per request (a tenth
+# as many). PORT overrides the first port (8491); the second is the next one.
+set -e
+cd "$(dirname "$0")"
+
+requests=${1:-20000}
+server=$(realpath "${2:-../auth/build/auth}")
+port=${PORT:-8491}
+newRequests=$(( requests / 10 ))
+
+dir=$(mktemp -d)
+serverPids=()
+cleanup() {
+  kill "${serverPids[@]}" 2>/dev/null || true
+  wait 2>/dev/null || true
+  rm -rf "$dir"
+}
+trap cleanup EXIT
+
+# start <directory> <port> <mode>
+start() {
+  mkdir -p "$1"
+  (cd "$1" && exec "$server" "$2" "$3" > server.log 2>&1) &
+  serverPids+=($!)
+  for i in $(seq 1 50); do
+    ss -Hltn "sport = :$2" | grep -q . && return
+    sleep 0.2
+  done
+  echo "[!] Auth server did not start, see $1/server.log" >&2
+  exit 1
+}
+
+mkdir -p "$dir/plain" "$dir/tls"
+printf "unix_socket %s\nshed_target_ms 0\n" "$dir/auth.sock" > "$dir/plain/auth.conf"
+printf "shed_target_ms 0\n" > "$dir/tls/auth.conf"
+openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:P-256 -nodes -subj /CN=localhost -days 1 \
+  -keyout "$dir/tls/key.pem" -out "$dir/tls/cert.pem" 2>/dev/null
+start "$dir/plain" "$port" HTTP
+start "$dir/tls" $(( port + 1 )) HTTPS
+
+for target in "127.0.0.1:$port" "tls:127.0.0.1:$(( port + 1 ))" "unix:$dir/auth.sock"; do
+  ./build/latency "$target" persistent "$requests" "VERIFY x" | grep -v segments
+  ./build/latency "$target" new "$newRequests" "VERIFY x" | grep -v segments
+done